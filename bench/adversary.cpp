@@ -0,0 +1,270 @@
+#include "adversary.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <thread>
+
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "ssh_client.h"
+#include "ssh_error.h"
+#include "ssh_types.h"
+
+namespace drop::bench {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::milliseconds;
+
+constexpr milliseconds kForever = std::chrono::hours{24};
+
+class Socket {
+public:
+	explicit Socket(int fd) : fd_{fd} {}
+
+	~Socket()
+	{
+		if (fd_ >= 0)
+			::close(fd_);
+	}
+
+	Socket(const Socket&)		 = delete;
+	Socket& operator=(const Socket&) = delete;
+
+	explicit operator bool() const noexcept
+	{
+		return fd_ >= 0;
+	}
+
+	int get() const noexcept
+	{
+		return fd_;
+	}
+
+private:
+	int fd_;
+};
+
+// Returns true once the server has closed fd, false on stop or after limit.
+// Anything the server sends meanwhile is discarded.
+bool wait_closed(int fd, milliseconds limit, const std::stop_token& stop)
+{
+	char	   buf[4096];
+	const auto deadline = Clock::now() + limit;
+
+	while (!stop.stop_requested()) {
+		const auto left = std::chrono::duration_cast<milliseconds>(
+				deadline - Clock::now());
+		if (left.count() <= 0)
+			return false;
+
+		pollfd	  p{fd, POLLIN, 0};
+		const int rc = ::poll(&p, 1,
+				      static_cast<int>(std::min<long long>(
+						      left.count(), 200)));
+		if (rc < 0 && errno != EINTR)
+			return true;
+		if (rc > 0 && ::recv(fd, buf, sizeof(buf), 0) <= 0)
+			return true;
+	}
+	return false;
+}
+
+bool authenticate(SshClient& client, const Target& t, ssh_key key)
+{
+	try {
+		client.connect(t.host, t.port, t.user, t.timeout);
+		if (key && !client.auth_pubkey(key))
+			return false;
+		if (!t.password.empty() && !client.auth_password(t.password))
+			return false;
+		return client.authenticated();
+	} catch (const SshError&) {
+		return false;
+	}
+}
+
+// Each play_* returns false when it could not reach the phase it stalls in.
+
+bool play_idle(const Target& t, const std::stop_token& stop)
+{
+	Socket s{tcp_connect(t.host, t.port)};
+	if (!s)
+		return false;
+
+	(void)wait_closed(s.get(), kForever, stop);
+	return true;
+}
+
+bool play_kex_trickle(const Target& t, const std::stop_token& stop)
+{
+	Socket s{tcp_connect(t.host, t.port)};
+	if (!s)
+		return false;
+
+	// Banner, then the length field of a packet whose body never arrives
+	// at a useful rate
+	const std::string head = std::string{"SSH-2.0-trickle\r\n"}
+				 + std::string{"\0\0\1\0", 4};
+
+	for (std::size_t i = 0; !stop.stop_requested(); ++i) {
+		const char b = i < head.size() ? head[i] : '\0';
+		if (::send(s.get(), &b, 1, MSG_NOSIGNAL) != 1)
+			return true;
+		if (wait_closed(s.get(), t.trickle_interval, stop))
+			return true;
+	}
+	return true;
+}
+
+bool play_auth_only(const Target& t, ssh_key key, const std::stop_token& stop)
+{
+	SshClient client;
+	if (!authenticate(client, t, key))
+		return false;
+
+	(void)wait_closed(ssh_get_fd(client.session().get()), kForever, stop);
+	return true;
+}
+
+bool play_shell_only(const Target& t, ssh_key key, const std::stop_token& stop)
+{
+	SshClient client;
+	if (!authenticate(client, t, key))
+		return false;
+
+	try {
+		SshChannel channel = client.open_shell();
+		(void)wait_closed(ssh_get_fd(client.session().get()), kForever,
+				  stop);
+	} catch (const SshError&) {
+		return false;
+	}
+	return true;
+}
+
+bool play_passphrase_trickle(const Target& t, ssh_key key,
+			     const std::stop_token& stop)
+{
+	SshClient client;
+	if (!authenticate(client, t, key))
+		return false;
+
+	try {
+		SshChannel	  channel = client.open_shell();
+		const std::string line	  = t.passphrase + "\n";
+		const auto	  gap = static_cast<int>(t.trickle_interval.count());
+
+		for (const char c : line) {
+			if (stop.stop_requested())
+				return true;
+			channel.write({&c, 1});
+
+			// Doubles as the inter-byte sleep; wakes early if the
+			// server gives up on us
+			const int rc = ssh_channel_poll_timeout(channel.get(),
+								gap, 0);
+			if (rc == SSH_ERROR || rc == SSH_EOF)
+				return true;
+		}
+
+		(void)channel.read_all(t.timeout * 1000);
+	} catch (const SshError&) {
+		// Server hung up mid-trickle: still a held connection
+	}
+	return true;
+}
+
+bool play(Adversary kind, const Target& t, ssh_key key,
+	  const std::stop_token& stop)
+{
+	switch (kind) {
+	case Adversary::idle:
+		return play_idle(t, stop);
+	case Adversary::kex_trickle:
+		return play_kex_trickle(t, stop);
+	case Adversary::auth_only:
+		return play_auth_only(t, key, stop);
+	case Adversary::shell_only:
+		return play_shell_only(t, key, stop);
+	case Adversary::passphrase_trickle:
+		return play_passphrase_trickle(t, key, stop);
+	}
+	return false;
+}
+
+} // namespace
+
+int tcp_connect(const std::string& host, int port)
+{
+	addrinfo hints{};
+	hints.ai_family	  = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo* res = nullptr;
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints,
+			&res)
+	    != 0)
+		return -1;
+
+	int fd = -1;
+	for (auto* ai = res; ai; ai = ai->ai_next) {
+		fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+		if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		::close(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(res);
+	return fd;
+}
+
+const char* adversary_name(Adversary kind)
+{
+	switch (kind) {
+	case Adversary::idle:
+		return "idle";
+	case Adversary::kex_trickle:
+		return "kex_trickle";
+	case Adversary::auth_only:
+		return "auth_only";
+	case Adversary::shell_only:
+		return "shell_only";
+	case Adversary::passphrase_trickle:
+		return "passphrase_trickle";
+	}
+	return "?";
+}
+
+AdversaryStats run_adversary(Adversary kind, const Target& target,
+			     std::stop_token stop)
+{
+	SshKeyPtr key;
+	if (!target.identity.empty())
+		key = load_private_key(target.identity);
+
+	AdversaryStats stats;
+	while (!stop.stop_requested()) {
+		const auto start = Clock::now();
+		if (play(kind, target, key.get(), stop)) {
+			stats.connections++;
+			stats.held_s += std::chrono::duration<double>(
+						Clock::now() - start)
+						.count();
+		} else {
+			stats.failures++;
+			// Refused outright; do not spin on the server
+			std::this_thread::sleep_for(milliseconds{100});
+		}
+	}
+	return stats;
+}
+
+} // namespace drop::bench
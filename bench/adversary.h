@@ -0,0 +1,61 @@
+#ifndef SSH_DROP_BENCH_ADVERSARY_H_
+#define SSH_DROP_BENCH_ADVERSARY_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <stop_token>
+#include <string>
+
+namespace drop::bench {
+
+// Misbehaving clients, each tying up a server thread in a different phase.
+enum class Adversary {
+	idle,		   // TCP connect, then silence
+	kex_trickle,	   // banner and first packet one byte at a time
+	auth_only,	   // authenticates, never opens a channel
+	shell_only,	   // opens a shell, never sends the passphrase
+	passphrase_trickle // passphrase one byte at a time
+};
+
+constexpr std::size_t kAdversaryCount = 5;
+
+[[nodiscard]] const char* adversary_name(Adversary kind);
+
+struct Target {
+	std::string host;
+	int	    port = 0;
+	std::string user;
+	std::string identity;
+	std::string password;
+	std::string passphrase;
+	int	    timeout = 10;
+
+	// Gap between bytes for the trickling adversaries
+	std::chrono::milliseconds trickle_interval{1000};
+};
+
+struct AdversaryStats {
+	std::uint64_t connections = 0; // reached the phase they stall in
+	std::uint64_t failures	  = 0; // refused or dropped before that
+	double	      held_s	  = 0; // total time the server kept them
+
+	void merge(const AdversaryStats& other) noexcept
+	{
+		connections += other.connections;
+		failures += other.failures;
+		held_s += other.held_s;
+	}
+};
+
+// Plain TCP connection to host:port; returns the fd, or -1.
+[[nodiscard]] int tcp_connect(const std::string& host, int port);
+
+// Plays one adversary until stop is requested, reconnecting every time the
+// server drops it.
+[[nodiscard]] AdversaryStats run_adversary(Adversary kind, const Target& target,
+					   std::stop_token stop);
+
+} // namespace drop::bench
+
+#endif // SSH_DROP_BENCH_ADVERSARY_H_
@@ -0,0 +1,433 @@
+// Load generator: opens connections against a running ssh-drop at a target
+// rate, authenticates, fetches the secret and reports throughput, error
+// rate and a latency histogram.
+//
+// With *_clients set, misbehaving clients run alongside the well-behaved
+// ones, and the report shows how much they cost the good clients and the
+// server (threads, fds, RSS via /proc/<server_pid>).
+//
+//   ssh-drop-bench-client bench.conf
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "adversary.h"
+#include "config_parser.h"
+#include "histogram.h"
+#include "proc_stats.h"
+#include "ssh_client.h"
+#include "ssh_error.h"
+#include "ssh_lib_guard.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+using drop::bench::Adversary;
+using drop::bench::AdversaryStats;
+
+struct BenchConfig {
+	std::string host = "127.0.0.1";
+	int	    port = 7022;
+	std::string user;
+
+	std::string identity;
+	std::string password;
+	std::string passphrase;
+
+	std::optional<std::string> expect;
+
+	int concurrency = 8;
+	int rate	= 0; // connections per second, 0 = as fast as possible
+	int total	= 1000;
+	int timeout	= 10;
+
+	// Adversarial clients kept connected during the run, by kind
+	std::array<int, drop::bench::kAdversaryCount> adversaries{};
+	int trickle_interval_ms = 1000;
+	int warmup		= 2;
+	int server_pid		= 0;
+	bool baseline		= false;
+
+	[[nodiscard]] bool has_adversaries() const noexcept
+	{
+		for (auto n : adversaries)
+			if (n > 0)
+				return true;
+		return false;
+	}
+
+	[[nodiscard]] drop::bench::Target target() const;
+
+	static BenchConfig load(const char* path);
+};
+
+drop::bench::Target BenchConfig::target() const
+{
+	drop::bench::Target t;
+	t.host		   = host;
+	t.port		   = port;
+	t.user		   = user;
+	t.identity	   = identity;
+	t.password	   = password;
+	t.passphrase	   = passphrase;
+	t.timeout	   = timeout;
+	t.trickle_interval = std::chrono::milliseconds{trickle_interval_ms};
+	return t;
+}
+
+BenchConfig BenchConfig::load(const char* path)
+{
+	const auto  m = drop::ConfigParser::parse(path);
+	BenchConfig cfg;
+
+	auto get = [&](const std::string& key) -> const std::string* {
+		auto it = m.find(key);
+		return it != m.end() ? &it->second : nullptr;
+	};
+
+	if (auto* v = get("host"))
+		cfg.host = *v;
+	if (auto* v = get("port"))
+		cfg.port = std::stoi(*v);
+	if (auto* v = get("user"))
+		cfg.user = *v;
+	if (auto* v = get("identity"))
+		cfg.identity = *v;
+	if (auto* v = get("password"))
+		cfg.password = *v;
+	if (auto* v = get("passphrase"))
+		cfg.passphrase = *v;
+	if (auto* v = get("expect"))
+		cfg.expect = *v;
+	if (auto* v = get("expect_file")) {
+		std::ifstream file(*v);
+		if (!file.is_open())
+			throw std::runtime_error{"Could not open " + *v};
+		std::ostringstream ss;
+		ss << file.rdbuf();
+		cfg.expect = ss.str();
+	}
+	if (auto* v = get("concurrency"))
+		cfg.concurrency = std::stoi(*v);
+	if (auto* v = get("rate"))
+		cfg.rate = std::stoi(*v);
+	if (auto* v = get("total"))
+		cfg.total = std::stoi(*v);
+	if (auto* v = get("timeout"))
+		cfg.timeout = std::stoi(*v);
+
+	for (std::size_t i = 0; i < drop::bench::kAdversaryCount; ++i) {
+		const auto kind = static_cast<drop::bench::Adversary>(i);
+		if (auto* v = get(std::string{drop::bench::adversary_name(kind)}
+				  + "_clients"))
+			cfg.adversaries[i] = std::stoi(*v);
+	}
+	if (auto* v = get("trickle_interval_ms"))
+		cfg.trickle_interval_ms = std::stoi(*v);
+	if (auto* v = get("warmup"))
+		cfg.warmup = std::stoi(*v);
+	if (auto* v = get("server_pid"))
+		cfg.server_pid = std::stoi(*v);
+	if (auto* v = get("baseline"))
+		cfg.baseline = *v == "true";
+
+	if (cfg.identity.empty() && cfg.password.empty())
+		throw std::runtime_error{"Set identity, password, or both"};
+	if (cfg.concurrency < 1 || cfg.total < 1 || cfg.rate < 0)
+		throw std::runtime_error{
+				"concurrency and total must be >= 1, rate >= 0"};
+
+	return cfg;
+}
+
+enum class Result {
+	ok,
+	connect_error,
+	auth_error,
+	fetch_error,
+	mismatch
+};
+
+constexpr std::size_t kResultCount = 5;
+
+const char* result_name(Result r)
+{
+	switch (r) {
+	case Result::ok:
+		return "ok";
+	case Result::connect_error:
+		return "connect";
+	case Result::auth_error:
+		return "auth";
+	case Result::fetch_error:
+		return "fetch";
+	case Result::mismatch:
+		return "mismatch";
+	}
+	return "?";
+}
+
+Result run_one(const BenchConfig& cfg, ssh_key key)
+{
+	drop::SshClient client;
+
+	try {
+		client.connect(cfg.host, cfg.port, cfg.user, cfg.timeout);
+	} catch (const drop::SshError&) {
+		return Result::connect_error;
+	}
+
+	try {
+		if (key && !client.auth_pubkey(key))
+			return Result::auth_error;
+		if (!cfg.password.empty()
+		    && !client.auth_password(cfg.password))
+			return Result::auth_error;
+		if (!client.authenticated())
+			return Result::auth_error;
+	} catch (const drop::SshError&) {
+		return Result::auth_error;
+	}
+
+	std::string secret;
+	try {
+		secret = client.fetch(cfg.passphrase, cfg.timeout * 1000);
+	} catch (const drop::SshError&) {
+		return Result::fetch_error;
+	}
+
+	if (cfg.expect && secret != *cfg.expect)
+		return Result::mismatch;
+	return Result::ok;
+}
+
+struct WorkerStats {
+	drop::bench::Histogram			histogram;
+	std::array<std::uint64_t, kResultCount> results{};
+};
+
+WorkerStats run_worker(const BenchConfig& cfg, std::atomic<int>& next,
+		       Clock::time_point start)
+{
+	drop::SshKeyPtr key;
+	if (!cfg.identity.empty())
+		key = drop::load_private_key(cfg.identity);
+
+	WorkerStats stats;
+	for (;;) {
+		const int i = next.fetch_add(1);
+		if (i >= cfg.total)
+			break;
+
+		// Latency is measured from the scheduled start so a slow
+		// server cannot hide queueing delay.
+		auto scheduled = Clock::now();
+		if (cfg.rate > 0) {
+			scheduled = start
+				    + std::chrono::microseconds(
+						    1'000'000LL * i / cfg.rate);
+			std::this_thread::sleep_until(scheduled);
+		}
+
+		const auto r = run_one(cfg, key.get());
+		stats.results[static_cast<std::size_t>(r)]++;
+		if (r == Result::ok)
+			stats.histogram.record(Clock::now() - scheduled);
+	}
+
+	return stats;
+}
+
+void report(const BenchConfig& cfg, const WorkerStats& total,
+	    std::chrono::duration<double> elapsed)
+{
+	std::uint64_t count = 0;
+	for (auto n : total.results)
+		count += n;
+	const auto errors = count - total.results[0];
+
+	std::printf("connections   %llu (concurrency %d, target rate %s)\n",
+		    static_cast<unsigned long long>(count), cfg.concurrency,
+		    cfg.rate ? (std::to_string(cfg.rate) + "/s").c_str()
+			     : "unlimited");
+	std::printf("elapsed       %.2f s\n", elapsed.count());
+	std::printf("throughput    %.1f handshakes/s\n",
+		    static_cast<double>(total.results[0]) / elapsed.count());
+	std::printf("errors        %llu (%.2f%%):",
+		    static_cast<unsigned long long>(errors),
+		    count ? 100.0 * static_cast<double>(errors)
+				    / static_cast<double>(count)
+			  : 0.0);
+	for (std::size_t i = 1; i < kResultCount; ++i)
+		std::printf(" %s=%llu", result_name(static_cast<Result>(i)),
+			    static_cast<unsigned long long>(total.results[i]));
+	std::printf("\n\n%s", total.histogram.render().c_str());
+}
+
+WorkerStats run_load(const BenchConfig& cfg)
+{
+	std::atomic<int>	 next{0};
+	std::vector<WorkerStats> stats(
+			static_cast<std::size_t>(cfg.concurrency));
+	std::vector<std::thread> workers;
+
+	const auto start = Clock::now();
+
+	for (auto& out : stats)
+		workers.emplace_back([&cfg, &next, &out, start] {
+			out = run_worker(cfg, next, start);
+		});
+
+	for (auto& t : workers)
+		t.join();
+
+	WorkerStats total;
+	for (const auto& ws : stats) {
+		total.histogram.merge(ws.histogram);
+		for (std::size_t i = 0; i < kResultCount; ++i)
+			total.results[i] += ws.results[i];
+	}
+	return total;
+}
+
+// One measured run of the well-behaved clients. Returns true when every
+// connection delivered.
+bool measure(const BenchConfig& cfg, const drop::bench::ProcSampler* server)
+{
+	const auto start = Clock::now();
+	const auto total = run_load(cfg);
+	report(cfg, total, Clock::now() - start);
+
+	if (server)
+		std::printf("\nserver peak   %s\nserver now    %s\n",
+			    drop::bench::format(server->peak()).c_str(),
+			    drop::bench::format(server->last()).c_str());
+
+	return total.results[0] == static_cast<std::uint64_t>(cfg.total);
+}
+
+std::unique_ptr<drop::bench::ProcSampler> sample_server(const BenchConfig& cfg)
+{
+	if (cfg.server_pid == 0)
+		return nullptr;
+	return std::make_unique<drop::bench::ProcSampler>(
+			cfg.server_pid, std::chrono::milliseconds{250});
+}
+
+// Keeps the configured adversaries connected until stop().
+class AdversaryPool {
+public:
+	explicit AdversaryPool(const BenchConfig& cfg) : target_{cfg.target()}
+	{
+		for (std::size_t i = 0; i < drop::bench::kAdversaryCount; ++i)
+			for (int n = 0; n < cfg.adversaries[i]; ++n)
+				clients_.push_back({static_cast<Adversary>(i),
+						    {}});
+
+		// clients_ no longer grows, so the references stay valid
+		for (auto& c : clients_)
+			threads_.emplace_back([this, &c](std::stop_token st) {
+				c.stats = drop::bench::run_adversary(
+						c.kind, target_, st);
+			});
+	}
+
+	std::array<AdversaryStats, drop::bench::kAdversaryCount> stop()
+	{
+		for (auto& t : threads_)
+			t.request_stop();
+		threads_.clear();
+
+		std::array<AdversaryStats, drop::bench::kAdversaryCount> out{};
+		for (const auto& c : clients_)
+			out[static_cast<std::size_t>(c.kind)].merge(c.stats);
+		return out;
+	}
+
+private:
+	struct Client {
+		Adversary      kind;
+		AdversaryStats stats;
+	};
+
+	drop::bench::Target	  target_;
+	std::vector<Client>	  clients_;
+	std::vector<std::jthread> threads_;
+};
+
+void report_adversaries(
+		const BenchConfig& cfg,
+		const std::array<AdversaryStats, drop::bench::kAdversaryCount>&
+				stats)
+{
+	std::printf("\n%-20s %8s %12s %10s %12s\n", "adversary", "clients",
+		    "connections", "refused", "mean held s");
+	for (std::size_t i = 0; i < drop::bench::kAdversaryCount; ++i) {
+		if (cfg.adversaries[i] == 0)
+			continue;
+
+		const auto& a	  = stats[i];
+		const auto  count = static_cast<double>(a.connections);
+		const auto  mean  = a.connections ? a.held_s / count : 0.0;
+		std::printf("%-20s %8d %12llu %10llu %12.1f\n",
+			    drop::bench::adversary_name(
+					    static_cast<Adversary>(i)),
+			    cfg.adversaries[i],
+			    static_cast<unsigned long long>(a.connections),
+			    static_cast<unsigned long long>(a.failures), mean);
+	}
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0] << " <bench.conf>\n";
+		return 2;
+	}
+
+	try {
+		const auto cfg = BenchConfig::load(argv[1]);
+
+		drop::SshLibGuard lib;
+
+		// Fail early on a bad key instead of inside every worker
+		if (!cfg.identity.empty())
+			(void)drop::load_private_key(cfg.identity);
+
+		if (!cfg.has_adversaries())
+			return measure(cfg, sample_server(cfg).get()) ? 0 : 1;
+
+		if (cfg.baseline) {
+			std::printf("== baseline ==\n");
+			(void)measure(cfg, sample_server(cfg).get());
+			std::printf("\n== with adversaries ==\n");
+		}
+
+		const auto    server = sample_server(cfg);
+		AdversaryPool pool{cfg};
+
+		// Let the adversaries settle into the phase they stall in
+		std::this_thread::sleep_for(std::chrono::seconds{cfg.warmup});
+
+		const bool ok = measure(cfg, server.get());
+		report_adversaries(cfg, pool.stop());
+		return ok ? 0 : 1;
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << '\n';
+		return 1;
+	}
+}
@@ -0,0 +1,109 @@
+// Micro-benchmarks for the server's hot paths.
+//
+//   ssh-drop-bench [--filter <substr>] [--min-time <ms>] [--out <file.json>]
+//   ssh-drop-bench --compare <base.json> <current.json> [--threshold <pct>]
+//
+// Results go to stdout as JSON (or to --out); progress goes to stderr.
+// Compare mode exits 1 when any benchmark got slower than the threshold
+// (default 10%).
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "log.h"
+#include "runner.h"
+#include "ssh_lib_guard.h"
+#include "suites.h"
+
+namespace {
+
+int usage(const char* argv0)
+{
+	std::cerr << "Usage: " << argv0
+		  << " [--filter <substr>] [--min-time <ms>] [--out <file>]\n"
+		  << "       " << argv0
+		  << " --compare <base.json> <current.json>"
+		     " [--threshold <pct>]\n";
+	return 2;
+}
+
+std::vector<drop::bench::Result> load(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+		throw std::runtime_error{"Could not open " + path};
+	std::ostringstream ss;
+	ss << file.rdbuf();
+	return drop::bench::from_json(ss.str());
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+	std::string filter;
+	std::string out_path;
+	std::string base_path;
+	std::string current_path;
+	double	    threshold = 10.0;
+	int	    min_time  = 500;
+
+	try {
+		for (int i = 1; i < argc; ++i) {
+			const std::string_view arg = argv[i];
+			const bool	       has_value = i + 1 < argc;
+
+			if (arg == "--filter" && has_value)
+				filter = argv[++i];
+			else if (arg == "--min-time" && has_value)
+				min_time = std::stoi(argv[++i]);
+			else if (arg == "--out" && has_value)
+				out_path = argv[++i];
+			else if (arg == "--threshold" && has_value)
+				threshold = std::stod(argv[++i]);
+			else if (arg == "--compare" && i + 2 < argc) {
+				base_path    = argv[++i];
+				current_path = argv[++i];
+			} else
+				return usage(argv[0]);
+		}
+
+		if (!base_path.empty()) {
+			const int regressions = drop::bench::compare(
+					load(base_path), load(current_path),
+					threshold);
+			return regressions ? 1 : 0;
+		}
+
+		// stdout carries the JSON; keep server logging off it
+		drop::log::init(drop::log::Level::error);
+
+		drop::SshLibGuard   lib;
+		drop::bench::Runner runner{filter,
+					   std::chrono::milliseconds{min_time}};
+
+		drop::bench::micro_suite(runner);
+		drop::bench::loopback_suite(runner);
+
+		const auto json = drop::bench::to_json(runner.results());
+		if (out_path.empty()) {
+			std::fputs(json.c_str(), stdout);
+		} else {
+			std::ofstream out(out_path, std::ios::trunc);
+			if (!(out << json))
+				throw std::runtime_error{"Could not write "
+							 + out_path};
+		}
+		return 0;
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << '\n';
+		return 1;
+	}
+}
@@ -0,0 +1,128 @@
+#include "histogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+
+namespace drop::bench {
+
+void Histogram::record(std::chrono::nanoseconds d) noexcept
+{
+	const auto us = std::chrono::duration_cast<std::chrono::microseconds>(d)
+				.count();
+	record_us(us > 0 ? static_cast<std::uint64_t>(us) : 0);
+}
+
+void Histogram::record_us(std::uint64_t us) noexcept
+{
+	buckets_[index_of(us)]++;
+	count_++;
+	sum_ += us;
+	min_ = std::min(min_, us);
+	max_ = std::max(max_, us);
+}
+
+void Histogram::merge(const Histogram& other) noexcept
+{
+	for (std::size_t i = 0; i < buckets_.size(); ++i)
+		buckets_[i] += other.buckets_[i];
+	count_ += other.count_;
+	sum_ += other.sum_;
+	min_ = std::min(min_, other.min_);
+	max_ = std::max(max_, other.max_);
+}
+
+std::uint64_t Histogram::percentile(double p) const noexcept
+{
+	if (count_ == 0)
+		return 0;
+
+	const auto rank = static_cast<std::uint64_t>(
+			p / 100.0 * static_cast<double>(count_ - 1));
+
+	std::uint64_t seen = 0;
+	for (std::size_t i = 0; i < buckets_.size(); ++i) {
+		seen += buckets_[i];
+		if (seen > rank)
+			return std::min(upper_bound(i), max_);
+	}
+	return max_;
+}
+
+double Histogram::mean() const noexcept
+{
+	return count_ ? static_cast<double>(sum_) / static_cast<double>(count_)
+		      : 0.0;
+}
+
+std::string Histogram::render() const
+{
+	std::string out;
+	char	    line[128];
+
+	std::snprintf(line, sizeof(line),
+		      "latency us: min=%llu p50=%llu p90=%llu p99=%llu "
+		      "p99.9=%llu max=%llu mean=%.1f\n",
+		      static_cast<unsigned long long>(count_ ? min_ : 0),
+		      static_cast<unsigned long long>(percentile(50)),
+		      static_cast<unsigned long long>(percentile(90)),
+		      static_cast<unsigned long long>(percentile(99)),
+		      static_cast<unsigned long long>(percentile(99.9)),
+		      static_cast<unsigned long long>(max_), mean());
+	out += line;
+
+	if (count_ == 0)
+		return out;
+
+	// Collapse the sub-buckets into one row per power of two
+	std::array<std::uint64_t, 64> rows{};
+	for (std::size_t i = 0; i < buckets_.size(); ++i)
+		rows[i / kSub] += buckets_[i];
+
+	const auto first = std::find_if(rows.begin(), rows.end(), [](auto n) {
+		return n != 0;
+	});
+	const auto last = std::find_if(rows.rbegin(), rows.rend(), [](auto n) {
+		return n != 0;
+	});
+	const auto peak = *std::max_element(rows.begin(), rows.end());
+
+	for (auto it = first; it != last.base(); ++it) {
+		const auto row	 = static_cast<std::size_t>(it - rows.begin());
+		const auto bound = upper_bound(row * kSub + kSub - 1);
+		const auto width = static_cast<int>(40 * *it / peak);
+
+		std::snprintf(line, sizeof(line), "  <= %10llu us | %-40s %llu\n",
+			      static_cast<unsigned long long>(bound),
+			      std::string(static_cast<std::size_t>(width), '#')
+					      .c_str(),
+			      static_cast<unsigned long long>(*it));
+		out += line;
+	}
+
+	return out;
+}
+
+std::size_t Histogram::index_of(std::uint64_t us) noexcept
+{
+	if (us < static_cast<std::uint64_t>(kSub))
+		return static_cast<std::size_t>(us);
+
+	const int msb	= std::bit_width(us) - 1;
+	const int shift = msb - kSubBits;
+	return static_cast<std::size_t>((shift + 1) * kSub)
+	       + static_cast<std::size_t>((us >> shift) - kSub);
+}
+
+std::uint64_t Histogram::upper_bound(std::size_t index) noexcept
+{
+	if (index < static_cast<std::size_t>(kSub))
+		return index;
+
+	const auto shift = static_cast<int>(index / kSub) - 1;
+	const auto sub	 = static_cast<std::uint64_t>(index % kSub);
+	const auto lower = (kSub + sub) << shift;
+	return lower + (std::uint64_t{1} << shift) - 1;
+}
+
+} // namespace drop::bench
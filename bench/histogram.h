@@ -0,0 +1,53 @@
+#ifndef SSH_DROP_BENCH_HISTOGRAM_H_
+#define SSH_DROP_BENCH_HISTOGRAM_H_
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+namespace drop::bench {
+
+// Log-linear latency histogram in microseconds: eight linear sub-buckets
+// per power of two, so any percentile is within 12.5% of the true value.
+class Histogram {
+public:
+	void record(std::chrono::nanoseconds d) noexcept;
+	void record_us(std::uint64_t us) noexcept;
+	void merge(const Histogram& other) noexcept;
+
+	[[nodiscard]] std::uint64_t count() const noexcept
+	{
+		return count_;
+	}
+
+	[[nodiscard]] std::uint64_t percentile(double p) const noexcept;
+	[[nodiscard]] double	    mean() const noexcept;
+	[[nodiscard]] std::uint64_t max() const noexcept
+	{
+		return max_;
+	}
+
+	// Percentile summary followed by one bar per power of two.
+	[[nodiscard]] std::string render() const;
+
+private:
+	static constexpr int kSubBits = 3;
+	static constexpr int kSub     = 1 << kSubBits;
+
+	static std::size_t   index_of(std::uint64_t us) noexcept;
+	static std::uint64_t upper_bound(std::size_t index) noexcept;
+
+	std::array<std::uint64_t, 64 * kSub> buckets_{};
+
+	std::uint64_t count_ = 0;
+	std::uint64_t sum_   = 0;
+	std::uint64_t min_   = std::numeric_limits<std::uint64_t>::max();
+	std::uint64_t max_   = 0;
+};
+
+} // namespace drop::bench
+
+#endif // SSH_DROP_BENCH_HISTOGRAM_H_
@@ -0,0 +1,36 @@
+#include "keys.h"
+
+#include "ssh_error.h"
+
+namespace drop::bench {
+
+SshKeyPtr generate_key(ssh_keytypes_e type, int bits)
+{
+	ssh_key raw = nullptr;
+	if (ssh_pki_generate(type, bits, &raw) != SSH_OK)
+		throw SshError{std::string{"Could not generate "}
+			       + ssh_key_type_to_char(type) + " key"};
+	return SshKeyPtr{raw};
+}
+
+std::string public_key_line(ssh_key key)
+{
+	char* b64 = nullptr;
+	if (ssh_pki_export_pubkey_base64(key, &b64) != SSH_OK)
+		throw SshError{"Could not export public key"};
+
+	std::string line = std::string{ssh_key_type_to_char(ssh_key_type(key))}
+			   + " " + b64;
+	ssh_string_free_char(b64);
+	return line;
+}
+
+void write_private_key(ssh_key key, const std::filesystem::path& path)
+{
+	if (ssh_pki_export_privkey_file(key, nullptr, nullptr, nullptr,
+					path.string().c_str())
+	    != SSH_OK)
+		throw SshError{"Could not write private key: " + path.string()};
+}
+
+} // namespace drop::bench
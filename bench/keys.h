@@ -0,0 +1,24 @@
+#ifndef SSH_DROP_BENCH_KEYS_H_
+#define SSH_DROP_BENCH_KEYS_H_
+
+#include <filesystem>
+#include <string>
+
+#include "ssh_types.h"
+
+namespace drop::bench {
+
+// Fresh key pair, ed25519 unless asked otherwise; bits is only used for
+// RSA and ECDSA. Throws SshError.
+[[nodiscard]] SshKeyPtr generate_key(ssh_keytypes_e type = SSH_KEYTYPE_ED25519,
+				     int	    bits = 0);
+
+// "<type> <base64>" as it appears in authorized_keys.
+[[nodiscard]] std::string public_key_line(ssh_key key);
+
+// Writes the private half in OpenSSH format, unencrypted.
+void write_private_key(ssh_key key, const std::filesystem::path& path);
+
+} // namespace drop::bench
+
+#endif // SSH_DROP_BENCH_KEYS_H_
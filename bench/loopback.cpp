@@ -0,0 +1,152 @@
+#include "loopback.h"
+
+#include <exception>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "connection_handler.h"
+#include "session_protocol.h"
+
+namespace drop::bench {
+
+Loopback::Loopback(const std::vector<std::filesystem::path>& host_keys)
+{
+	for (const auto& path : host_keys)
+		bind_.set_host_key(path.string());
+}
+
+int Loopback::start(std::jthread& server, const IAuthenticator& authenticator,
+		    const ISecretProvider& provider, const Credentials& creds,
+		    int timeout_s, std::string& server_error)
+{
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		throw std::runtime_error{"socketpair() failed"};
+
+	SshSession server_session;
+	try {
+		bind_.accept_fd(server_session, fds[0]);
+	} catch (...) {
+		::close(fds[0]);
+		::close(fds[1]);
+		throw;
+	}
+
+	server = std::jthread{[&, s = std::move(server_session),
+			       conn_id = next_conn_id_++]() mutable {
+		try {
+			ConnectionOptions options;
+			options.prompt_passphrase = creds.prompt;
+			options.secrets		  = secrets_;
+			options.watch		  = watch_;
+			ConnectionHandler handler{std::move(s), authenticator,
+						  provider, timeout_s, conn_id,
+						  options};
+			handler.run();
+		} catch (const std::exception& e) {
+			server_error = e.what();
+		}
+	}};
+	return fds[1];
+}
+
+Delivery Loopback::connect(const IAuthenticator&  authenticator,
+			   const ISecretProvider& provider,
+			   const Credentials& creds, int timeout_s)
+{
+	Delivery     result;
+	std::jthread server;
+	const int    fd = start(server, authenticator, provider, creds,
+				timeout_s, result.server_error);
+
+	// The client must be gone before joining: a denied client leaves the
+	// server polling for auth until it sees the disconnect.
+	try {
+		SshClient client;
+		client.connect_fd(fd, "bench", timeout_s);
+
+		if (creds.key)
+			(void)client.auth_pubkey(creds.key);
+		if (!creds.password.empty())
+			(void)client.auth_password(creds.password);
+		if (creds.prompt && !client.authenticated())
+			(void)client.auth_kbdint(creds.passphrase);
+
+		// Already given at the prompt, not sent again on the channel
+		const std::string_view passphrase =
+				creds.prompt ? std::string_view{}
+					     : creds.passphrase;
+
+		result.authenticated = client.authenticated();
+		if (result.authenticated && creds.requests > 0) {
+			auto channel = client.open_subsystem();
+			for (std::uint64_t i = 0; i < creds.requests; ++i)
+				result.secret = client.request(
+						channel, creds.command,
+						timeout_s * 1000);
+		} else if (result.authenticated && !creds.command.empty())
+			result.secret = client.fetch_exec(creds.command,
+							  passphrase,
+							  timeout_s * 1000);
+		else if (result.authenticated)
+			result.secret = client.fetch(passphrase,
+						     timeout_s * 1000);
+	} catch (const std::exception& e) {
+		result.client_error = e.what();
+	}
+
+	server.join();
+	return result;
+}
+
+std::unique_ptr<Watcher> Loopback::watch(const IAuthenticator&	authenticator,
+					 const ISecretProvider& provider,
+					 ssh_key key, int timeout_s)
+{
+	const Credentials creds{key, "", "", "WATCH"};
+	std::string	  server_error;
+	std::jthread	  server;
+	const int fd = start(server, authenticator, provider, creds, timeout_s,
+			     server_error);
+
+	// The handler thread ends once the hub has the session
+	auto watcher = std::make_unique<Watcher>();
+	try {
+		watcher->client.connect_fd(fd, "bench", timeout_s);
+		if (!watcher->client.auth_pubkey(key))
+			throw std::runtime_error{"Watcher denied"};
+		watcher->channel.emplace(watcher->client.open_subsystem());
+		watcher->channel->write(protocol::frame("WATCH"));
+	} catch (...) {
+		watcher.reset();
+		server.join();
+		throw;
+	}
+	server.join();
+	if (!server_error.empty())
+		throw std::runtime_error{"Watcher: " + server_error};
+	return watcher;
+}
+
+void Loopback::accept_only()
+{
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		throw std::runtime_error{"socketpair() failed"};
+
+	SshSession session;
+	try {
+		bind_.accept_fd(session, fds[0]);
+	} catch (...) {
+		::close(fds[0]);
+		::close(fds[1]);
+		throw;
+	}
+	::close(fds[1]);
+}
+
+} // namespace drop::bench
@@ -0,0 +1,106 @@
+#ifndef SSH_DROP_BENCH_LOOPBACK_H_
+#define SSH_DROP_BENCH_LOOPBACK_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "authenticator.h"
+#include "secret_provider.h"
+#include "ssh_client.h"
+#include "ssh_types.h"
+#include "watch_hub.h"
+
+namespace drop::bench {
+
+struct Credentials {
+	ssh_key	    key = nullptr;
+	std::string password;
+	std::string passphrase;
+	// Exec request to send instead of opening a shell, e.g. "get"
+	std::string command;
+	// Server asks for the passphrase during keyboard-interactive auth
+	bool prompt = false;
+	// When set, open the ssh-drop subsystem instead and send `command`
+	// as a request this many times; the last reply is the delivery
+	std::uint64_t requests = 0;
+};
+
+struct Delivery {
+	bool	    authenticated = false;
+	std::string secret;
+	std::string client_error;
+	std::string server_error;
+};
+
+// A client left on an ssh-drop session after WATCH
+struct Watcher {
+	SshClient		  client;
+	std::optional<SshChannel> channel;
+
+	// Blocks for the next pushed value; the current one comes first
+	std::string next(int timeout_ms)
+	{
+		return client.read_reply(*channel, timeout_ms);
+	}
+};
+
+// Runs a ConnectionHandler and an SshClient in one process, joined by a
+// socketpair() instead of TCP, and drives one connection through kex, auth,
+// shell and delivery. No port, no kernel network stack.
+class Loopback {
+public:
+	explicit Loopback(const std::vector<std::filesystem::path>& host_keys);
+
+	// For setting algorithm preferences between connections
+	SshBind& bind() noexcept
+	{
+		return bind_;
+	}
+
+	// Named secrets the server side can deliver
+	void set_secrets(const SecretDirectory* secrets) noexcept
+	{
+		secrets_ = secrets;
+	}
+
+	// Hub that sessions sending WATCH are handed to
+	void set_watch(WatchHub* watch) noexcept
+	{
+		watch_ = watch;
+	}
+
+	Delivery connect(const IAuthenticator&  authenticator,
+			 const ISecretProvider& provider,
+			 const Credentials&	creds,
+			 int			timeout_s = 5);
+
+	// Logs in with key and subscribes; needs a hub from set_watch().
+	std::unique_ptr<Watcher> watch(const IAuthenticator&  authenticator,
+				       const ISecretProvider& provider,
+				       ssh_key key, int timeout_s = 5);
+
+	// Accepts a session on a fresh socketpair and drops it before kex:
+	// the fixed per-connection cost of the bind.
+	void accept_only();
+
+private:
+	// Runs the handler for one end of a fresh socketpair on server and
+	// returns the other end for the client
+	int start(std::jthread& server, const IAuthenticator& authenticator,
+		  const ISecretProvider& provider, const Credentials& creds,
+		  int timeout_s, std::string& server_error);
+
+	SshBind		       bind_;
+	const SecretDirectory* secrets_	     = nullptr;
+	WatchHub*	       watch_	     = nullptr;
+	std::uint64_t	       next_conn_id_ = 1;
+};
+
+} // namespace drop::bench
+
+#endif // SSH_DROP_BENCH_LOOPBACK_H_
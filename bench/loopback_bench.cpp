@@ -0,0 +1,960 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "authenticator.h"
+#include "crypto.h"
+#include "drop_server.h"
+#include "keys.h"
+#include "loopback.h"
+#include "proc_stats.h"
+#include "secret_provider.h"
+#include "server_config.h"
+#include "suites.h"
+
+namespace drop::bench {
+
+namespace {
+
+constexpr auto kSecret	   = "s3cret-value";
+constexpr auto kPassword   = "hunter2";
+constexpr auto kPassphrase = "open sesame";
+
+// Fixed ports for the checks that run a whole server; soak uses 17022
+constexpr int kFilterPort    = 17031;
+constexpr int kLimiterPort   = 17032;
+constexpr int kAdmissionPort = 17033;
+
+struct Case {
+	const char*	       name;
+	const IAuthenticator&  authenticator;
+	const ISecretProvider& provider;
+	Credentials	       creds;
+	bool		       delivers;
+	// What a delivery looks like; framed values for a batch
+	std::string expected = kSecret;
+};
+
+std::unique_ptr<IAuthenticator> make_auth(int methods,
+					  const std::filesystem::path& keys)
+{
+	return std::make_unique<Authenticator>(
+			methods, keys,
+			std::make_unique<StaticSecretProvider>(kPassword),
+			nullptr);
+}
+
+// Each check fails the whole run: a benchmark of a broken flow is
+// meaningless.
+void verify(Runner& runner, Loopback& loopback, const Case& c)
+{
+	const std::string name = std::string{"loopback.verify/"} + c.name;
+	if (!runner.selected(name))
+		return;
+
+	const auto d = loopback.connect(c.authenticator, c.provider, c.creds);
+	const bool delivered = d.authenticated && d.secret == c.expected;
+	if (delivered != c.delivers)
+		throw std::runtime_error{
+				name + ": expected "
+				+ (c.delivers ? "delivery" : "no delivery")
+				+ ", got secret='" + d.secret + "' client='"
+				+ d.client_error + "' server='" + d.server_error
+				+ "'"};
+
+	std::fprintf(stderr, "%-40s ok\n", name.c_str());
+}
+
+void handshakes(Loopback& loopback, const Case& c, std::uint64_t n)
+{
+	for (std::uint64_t i = 0; i < n; ++i) {
+		const auto d = loopback.connect(c.authenticator, c.provider,
+						c.creds);
+		if (d.secret != c.expected)
+			throw std::runtime_error{
+					std::string{"Handshake failed: "}
+					+ c.name};
+	}
+}
+
+void bench(Runner& runner, Loopback& loopback, const Case& c)
+{
+	const std::string tag = std::string{"/"} + c.name;
+	runner.run("loopback.handshake" + tag, [&](std::uint64_t n) {
+		handshakes(loopback, c, n);
+	});
+	runner.run(
+			"loopback.handshake_cpu" + tag,
+			[&](std::uint64_t n) { handshakes(loopback, c, n); },
+			Timer::cpu);
+}
+
+// Cost of one request on an open ssh-drop session, the handshake spread
+// over the whole run
+void bench_session(Runner& runner, Loopback& loopback, const Case& c)
+{
+	const std::string name = std::string{"loopback.session_request/"}
+				 + c.name;
+	runner.run(name, [&](std::uint64_t n) {
+		auto creds     = c.creds;
+		creds.requests = n;
+		const auto d   = loopback.connect(c.authenticator, c.provider,
+						  creds);
+		if (d.secret != c.expected)
+			throw std::runtime_error{name + ": " + d.client_error};
+	});
+}
+
+// Replaces the file the way deploy tools do, so the hub sees one complete
+// write
+void rotate(const std::filesystem::path& path, const std::string& value)
+{
+	auto tmp = path;
+	tmp += ".tmp";
+	std::ofstream(tmp) << value;
+	std::filesystem::rename(tmp, path);
+}
+
+// Subscribers see the current value at once and a rotation right after,
+// and every rotation reaches all kWatchers of them
+void bench_watch(Runner& runner, Loopback& loopback,
+		 const IAuthenticator& authenticator, const ScratchDir& dir,
+		 ssh_key key)
+{
+	constexpr int kWatchers	 = 64;
+	constexpr int kTimeoutMs = 5000;
+
+	const std::string verify_name = "loopback.verify/watch";
+	const std::string bench_name  = "loopback.watch_push/"
+				       + std::to_string(kWatchers);
+	if (!runner.selected(verify_name) && !runner.selected(bench_name))
+		return;
+
+	const auto path = dir.file("watched");
+	rotate(path, "v0");
+	const auto provider = std::make_shared<const FileSecretProvider>(path);
+	WatchHub   hub{provider, path, {}};
+	loopback.set_watch(&hub);
+
+	std::vector<std::unique_ptr<Watcher>> watchers;
+	for (int i = 0; i < kWatchers; ++i)
+		watchers.push_back(
+				loopback.watch(authenticator, *provider, key));
+
+	auto expect = [&](const std::string& value, const char* what) {
+		for (auto& w : watchers)
+			if (w->next(kTimeoutMs) != value)
+				throw std::runtime_error{verify_name + ": "
+							 + what};
+	};
+	expect("v0", "no first push");
+	rotate(path, "v1");
+	expect("v1", "rotation not pushed");
+	std::fprintf(stderr, "%-40s ok\n", verify_name.c_str());
+
+	std::uint64_t version = 1;
+	runner.run(bench_name, [&](std::uint64_t n) {
+		for (std::uint64_t i = 0; i < n; ++i) {
+			const auto value = "v" + std::to_string(++version);
+			rotate(path, value);
+			for (auto& w : watchers)
+				if (w->next(kTimeoutMs) != value)
+					throw std::runtime_error{
+							bench_name
+							+ ": lost a push"};
+		}
+	});
+
+	watchers.clear();
+	loopback.set_watch(nullptr);
+}
+
+// A reload whose cipher list libssh rejects must leave the bind serving
+// with the keys and lists it had
+void verify_reload(Runner& runner, Loopback& loopback,
+		   const std::filesystem::path& host_key, const Case& c)
+{
+	const std::string name = "loopback.verify/reload_bad_algorithms";
+	if (!runner.selected(name))
+		return;
+
+	ServerConfig config;
+	config.host_key_paths = {host_key.string()};
+	config.kex_algorithms = "curve25519-sha256";
+	config.ciphers	      = "no-such-cipher";
+	try {
+		reconfigure_bind(loopback.bind(), config);
+		throw std::runtime_error{name + ": bad cipher list accepted"};
+	} catch (const SshError&) {
+	}
+
+	const auto d = loopback.connect(c.authenticator, c.provider, c.creds);
+	if (d.secret != c.expected)
+		throw std::runtime_error{name + ": no delivery after reload, "
+					 + d.client_error};
+	std::fprintf(stderr, "%-40s ok\n", name.c_str());
+}
+
+// Workers sharing one listener all wake for a connection; those that lose
+// the accept() must come straight back round their loop, not block in it
+// until the next connection
+void verify_shared_listener(Runner&			 runner,
+			    const std::filesystem::path& host_key)
+{
+	constexpr int	  kWorkers = 4;
+	const std::string name	   = "loopback.verify/shared_listener";
+	if (!runner.selected(name))
+		return;
+
+	SshBind bind;
+	bind.set_port("0");
+	bind.set_host_key(host_key.string());
+	bind.listen();
+
+	sockaddr_in addr{};
+	socklen_t   len = sizeof(addr);
+	if (::getsockname(ssh_bind_get_fd(bind.get()),
+			  reinterpret_cast<sockaddr*>(&addr), &len)
+	    != 0)
+		throw std::runtime_error{name + ": getsockname() failed"};
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	auto connect = [&] {
+		const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+		if (fd >= 0
+		    && ::connect(fd, reinterpret_cast<const sockaddr*>(&addr),
+				 sizeof(addr))
+			       == 0)
+			return fd;
+		if (fd >= 0)
+			::close(fd);
+		throw std::runtime_error{name + ": connect() failed"};
+	};
+
+	std::atomic<int>				 accepted{0};
+	std::atomic<int>				 running{kWorkers};
+	std::array<std::atomic<std::uint64_t>, kWorkers> passes{};
+	std::vector<std::jthread>			 workers;
+	for (std::size_t i = 0; i < kWorkers; ++i)
+		workers.emplace_back([&, i](const std::stop_token& stop) {
+			while (!stop.stop_requested()) {
+				passes[i]++;
+				if (!bind.wait_for_connection(100))
+					continue;
+				sockaddr_storage peer{};
+				const socket_t	 fd = bind.accept_socket(peer);
+				if (fd == SSH_INVALID_SOCKET)
+					continue;
+				accepted++;
+				close_socket(fd);
+			}
+			running--;
+		});
+
+	const int client = connect();
+	for (int i = 0; i < 100 && accepted == 0; ++i)
+		std::this_thread::sleep_for(std::chrono::milliseconds{20});
+
+	std::array<std::uint64_t, kWorkers> before{};
+	for (std::size_t i = 0; i < kWorkers; ++i)
+		before[i] = passes[i];
+	std::this_thread::sleep_for(std::chrono::milliseconds{500});
+
+	int stuck = 0;
+	for (std::size_t i = 0; i < kWorkers; ++i)
+		if (passes[i] == before[i])
+			stuck++;
+	::close(client);
+
+	// Once the others are gone, connections free any stuck worker
+	for (auto& w : workers)
+		w.request_stop();
+	while (running > 0) {
+		std::this_thread::sleep_for(std::chrono::milliseconds{150});
+		if (running > 0)
+			::close(connect());
+	}
+	if (stuck > 0 || accepted != 1)
+		throw std::runtime_error{
+				name + ": " + std::to_string(stuck)
+				+ " workers blocked in accept(), "
+				+ std::to_string(accepted.load())
+				+ " connections accepted"};
+	std::fprintf(stderr, "%-40s ok\n", name.c_str());
+}
+
+// What a server did first with a raw TCP connection
+enum class Greeting { banner, closed, reset, silent };
+
+const char* greeting_name(Greeting g)
+{
+	switch (g) {
+	case Greeting::banner:
+		return "banner";
+	case Greeting::closed:
+		return "closed";
+	case Greeting::reset:
+		return "reset";
+	case Greeting::silent:
+		return "silent";
+	}
+	return "?";
+}
+
+// A TCP connection to a loopback port from a chosen 127/8 address, for what
+// the server does before it speaks SSH. Throws std::runtime_error when the
+// connection cannot be made.
+class Probe {
+public:
+	Probe(int port, const char* source)
+	    : fd_{::socket(AF_INET, SOCK_STREAM, 0)}
+	{
+		sockaddr_in from{};
+		from.sin_family = AF_INET;
+		sockaddr_in to{};
+		to.sin_family	   = AF_INET;
+		to.sin_port	   = htons(static_cast<std::uint16_t>(port));
+		to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (fd_ < 0 || ::inet_pton(AF_INET, source, &from.sin_addr) != 1
+		    || ::bind(fd_, reinterpret_cast<const sockaddr*>(&from),
+			      sizeof(from))
+			       != 0
+		    || ::connect(fd_, reinterpret_cast<const sockaddr*>(&to),
+				 sizeof(to))
+			       != 0) {
+			if (fd_ >= 0)
+				::close(fd_);
+			throw std::runtime_error{std::string{"connect from "}
+						 + source + " failed"};
+		}
+	}
+
+	~Probe()
+	{
+		::close(fd_);
+	}
+
+	Probe(const Probe&)	       = delete;
+	Probe& operator=(const Probe&) = delete;
+
+	// Waits up to timeout_ms for the SSH banner, an orderly close or a
+	// reset
+	[[nodiscard]] Greeting greeting(int timeout_ms = 2000) const
+	{
+		pollfd p{fd_, POLLIN, 0};
+		if (::poll(&p, 1, timeout_ms) <= 0)
+			return Greeting::silent;
+
+		char	      buf[8];
+		const ssize_t n = ::recv(fd_, buf, sizeof(buf), 0);
+		if (n > 0) {
+			const std::string_view head{
+					buf, static_cast<std::size_t>(n)};
+			return head.starts_with("SSH-") ? Greeting::banner
+							: Greeting::silent;
+		}
+		if (n < 0 && errno == ECONNRESET)
+			return Greeting::reset;
+		return Greeting::closed;
+	}
+
+private:
+	int fd_;
+};
+
+// Throws unless a connection from source sees want
+void expect_greeting(const std::string& name, int port, const char* source,
+		     Greeting want)
+{
+	const Probe    probe{port, source};
+	const Greeting got = probe.greeting();
+	if (got != want)
+		throw std::runtime_error{name + ": " + source + " got "
+					 + greeting_name(got) + ", expected "
+					 + greeting_name(want)};
+}
+
+// Whole HTTP reply to GET path from a LocalEndpoint on a unix socket
+std::string http_get(const std::filesystem::path& socket, const char* path)
+{
+	sockaddr_un addr{};
+	addr.sun_family	  = AF_UNIX;
+	const auto native = socket.string();
+	if (native.size() >= sizeof(addr.sun_path))
+		throw std::runtime_error{native + ": socket path too long"};
+	std::memcpy(addr.sun_path, native.c_str(), native.size() + 1);
+
+	const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0
+	    || ::connect(fd, reinterpret_cast<const sockaddr*>(&addr),
+			 sizeof(addr))
+		       != 0) {
+		if (fd >= 0)
+			::close(fd);
+		throw std::runtime_error{native + ": connect() failed"};
+	}
+
+	const std::string request =
+			std::string{"GET "} + path + " HTTP/1.0\r\n\r\n";
+	std::string reply;
+	if (::send(fd, request.data(), request.size(), MSG_NOSIGNAL)
+	    == static_cast<ssize_t>(request.size())) {
+		char	buf[4096];
+		ssize_t n;
+		while ((n = ::recv(fd, buf, sizeof(buf), 0)) > 0)
+			reply.append(buf, static_cast<std::size_t>(n));
+	}
+	::close(fd);
+	return reply;
+}
+
+// Value of an unlabelled sample in Prometheus text; throws when absent
+std::uint64_t sample(const std::string& text, const std::string& metric)
+{
+	const auto at = text.find('\n' + metric + ' ');
+	if (at == std::string::npos)
+		throw std::runtime_error{metric + " missing from metrics"};
+	return std::stoull(text.substr(at + metric.size() + 2));
+}
+
+// Pubkey server on port with the suite's keys, for the checks below to
+// adjust
+ServerConfig local_config(const ScratchDir& dir, int port)
+{
+	ServerConfig config;
+	config.port		    = std::to_string(port);
+	config.host_key_paths	    = {dir.file("host_key").string()};
+	config.authorized_keys_path = dir.file("authorized_keys").string();
+	config.auth_method	    = "publickey";
+	config.auth_timeout	    = 5;
+	config.secret		    = kSecret;
+	return config;
+}
+
+// A whole DropServer run in this process, as soak runs one: the accept
+// loop and what it does before key exchange are out of the Loopback's
+// reach. Ready once a connection from 127.0.0.1 goes through.
+class LocalServer {
+public:
+	explicit LocalServer(const ServerConfig& config)
+	    : server_{config, make_authenticator(config),
+		      make_secret_provider(config)},
+	      thread_{[this] {
+		      try {
+			      server_.run(running_);
+		      } catch (const std::exception& e) {
+			      error_ = e.what();
+		      }
+	      }}
+	{
+		const int port = std::stoi(config.port);
+		for (int i = 0; i < 50; ++i) {
+			try {
+				const Probe probe{port, "127.0.0.1"};
+				return;
+			} catch (const std::runtime_error&) {
+			}
+			std::this_thread::sleep_for(
+					std::chrono::milliseconds{100});
+		}
+		stop();
+		throw std::runtime_error{"server did not listen on port "
+					 + config.port + ": " + error_};
+	}
+
+	~LocalServer()
+	{
+		stop();
+	}
+
+	LocalServer(const LocalServer&)		   = delete;
+	LocalServer& operator=(const LocalServer&) = delete;
+
+private:
+	void stop() noexcept
+	{
+		running_ = false;
+		if (thread_.joinable())
+			thread_.join();
+	}
+
+	DropServer	  server_;
+	std::atomic<bool> running_{true};
+	std::string	  error_;
+	std::jthread	  thread_;
+};
+
+// A denied address is closed before the banner even inside an allowed
+// prefix, and with an allow list, so is anything off it
+void verify_ip_filter(Runner& runner, const ScratchDir& dir)
+{
+	const std::string name = "loopback.verify/ip_filter";
+	if (!runner.selected(name))
+		return;
+
+	auto config	  = local_config(dir, kFilterPort);
+	config.allow_from = {"127.0.0.0/24"};
+	config.deny_from  = {"127.0.0.2/32"};
+	config.validate();
+	const LocalServer server{config};
+
+	expect_greeting(name, kFilterPort, "127.0.0.1", Greeting::banner);
+	expect_greeting(name, kFilterPort, "127.0.0.2", Greeting::closed);
+	expect_greeting(name, kFilterPort, "127.0.1.1", Greeting::closed);
+	std::fprintf(stderr, "%-40s ok\n", name.c_str());
+}
+
+// A source past its burst is closed before the banner until its bucket
+// refills; the readiness probe comes from another address
+void verify_rate_limit(Runner& runner, const ScratchDir& dir)
+{
+	constexpr int	  kBurst = 3;
+	const std::string name	 = "loopback.verify/rate_limit";
+	if (!runner.selected(name))
+		return;
+
+	auto config	  = local_config(dir, kLimiterPort);
+	config.rate_limit = 1.0;
+	config.rate_burst = kBurst;
+	config.validate();
+	const LocalServer server{config};
+
+	for (int i = 0; i < kBurst; ++i)
+		expect_greeting(name, kLimiterPort, "127.0.0.3",
+				Greeting::banner);
+	expect_greeting(name, kLimiterPort, "127.0.0.3", Greeting::closed);
+	expect_greeting(name, kLimiterPort, "127.0.0.4", Greeting::banner);
+
+	// One token a second
+	std::this_thread::sleep_for(std::chrono::milliseconds{1200});
+	expect_greeting(name, kLimiterPort, "127.0.0.3", Greeting::banner);
+	std::fprintf(stderr, "%-40s ok\n", name.c_str());
+}
+
+// With every admission slot held by a connection stalled in key exchange,
+// the next one is reset before the banner, /readyz reports the limit and
+// the shed counter moves; once the slots are free, /readyz recovers
+void verify_admission(Runner& runner, const ScratchDir& dir)
+{
+	constexpr int	  kMax = 2;
+	const std::string name = "loopback.verify/admission";
+	if (!runner.selected(name))
+		return;
+
+	const auto health  = dir.file("health.sock");
+	const auto metrics = dir.file("metrics.sock");
+	const auto shed	   = "ssh_drop_connections_shed_total";
+
+	auto config		 = local_config(dir, kAdmissionPort);
+	config.latency_target_ms = 250;
+	config.concurrency_min	 = 1;
+	config.concurrency_max	 = kMax;
+	config.health_listen	 = health.string();
+	config.metrics_socket	 = metrics.string();
+	config.validate();
+	const LocalServer server{config};
+
+	// The readiness probe holds a slot until its key exchange fails
+	auto ready = [&](const char* status) {
+		for (int i = 0; i < 50; ++i) {
+			if (http_get(health, "/readyz").starts_with(status))
+				return true;
+			std::this_thread::sleep_for(
+					std::chrono::milliseconds{40});
+		}
+		return false;
+	};
+	if (!ready("HTTP/1.0 200"))
+		throw std::runtime_error{name + ": not ready at start"};
+	const auto shed_before = sample(http_get(metrics, "/metrics"), shed);
+
+	{
+		std::vector<std::unique_ptr<Probe>> stalled;
+		for (int i = 0; i < kMax; ++i) {
+			stalled.push_back(std::make_unique<Probe>(
+					kAdmissionPort, "127.0.0.5"));
+			if (stalled.back()->greeting() != Greeting::banner)
+				throw std::runtime_error{name + ": refused "
+							 "below the limit"};
+		}
+		expect_greeting(name, kAdmissionPort, "127.0.0.6",
+				Greeting::reset);
+
+		const auto readyz = http_get(health, "/readyz");
+		if (!readyz.starts_with("HTTP/1.0 503")
+		    || readyz.find("at admission limit") == std::string::npos)
+			throw std::runtime_error{name + ": /readyz at the "
+						 "limit said " + readyz};
+		if (sample(http_get(metrics, "/metrics"), shed) <= shed_before)
+			throw std::runtime_error{name + ": shed connection "
+						 "not counted"};
+	}
+
+	if (!ready("HTTP/1.0 200"))
+		throw std::runtime_error{name + ": not ready once the stalled "
+					 "connections left"};
+	std::fprintf(stderr, "%-40s ok\n", name.c_str());
+}
+
+// Per-accept CPU and read/write syscalls. With the host key imported once
+// at startup, an accept should not touch the filesystem at all.
+void bench_accept(Runner& runner, Loopback& loopback)
+{
+	runner.run(
+			"loopback.accept",
+			[&](std::uint64_t n) {
+				for (std::uint64_t i = 0; i < n; ++i)
+					loopback.accept_only();
+			},
+			Timer::cpu);
+
+	if (!runner.selected("loopback.accept"))
+		return;
+
+	constexpr int kAccepts = 1000;
+	const auto    before   = read_proc_stats(0);
+	for (int i = 0; i < kAccepts; ++i)
+		loopback.accept_only();
+	const auto after = read_proc_stats(0);
+
+	std::fprintf(stderr,
+		     "%-40s %.2f read + %.2f write syscalls/accept\n",
+		     "loopback.accept",
+		     static_cast<double>(after.syscr - before.syscr) / kAccepts,
+		     static_cast<double>(after.syscw - before.syscw)
+				     / kAccepts);
+}
+
+const std::string kAlgorithmPrefix = "loopback.algorithms/";
+
+struct Algorithm {
+	const char* label;
+	const char* name;
+};
+
+constexpr std::array<Algorithm, 3> kKex = {{
+		{"curve25519", "curve25519-sha256"},
+		{"p256", "ecdh-sha2-nistp256"},
+		{"dh14", "diffie-hellman-group14-sha256"},
+}};
+
+constexpr std::array<Algorithm, 3> kHostKeyAlgorithms = {{
+		{"ed25519", "ssh-ed25519"},
+		{"ecdsa256", "ecdsa-sha2-nistp256"},
+		{"rsa4096", "rsa-sha2-512"},
+}};
+
+constexpr std::array<Algorithm, 3> kCiphers = {{
+		{"chacha20", "chacha20-poly1305@openssh.com"},
+		{"aes256gcm", "aes256-gcm@openssh.com"},
+		{"aes128ctr", "aes128-ctr"},
+}};
+
+std::string combo_name(const Algorithm& kex, const Algorithm& host,
+		       const Algorithm& cipher)
+{
+	return kAlgorithmPrefix + kex.label + '+' + host.label + '+'
+	       + cipher.label;
+}
+
+// One host key of each type, so any host key algorithm can be negotiated.
+std::vector<std::filesystem::path> write_host_keys(const ScratchDir& dir)
+{
+	const std::vector<std::pair<ssh_keytypes_e, int>> types = {
+			{SSH_KEYTYPE_ED25519, 0},
+			{SSH_KEYTYPE_ECDSA_P256, 256},
+			{SSH_KEYTYPE_RSA, 4096},
+	};
+
+	std::vector<std::filesystem::path> paths;
+	for (const auto& [type, bits] : types) {
+		const auto key = generate_key(type, bits);
+		paths.push_back(dir.file(std::string{"host_key_"}
+					 + ssh_key_type_to_char(type)));
+		write_private_key(key.get(), paths.back());
+	}
+	return paths;
+}
+
+// Narrows the server to exactly one algorithm of each kind and checks that
+// the pair still completes a handshake; false if this libssh build lacks
+// one of them.
+bool force_algorithms(Loopback& loopback, const Case& c,
+		      const std::string& name, const Algorithm& kex,
+		      const Algorithm& host, const Algorithm& cipher)
+{
+	auto& bind = loopback.bind();
+	try {
+		bind.set_kex_algorithms(kex.name);
+		bind.set_hostkey_algorithms(host.name);
+		bind.set_ciphers(cipher.name);
+	} catch (const SshError& e) {
+		std::fprintf(stderr, "%-40s skipped: %s\n", name.c_str(),
+			     e.what());
+		return false;
+	}
+
+	const auto d = loopback.connect(c.authenticator, c.provider, c.creds);
+	if (d.secret == kSecret)
+		return true;
+	std::fprintf(stderr, "%-40s skipped: %s\n", name.c_str(),
+		     d.client_error.c_str());
+	return false;
+}
+
+// Handshake CPU cost of every kex x host key x cipher combination.
+void bench_algorithms(Runner& runner, const ScratchDir& dir, const Case& c)
+{
+	std::optional<Loopback> loopback;
+
+	for (const auto& kex : kKex) {
+		for (const auto& host : kHostKeyAlgorithms) {
+			for (const auto& cipher : kCiphers) {
+				const auto name = combo_name(kex, host, cipher);
+				if (!runner.selected(name))
+					continue;
+				if (!loopback)
+					loopback.emplace(write_host_keys(dir));
+				if (!force_algorithms(*loopback, c, name, kex,
+						      host, cipher))
+					continue;
+
+				runner.run(
+						name,
+						[&](std::uint64_t n) {
+							handshakes(*loopback,
+								   c, n);
+						},
+						Timer::cpu);
+			}
+		}
+	}
+}
+
+// Handshakes per second per core, cheapest first, for picking defaults.
+void algorithm_summary(const Runner& runner)
+{
+	std::vector<Result> rows;
+	for (const auto& r : runner.results())
+		if (r.name.starts_with(kAlgorithmPrefix))
+			rows.push_back(r);
+	if (rows.empty())
+		return;
+
+	std::sort(rows.begin(), rows.end(),
+		  [](const Result& a, const Result& b) {
+			  return a.ns_per_op < b.ns_per_op;
+		  });
+	std::fprintf(stderr, "\n%-40s %18s\n", "algorithms",
+		     "handshakes/s/core");
+	for (const auto& r : rows)
+		std::fprintf(stderr, "%-40s %18.0f\n",
+			     r.name.substr(kAlgorithmPrefix.size()).c_str(),
+			     1e9 / r.ns_per_op);
+}
+
+} // namespace
+
+void loopback_suite(Runner& runner)
+{
+	const ScratchDir dir;
+
+	const auto host_key = generate_key();
+	write_private_key(host_key.get(), dir.file("host_key"));
+
+	const auto client_key = generate_key();
+	const auto stranger   = generate_key();
+	std::ofstream(dir.file("authorized_keys"))
+			<< public_key_line(client_key.get()) << '\n';
+
+	const auto keys	    = dir.file("authorized_keys");
+	const auto pubkey   = make_auth(SSH_AUTH_METHOD_PUBLICKEY, keys);
+	const auto password = make_auth(SSH_AUTH_METHOD_PASSWORD, keys);
+	const auto both	    = make_auth(
+			      SSH_AUTH_METHOD_PUBLICKEY
+					      | SSH_AUTH_METHOD_PASSWORD,
+			      keys);
+
+	const StaticSecretProvider    plain{kSecret};
+	const EncryptedSecretProvider sealed{
+			std::make_unique<StaticSecretProvider>(
+					crypto::encrypt(kSecret, kPassphrase))};
+
+	// Named secrets: a batch of kBatch in one exec request against
+	// kBatch connections for one each
+	constexpr int kBatch = 16;
+	std::filesystem::create_directory(dir.file("secrets"));
+	std::string batch_command = "get";
+	std::string batch_reply;
+	for (int i = 0; i < kBatch; ++i) {
+		const auto name = "s" + std::to_string(i);
+		std::ofstream(dir.file("secrets") / name) << kSecret;
+		batch_command += ' ' + name;
+		batch_reply += name + ' ' + std::to_string(std::strlen(kSecret))
+			       + '\n' + kSecret + '\n';
+	}
+	const SecretDirectory named{dir.file("secrets"), false};
+
+	ssh_key key = client_key.get();
+	ssh_key bad = stranger.get();
+
+	const std::vector<Case> good = {
+			{"publickey", *pubkey, plain, {key, "", "", ""}, true},
+			{"password",
+			 *password,
+			 plain,
+			 {nullptr, kPassword, "", ""},
+			 true},
+			{"both", *both, plain, {key, kPassword, "", ""}, true},
+			{"encrypted",
+			 *pubkey,
+			 sealed,
+			 {key, "", kPassphrase, ""},
+			 true},
+			{"exec", *pubkey, plain, {key, "", "", "get"}, true},
+			{"exec_encrypted",
+			 *pubkey,
+			 sealed,
+			 {key, "", kPassphrase, "get"},
+			 true},
+			{"kbdint",
+			 *pubkey,
+			 sealed,
+			 {key, "", kPassphrase, "", true},
+			 true},
+			{"exec_named",
+			 *pubkey,
+			 plain,
+			 {key, "", "", "get s0"},
+			 true},
+			{"exec_batch",
+			 *pubkey,
+			 plain,
+			 {key, "", "", batch_command},
+			 true,
+			 batch_reply},
+			{"session",
+			 *pubkey,
+			 plain,
+			 {key, "", "", "GET", false, 3},
+			 true},
+			{"session_named",
+			 *pubkey,
+			 plain,
+			 {key, "", "", "GET s0", false, 3},
+			 true},
+	};
+	const std::vector<Case> bad_cases = {
+			{"unknown_key",
+			 *pubkey,
+			 plain,
+			 {bad, "", "", ""},
+			 false},
+			{"wrong_password",
+			 *password,
+			 plain,
+			 {nullptr, "nope", "", ""},
+			 false},
+			{"both_key_only",
+			 *both,
+			 plain,
+			 {key, "", "", ""},
+			 false},
+			{"both_wrong_password",
+			 *both,
+			 plain,
+			 {key, "nope", "", ""},
+			 false},
+			{"wrong_passphrase",
+			 *pubkey,
+			 sealed,
+			 {key, "", "nope", ""},
+			 false},
+			{"exec_unknown_command",
+			 *pubkey,
+			 plain,
+			 {key, "", "", "cat /etc/passwd"},
+			 false},
+			{"exec_unknown_secret",
+			 *pubkey,
+			 plain,
+			 {key, "", "", "get other"},
+			 false},
+			{"exec_wrong_passphrase",
+			 *pubkey,
+			 sealed,
+			 {key, "", "nope", "get"},
+			 false},
+			{"exec_batch_unknown",
+			 *pubkey,
+			 plain,
+			 {key, "", "", "get s0 missing"},
+			 false},
+			{"exec_bad_name",
+			 *pubkey,
+			 plain,
+			 {key, "", "", "get ../authorized_keys"},
+			 false},
+			{"session_unknown_secret",
+			 *pubkey,
+			 plain,
+			 {key, "", "", "GET missing", false, 1},
+			 false},
+			{"session_bad_request",
+			 *pubkey,
+			 plain,
+			 {key, "", "", "DELETE s0", false, 1},
+			 false},
+			{"kbdint_wrong_passphrase",
+			 *pubkey,
+			 sealed,
+			 {key, "", "nope", "", true},
+			 false},
+	};
+
+	Loopback loopback{{dir.file("host_key")}};
+	loopback.set_secrets(&named);
+
+	for (const auto& c : good)
+		verify(runner, loopback, c);
+	for (const auto& c : bad_cases)
+		verify(runner, loopback, c);
+	verify_reload(runner, loopback, dir.file("host_key"), good.front());
+	verify_shared_listener(runner, dir.file("host_key"));
+	verify_ip_filter(runner, dir);
+	verify_rate_limit(runner, dir);
+	verify_admission(runner, dir);
+	bench_accept(runner, loopback);
+	for (const auto& c : good)
+		bench(runner, loopback, c);
+	for (const auto& c : good)
+		if (c.creds.requests > 0)
+			bench_session(runner, loopback, c);
+	bench_watch(runner, loopback, *pubkey, dir, key);
+
+	bench_algorithms(runner, dir, good.front());
+	algorithm_summary(runner);
+}
+
+} // namespace drop::bench
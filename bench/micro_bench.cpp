@@ -0,0 +1,209 @@
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "authenticator.h"
+#include "config_parser.h"
+#include "crypto.h"
+#include "keys.h"
+#include "log.h"
+#include "suites.h"
+
+namespace drop::bench {
+
+namespace {
+
+constexpr std::array kSecretSizes  = {16, 1024, 65536};
+constexpr std::array kKeyCounts	   = {10, 100, 1000, 10000, 100000};
+constexpr std::array kLogThreads   = {1, 4, 16};
+constexpr auto	     kPassphrase   = "correct horse battery staple";
+
+std::string payload(std::size_t size)
+{
+	std::string s(size, '\0');
+	std::mt19937 rng{42};
+	for (auto& c : s)
+		c = static_cast<char>('a' + rng() % 26);
+	return s;
+}
+
+void bench_crypto(Runner& runner)
+{
+	for (const auto size : kSecretSizes) {
+		const auto plain = payload(static_cast<std::size_t>(size));
+		const auto tag	 = "/" + std::to_string(size);
+
+		runner.run("crypto.encrypt" + tag, [&](std::uint64_t n) {
+			for (std::uint64_t i = 0; i < n; ++i)
+				keep(crypto::encrypt(plain, kPassphrase)
+						     .size());
+		});
+
+		const auto sealed = crypto::encrypt(plain, kPassphrase);
+		runner.run("crypto.decrypt" + tag, [&](std::uint64_t n) {
+			for (std::uint64_t i = 0; i < n; ++i)
+				keep(crypto::decrypt(sealed, kPassphrase)
+						     ->size());
+		});
+	}
+}
+
+void bench_base64(Runner& runner)
+{
+	for (const auto size : kSecretSizes) {
+		const auto  raw	 = payload(static_cast<std::size_t>(size));
+		const auto* data = reinterpret_cast<const unsigned char*>(
+				raw.data());
+		const auto tag = "/" + std::to_string(size);
+
+		runner.run("base64.encode" + tag, [&](std::uint64_t n) {
+			for (std::uint64_t i = 0; i < n; ++i)
+				keep(crypto::base64_encode(data, raw.size())
+						     .size());
+		});
+
+		const auto b64 = crypto::base64_encode(data, raw.size());
+		runner.run("base64.decode" + tag, [&](std::uint64_t n) {
+			for (std::uint64_t i = 0; i < n; ++i)
+				keep(crypto::base64_decode(b64).size());
+		});
+	}
+}
+
+// SSH wire-format string: 32-bit big-endian length, then the bytes.
+void put_string(std::vector<unsigned char>& out, const unsigned char* p,
+		std::uint32_t len)
+{
+	for (int shift = 24; shift >= 0; shift -= 8)
+		out.push_back(static_cast<unsigned char>(len >> shift));
+	out.insert(out.end(), p, p + len);
+}
+
+// Any 32 bytes form a valid ed25519 public key blob, which is much cheaper
+// than generating 100k real key pairs.
+std::string fake_ed25519_line(std::mt19937_64& rng)
+{
+	static constexpr char kType[] = "ssh-ed25519";
+
+	std::array<unsigned char, 32> pk{};
+	for (auto& b : pk)
+		b = static_cast<unsigned char>(rng());
+
+	std::vector<unsigned char> blob;
+	put_string(blob, reinterpret_cast<const unsigned char*>(kType),
+		   sizeof(kType) - 1);
+	put_string(blob, pk.data(), pk.size());
+
+	return "ssh-ed25519 " + crypto::base64_encode(blob.data(), blob.size())
+	       + " bench";
+}
+
+void bench_authorized_keys(Runner& runner, const ScratchDir& dir)
+{
+	const auto	  probe	     = generate_key();
+	const std::string probe_line = public_key_line(probe.get());
+
+	std::mt19937_64 rng{7};
+	for (const auto count : kKeyCounts) {
+		const auto name = "authorized_keys.check_pubkey/"
+				  + std::to_string(count);
+		if (!runner.selected(name))
+			continue;
+
+		// The matching key goes last: the lookup is a linear scan, so
+		// this is the worst case for a given file size.
+		const auto    path = dir.file("authorized_keys");
+		std::ofstream out(path, std::ios::trunc);
+		for (int i = 1; i < count; ++i)
+			out << fake_ed25519_line(rng) << '\n';
+		out << probe_line << '\n';
+		out.close();
+
+		const AuthorizedKeysAuthenticator auth{path};
+		if (!auth.check_pubkey(probe.get()))
+			throw std::runtime_error{"Probe key not found in "
+						 + name};
+
+		runner.run(name, [&](std::uint64_t n) {
+			for (std::uint64_t i = 0; i < n; ++i)
+				keep(auth.check_pubkey(probe.get()) ? 1 : 0);
+		});
+	}
+}
+
+void bench_config(Runner& runner, const ScratchDir& dir)
+{
+	const auto path = dir.file("ssh-drop.conf");
+	std::ofstream(path) << "# ssh-drop configuration\n\n"
+			       "port = 7022\n"
+			       "host_key = key/id_ed25519\n"
+			       "authorized_keys = key/authorized_keys\n"
+			       "auth_method = both\n\n"
+			       "auth_timeout = 30\n"
+			       "log_level = info\n"
+			       "log_file = /var/log/ssh-drop/ssh-drop.log\n\n"
+			       "metrics_socket = /run/ssh-drop/metrics.sock\n"
+			       "trace_file = /var/log/ssh-drop/trace.json\n"
+			       "trace_enabled = false\n\n"
+			       "# Secret source (exactly one must be set)\n"
+			       "secret_file = secret/secret\n"
+			       "secret_encrypted = true\n\n"
+			       "auth_user = admin\n"
+			       "auth_password_env = SSH_DROP_PASSWORD\n";
+
+	runner.run("config.parse", [&](std::uint64_t n) {
+		for (std::uint64_t i = 0; i < n; ++i)
+			keep(ConfigParser::parse(path).size());
+	});
+}
+
+void log_burst(int threads, std::uint64_t n)
+{
+	const auto per = n / static_cast<std::uint64_t>(threads) + 1;
+
+	std::vector<std::jthread> pool;
+	for (int t = 0; t < threads; ++t)
+		pool.emplace_back([per] {
+			for (std::uint64_t i = 0; i < per; ++i)
+				log::info("Accepted connection from 192.0.2.1");
+		});
+}
+
+// Console output goes to a null buffer so the numbers reflect formatting and
+// lock contention rather than the terminal.
+void bench_log(Runner& runner)
+{
+	NullBuffer null;
+	auto*	   saved = std::cout.rdbuf(&null);
+	log::init(log::Level::info);
+
+	for (const auto threads : kLogThreads)
+		runner.run("log.info/threads=" + std::to_string(threads),
+			   [threads](std::uint64_t n) {
+				   log_burst(threads, n);
+			   });
+
+	log::init(log::Level::error);
+	std::cout.rdbuf(saved);
+}
+
+} // namespace
+
+void micro_suite(Runner& runner)
+{
+	const ScratchDir dir;
+
+	bench_crypto(runner);
+	bench_base64(runner);
+	bench_authorized_keys(runner, dir);
+	bench_config(runner, dir);
+	bench_log(runner);
+}
+
+} // namespace drop::bench
@@ -0,0 +1,97 @@
+#include "proc_stats.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace drop::bench {
+
+ProcStats read_proc_stats(int pid)
+{
+	const std::filesystem::path dir =
+			"/proc/" + (pid ? std::to_string(pid) : "self");
+
+	ProcStats stats;
+
+	std::ifstream status(dir / "status");
+	std::string   line;
+	while (std::getline(status, line)) {
+		std::istringstream iss(line);
+		std::string	   key;
+		iss >> key;
+		if (key == "Threads:")
+			iss >> stats.threads;
+		else if (key == "VmRSS:")
+			iss >> stats.rss_kb;
+	}
+
+	std::ifstream io(dir / "io");
+	while (std::getline(io, line)) {
+		std::istringstream iss(line);
+		std::string	   key;
+		iss >> key;
+		if (key == "syscr:")
+			iss >> stats.syscr;
+		else if (key == "syscw:")
+			iss >> stats.syscw;
+	}
+
+	std::error_code ec;
+	for (std::filesystem::directory_iterator it(dir / "fd", ec), end;
+	     !ec && it != end; it.increment(ec))
+		stats.fds++;
+
+	return stats;
+}
+
+std::string format(const ProcStats& stats)
+{
+	return "threads=" + std::to_string(stats.threads)
+	       + " fds=" + std::to_string(stats.fds)
+	       + " rss=" + std::to_string(stats.rss_kb / 1024) + "MiB";
+}
+
+ProcSampler::ProcSampler(int pid, std::chrono::milliseconds interval)
+    : pid_{pid},
+      interval_{interval},
+      last_{read_proc_stats(pid)},
+      peak_{last_},
+      thread_{[this](std::stop_token st) { sample_loop(st); }}
+{
+}
+
+ProcStats ProcSampler::last() const
+{
+	std::lock_guard lock{mutex_};
+	return last_;
+}
+
+ProcStats ProcSampler::peak() const
+{
+	std::lock_guard lock{mutex_};
+	return peak_;
+}
+
+void ProcSampler::sample_loop(std::stop_token stop)
+{
+	std::mutex		    wait_mutex;
+	std::condition_variable_any cv;
+
+	while (!stop.stop_requested()) {
+		const auto s = read_proc_stats(pid_);
+		{
+			std::lock_guard lock{mutex_};
+			last_	      = s;
+			peak_.threads = std::max(peak_.threads, s.threads);
+			peak_.fds     = std::max(peak_.fds, s.fds);
+			peak_.rss_kb  = std::max(peak_.rss_kb, s.rss_kb);
+		}
+
+		std::unique_lock lock{wait_mutex};
+		cv.wait_for(lock, stop, interval_, [] { return false; });
+	}
+}
+
+} // namespace drop::bench
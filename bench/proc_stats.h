@@ -0,0 +1,50 @@
+#ifndef SSH_DROP_BENCH_PROC_STATS_H_
+#define SSH_DROP_BENCH_PROC_STATS_H_
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace drop::bench {
+
+struct ProcStats {
+	long threads = 0;
+	long fds     = 0;
+	long rss_kb  = 0;
+
+	// Cumulative read-type and write-type syscalls
+	long syscr = 0;
+	long syscw = 0;
+};
+
+// Reads /proc/<pid>/status and /proc/<pid>/io and counts /proc/<pid>/fd;
+// pid 0 means this process. Fields that cannot be read stay 0.
+[[nodiscard]] ProcStats read_proc_stats(int pid);
+
+[[nodiscard]] std::string format(const ProcStats& stats);
+
+// Samples a process in the background and keeps the latest and peak values.
+class ProcSampler {
+public:
+	ProcSampler(int pid, std::chrono::milliseconds interval);
+
+	[[nodiscard]] ProcStats last() const;
+	[[nodiscard]] ProcStats peak() const;
+
+private:
+	void sample_loop(std::stop_token stop);
+
+	int			  pid_;
+	std::chrono::milliseconds interval_;
+
+	mutable std::mutex mutex_;
+	ProcStats	   last_;
+	ProcStats	   peak_;
+
+	std::jthread thread_;
+};
+
+} // namespace drop::bench
+
+#endif // SSH_DROP_BENCH_PROC_STATS_H_
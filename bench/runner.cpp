@@ -0,0 +1,308 @@
+#include "runner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <random>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace drop::bench {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::atomic<std::size_t> g_sink{0};
+
+std::chrono::nanoseconds elapsed_since(Timer timer, Clock::time_point wall,
+				       std::clock_t cpu)
+{
+	if (timer == Timer::cpu) {
+		const auto ticks = std::clock() - cpu;
+		return std::chrono::nanoseconds{static_cast<std::int64_t>(
+				1e9 * static_cast<double>(ticks)
+				/ CLOCKS_PER_SEC)};
+	}
+	return Clock::now() - wall;
+}
+
+std::string format_time(double ns)
+{
+	char buf[32];
+	if (ns < 1e3)
+		std::snprintf(buf, sizeof(buf), "%.1f ns", ns);
+	else if (ns < 1e6)
+		std::snprintf(buf, sizeof(buf), "%.2f us", ns / 1e3);
+	else if (ns < 1e9)
+		std::snprintf(buf, sizeof(buf), "%.2f ms", ns / 1e6);
+	else
+		std::snprintf(buf, sizeof(buf), "%.2f s", ns / 1e9);
+	return buf;
+}
+
+// Minimal reader for the flat format to_json() writes.
+class JsonReader {
+public:
+	explicit JsonReader(std::string_view s) : s_{s} {}
+
+	std::vector<Result> read()
+	{
+		std::vector<Result> out;
+		expect_key("benchmarks");
+		expect('[');
+		if (peek() == ']') {
+			++pos_;
+			return out;
+		}
+		for (;;) {
+			out.push_back(read_result());
+			const char c = next();
+			if (c == ']')
+				return out;
+			if (c != ',')
+				fail();
+		}
+	}
+
+private:
+	Result read_result()
+	{
+		Result r;
+		expect('{');
+		for (;;) {
+			const auto key = read_string();
+			expect(':');
+			if (key == "name")
+				r.name = read_string();
+			else if (key == "iterations")
+				r.iterations = static_cast<std::uint64_t>(
+						read_number());
+			else if (key == "ns_per_op")
+				r.ns_per_op = read_number();
+			else
+				(void)read_number();
+
+			const char c = next();
+			if (c == '}')
+				return r;
+			if (c != ',')
+				fail();
+		}
+	}
+
+	void expect_key(std::string_view key)
+	{
+		expect('{');
+		if (read_string() != key)
+			fail();
+		expect(':');
+	}
+
+	std::string read_string()
+	{
+		expect('"');
+		std::string out;
+		while (pos_ < s_.size() && s_[pos_] != '"') {
+			if (s_[pos_] == '\\' && pos_ + 1 < s_.size())
+				++pos_;
+			out += s_[pos_++];
+		}
+		expect('"');
+		return out;
+	}
+
+	double read_number()
+	{
+		skip_space();
+		const auto start = pos_;
+		while (pos_ < s_.size()
+		       && std::string_view{"+-.0123456789eE"}.find(s_[pos_])
+				       != std::string_view::npos)
+			++pos_;
+		if (start == pos_)
+			fail();
+		return std::stod(std::string{s_.substr(start, pos_ - start)});
+	}
+
+	void skip_space()
+	{
+		while (pos_ < s_.size()
+		       && (s_[pos_] == ' ' || s_[pos_] == '\n'
+			   || s_[pos_] == '\t' || s_[pos_] == '\r'))
+			++pos_;
+	}
+
+	char peek()
+	{
+		skip_space();
+		return pos_ < s_.size() ? s_[pos_] : '\0';
+	}
+
+	char next()
+	{
+		const char c = peek();
+		if (c == '\0')
+			fail();
+		++pos_;
+		return c;
+	}
+
+	void expect(char c)
+	{
+		if (next() != c)
+			fail();
+	}
+
+	[[noreturn]] void fail() const
+	{
+		throw std::runtime_error{"Malformed benchmark JSON at offset "
+					 + std::to_string(pos_)};
+	}
+
+	std::string_view s_;
+	std::size_t	 pos_ = 0;
+};
+
+} // namespace
+
+Runner::Runner(std::string filter, std::chrono::milliseconds min_time)
+    : filter_{std::move(filter)}, min_time_{min_time}
+{
+}
+
+bool Runner::selected(std::string_view name) const
+{
+	return filter_.empty() || name.find(filter_) != std::string_view::npos;
+}
+
+void Runner::run(const std::string&				 name,
+		 const std::function<void(std::uint64_t n)>& body,
+		 Timer						 timer)
+{
+	if (!selected(name))
+		return;
+
+	// One untimed warm-up pass, then grow the batch until it is long
+	// enough to swamp timer resolution and scheduler noise.
+	body(1);
+
+	constexpr std::uint64_t kMaxIterations = std::uint64_t{1} << 40;
+
+	std::uint64_t n = 1;
+	for (;;) {
+		const auto wall = Clock::now();
+		const auto cpu	= std::clock();
+		body(n);
+		const auto elapsed = elapsed_since(timer, wall, cpu);
+
+		if (elapsed >= min_time_ || n >= kMaxIterations) {
+			add({name, n,
+			     static_cast<double>(elapsed.count())
+					     / static_cast<double>(n)});
+			return;
+		}
+
+		// Aim 20% past min_time, but never grow more than 100x at once
+		const auto ns = std::max<std::int64_t>(elapsed.count(), 1);
+		const auto want = static_cast<double>(n) * 1.2
+				  * static_cast<double>(min_time_.count())
+				  / static_cast<double>(ns);
+		const auto cap = std::min(n * 100, kMaxIterations);
+		n = std::clamp<std::uint64_t>(static_cast<std::uint64_t>(want),
+					      n + 1, cap);
+	}
+}
+
+void Runner::add(Result result)
+{
+	std::fprintf(stderr, "%-40s %12llu iters %14s/op\n",
+		     result.name.c_str(),
+		     static_cast<unsigned long long>(result.iterations),
+		     format_time(result.ns_per_op).c_str());
+	results_.push_back(std::move(result));
+}
+
+ScratchDir::ScratchDir()
+{
+	std::random_device rd;
+	path_ = std::filesystem::temp_directory_path()
+		/ ("ssh-drop-bench-" + std::to_string(rd()));
+	std::filesystem::create_directories(path_);
+}
+
+ScratchDir::~ScratchDir()
+{
+	std::error_code ec;
+	std::filesystem::remove_all(path_, ec);
+}
+
+void keep(std::size_t value) noexcept
+{
+	g_sink.fetch_add(value, std::memory_order_relaxed);
+}
+
+std::string to_json(const std::vector<Result>& results)
+{
+	std::string out = "{\"benchmarks\":[";
+	char	    buf[64];
+
+	for (std::size_t i = 0; i < results.size(); ++i) {
+		const auto& r = results[i];
+		if (i)
+			out += ',';
+		out += "\n  {\"name\":\"" + r.name + "\",\"iterations\":";
+		out += std::to_string(r.iterations);
+		std::snprintf(buf, sizeof(buf), ",\"ns_per_op\":%.3f}",
+			      r.ns_per_op);
+		out += buf;
+	}
+
+	out += "\n]}\n";
+	return out;
+}
+
+std::vector<Result> from_json(std::string_view json)
+{
+	return JsonReader{json}.read();
+}
+
+int compare(const std::vector<Result>& base,
+	    const std::vector<Result>& current, double threshold_pct)
+{
+	std::unordered_map<std::string, double> before;
+	for (const auto& r : base)
+		before[r.name] = r.ns_per_op;
+
+	int regressions = 0;
+	std::printf("%-40s %14s %14s %9s\n", "benchmark", "base", "current",
+		    "change");
+
+	for (const auto& r : current) {
+		auto it = before.find(r.name);
+		if (it == before.end()) {
+			std::printf("%-40s %14s %14s %9s\n", r.name.c_str(),
+				    "-", format_time(r.ns_per_op).c_str(),
+				    "new");
+			continue;
+		}
+
+		const double base_ns = it->second;
+		double	     change  = 0.0;
+		if (base_ns > 0.0)
+			change = 100.0 * (r.ns_per_op - base_ns) / base_ns;
+		const bool regressed = change > threshold_pct;
+		if (regressed)
+			regressions++;
+
+		std::printf("%-40s %14s %14s %+8.1f%%%s\n", r.name.c_str(),
+			    format_time(it->second).c_str(),
+			    format_time(r.ns_per_op).c_str(), change,
+			    regressed ? "  REGRESSION" : "");
+	}
+
+	return regressions;
+}
+
+} // namespace drop::bench
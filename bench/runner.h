@@ -0,0 +1,102 @@
+#ifndef SSH_DROP_BENCH_RUNNER_H_
+#define SSH_DROP_BENCH_RUNNER_H_
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace drop::bench {
+
+struct Result {
+	std::string   name;
+	std::uint64_t iterations = 0;
+	double	      ns_per_op	 = 0.0;
+};
+
+// What a batch is timed with: wall clock, or CPU time of the whole process
+// (all threads), which is steadier when client and server share a machine.
+enum class Timer {
+	wall,
+	cpu
+};
+
+// Runs named benchmarks whose names contain the filter, growing the
+// iteration count until one batch takes at least min_time.
+class Runner {
+public:
+	Runner(std::string filter, std::chrono::milliseconds min_time);
+
+	[[nodiscard]] bool selected(std::string_view name) const;
+
+	// body(n) must perform n operations.
+	void run(const std::string&				name,
+		 const std::function<void(std::uint64_t n)>& body,
+		 Timer					timer = Timer::wall);
+
+	// Records a result measured by the caller.
+	void add(Result result);
+
+	[[nodiscard]] const std::vector<Result>& results() const noexcept
+	{
+		return results_;
+	}
+
+private:
+	std::string		  filter_;
+	std::chrono::nanoseconds  min_time_;
+	std::vector<Result>	  results_;
+};
+
+// Temporary directory removed with everything in it on destruction.
+class ScratchDir {
+public:
+	ScratchDir();
+	~ScratchDir();
+
+	ScratchDir(const ScratchDir&)		 = delete;
+	ScratchDir& operator=(const ScratchDir&) = delete;
+
+	[[nodiscard]] std::filesystem::path file(const std::string& name) const
+	{
+		return path_ / name;
+	}
+
+private:
+	std::filesystem::path path_;
+};
+
+// Swallows everything; swap into std::cout/std::cerr to mute server logging.
+class NullBuffer : public std::streambuf {
+protected:
+	int_type overflow(int_type c) override
+	{
+		return c;
+	}
+
+	std::streamsize xsputn(const char*, std::streamsize n) override
+	{
+		return n;
+	}
+};
+
+// Keeps a computed value alive so the optimiser cannot drop the work.
+void keep(std::size_t value) noexcept;
+
+[[nodiscard]] std::string to_json(const std::vector<Result>& results);
+
+// Reads back the output of to_json(); throws on malformed input.
+[[nodiscard]] std::vector<Result> from_json(std::string_view json);
+
+// Prints a side-by-side table and returns the number of benchmarks that
+// got slower than base by more than threshold_pct.
+int compare(const std::vector<Result>& base,
+	    const std::vector<Result>& current, double threshold_pct);
+
+} // namespace drop::bench
+
+#endif // SSH_DROP_BENCH_RUNNER_H_
@@ -0,0 +1,451 @@
+// Soak test: runs a DropServer in this process and pushes a long stream of
+// connections through it, half of them ending on an error path, while
+// sampling /proc/self. Fails if threads or fds do not return to their idle
+// level afterwards, or if RSS keeps growing once warmed up.
+//
+//   ssh-drop-soak [soak.conf]
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "adversary.h"
+#include "authenticator.h"
+#include "config_parser.h"
+#include "crypto.h"
+#include "drop_server.h"
+#include "keys.h"
+#include "log.h"
+#include "proc_stats.h"
+#include "runner.h"
+#include "secret_provider.h"
+#include "server_config.h"
+#include "ssh_client.h"
+#include "ssh_error.h"
+#include "ssh_lib_guard.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr auto kSecret	   = "soak-secret";
+constexpr auto kPassphrase = "soak-passphrase";
+
+struct SoakConfig {
+	int port	= 17022;
+	int concurrency = 16;
+	int total	= 1'000'000;
+	int warmup	= 50'000; // connections before the RSS baseline
+	int interval	= 10;	  // seconds between samples
+	int auth_timeout = 2;
+	int timeout	 = 10;
+
+	int rss_growth_pct = 10;
+	int fd_slack	   = 4;
+	int thread_slack   = 0;
+
+	static SoakConfig load(const char* path);
+};
+
+SoakConfig SoakConfig::load(const char* path)
+{
+	SoakConfig cfg;
+	if (!path)
+		return cfg;
+
+	const auto m   = drop::ConfigParser::parse(path);
+	auto	   get = [&](const char* key, int& out) {
+		      auto it = m.find(key);
+		      if (it != m.end())
+			      out = std::stoi(it->second);
+	};
+
+	get("port", cfg.port);
+	get("concurrency", cfg.concurrency);
+	get("total", cfg.total);
+	get("warmup", cfg.warmup);
+	get("sample_interval", cfg.interval);
+	get("auth_timeout", cfg.auth_timeout);
+	get("timeout", cfg.timeout);
+	get("rss_growth_pct", cfg.rss_growth_pct);
+	get("fd_slack", cfg.fd_slack);
+	get("thread_slack", cfg.thread_slack);
+
+	if (cfg.concurrency < 1 || cfg.total < 1 || cfg.interval < 1)
+		throw std::runtime_error{"concurrency, total and "
+					 "sample_interval must be >= 1"};
+	return cfg;
+}
+
+// How a connection ends. Everything but ok takes an error path in
+// ConnectionHandler::run or its callbacks.
+enum class Kind {
+	ok,
+	wrong_passphrase, // decrypt throws
+	no_passphrase,	  // client leaves right after the shell request
+	unknown_key,	  // denied, client leaves during auth
+	kex_abort,	  // banner only, then close
+	auth_abort,	  // authenticated, gone before the channel
+	channel_abort	  // channel open, gone before the shell request
+};
+
+constexpr std::size_t kKindCount = 7;
+
+// One success for every failure mode
+constexpr std::array kMix = {Kind::ok,		  Kind::wrong_passphrase,
+			     Kind::ok,		  Kind::no_passphrase,
+			     Kind::ok,		  Kind::unknown_key,
+			     Kind::ok,		  Kind::kex_abort,
+			     Kind::ok,		  Kind::auth_abort,
+			     Kind::ok,		  Kind::channel_abort};
+
+const char* kind_name(Kind kind)
+{
+	switch (kind) {
+	case Kind::ok:
+		return "ok";
+	case Kind::wrong_passphrase:
+		return "wrong_passphrase";
+	case Kind::no_passphrase:
+		return "no_passphrase";
+	case Kind::unknown_key:
+		return "unknown_key";
+	case Kind::kex_abort:
+		return "kex_abort";
+	case Kind::auth_abort:
+		return "auth_abort";
+	case Kind::channel_abort:
+		return "channel_abort";
+	}
+	return "?";
+}
+
+struct Keys {
+	drop::SshKeyPtr client;
+	drop::SshKeyPtr stranger;
+};
+
+bool kex_abort(const SoakConfig& cfg)
+{
+	const int fd = drop::bench::tcp_connect("127.0.0.1", cfg.port);
+	if (fd < 0)
+		return false;
+
+	static constexpr char kBanner[] = "SSH-2.0-soak\r\n";
+	const auto sent = ::send(fd, kBanner, sizeof(kBanner) - 1,
+				 MSG_NOSIGNAL);
+	::close(fd);
+	return sent > 0;
+}
+
+// A wrong passphrase must never yield the secret; the server may close the
+// channel with or without an error.
+bool fetch_refused(drop::SshClient& client, int timeout_ms)
+{
+	try {
+		return client.fetch("wrong", timeout_ms).empty();
+	} catch (const drop::SshError&) {
+		return true;
+	}
+}
+
+// True when the server behaved as this kind expects.
+bool run_one(Kind kind, const SoakConfig& cfg, const Keys& keys)
+{
+	if (kind == Kind::kex_abort)
+		return kex_abort(cfg);
+
+	const int timeout_ms = cfg.timeout * 1000;
+
+	try {
+		drop::SshClient client;
+		client.connect("127.0.0.1", cfg.port, "soak", cfg.timeout);
+		ssh_session session = client.session().get();
+
+		if (kind == Kind::unknown_key)
+			return !client.auth_pubkey(keys.stranger.get());
+
+		if (!client.auth_pubkey(keys.client.get())
+		    || !client.authenticated())
+			return false;
+
+		switch (kind) {
+		case Kind::ok:
+			return client.fetch(kPassphrase, timeout_ms) == kSecret;
+		case Kind::wrong_passphrase:
+			return fetch_refused(client, timeout_ms);
+		case Kind::no_passphrase:
+			(void)client.open_shell();
+			return true;
+		case Kind::channel_abort: {
+			drop::SshChannel channel{ssh_channel_new(session)};
+			channel.open_session();
+			return true;
+		}
+		default: // auth_abort
+			return true;
+		}
+	} catch (const drop::SshError&) {
+		return false;
+	}
+}
+
+struct Tally {
+	std::array<std::atomic<std::uint64_t>, kKindCount> done{};
+	std::array<std::atomic<std::uint64_t>, kKindCount> unexpected{};
+	std::atomic<int>				   next{0};
+
+	[[nodiscard]] std::uint64_t total() const
+	{
+		std::uint64_t n = 0;
+		for (const auto& d : done)
+			n += d.load(std::memory_order_relaxed);
+		return n;
+	}
+};
+
+void run_worker(const SoakConfig& cfg, const std::string& client_key,
+		const std::string& stranger_key, Tally& tally)
+{
+	const Keys keys{drop::load_private_key(client_key),
+			drop::load_private_key(stranger_key)};
+
+	for (;;) {
+		const int i = tally.next.fetch_add(1);
+		if (i >= cfg.total)
+			return;
+
+		const auto slot = static_cast<std::size_t>(i) % kMix.size();
+		const Kind kind = kMix[slot];
+		const auto k	= static_cast<std::size_t>(kind);
+		if (!run_one(kind, cfg, keys))
+			tally.unexpected[k].fetch_add(1);
+		tally.done[k].fetch_add(1);
+	}
+}
+
+void wait_for_listener(const SoakConfig& cfg)
+{
+	for (int i = 0; i < 50; ++i) {
+		const int fd = drop::bench::tcp_connect("127.0.0.1", cfg.port);
+		if (fd >= 0) {
+			::close(fd);
+			return;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds{100});
+	}
+	throw std::runtime_error{"Server did not start listening on port "
+				 + std::to_string(cfg.port)};
+}
+
+// The server reaps finished connection threads once per accept loop
+// iteration (at most a second apart); give it a few.
+void settle()
+{
+	std::this_thread::sleep_for(std::chrono::seconds{3});
+}
+
+// Millions of per-connection log lines would swamp the output and the
+// measurement; progress goes through stdio instead.
+class MuteStreams {
+public:
+	MuteStreams()
+	    : out_{std::cout.rdbuf(&null_)}, err_{std::cerr.rdbuf(&null_)}
+	{
+	}
+
+	~MuteStreams()
+	{
+		std::cout.rdbuf(out_);
+		std::cerr.rdbuf(err_);
+	}
+
+	MuteStreams(const MuteStreams&)		   = delete;
+	MuteStreams& operator=(const MuteStreams&) = delete;
+
+private:
+	drop::bench::NullBuffer null_;
+	std::streambuf*		out_;
+	std::streambuf*		err_;
+};
+
+struct Growth {
+	drop::bench::ProcStats		       idle_before;
+	drop::bench::ProcStats		       idle_after;
+	std::optional<drop::bench::ProcStats> warm;
+	long				       peak_rss_after_warm = 0;
+};
+
+std::vector<std::string> check(const SoakConfig& cfg, const Growth& g)
+{
+	std::vector<std::string> failures;
+	auto grew = [&](const char* what, long from, long to) {
+		failures.push_back(std::string{what} + " grew from "
+				   + std::to_string(from) + " to "
+				   + std::to_string(to));
+	};
+
+	if (g.idle_after.threads > g.idle_before.threads + cfg.thread_slack)
+		grew("threads", g.idle_before.threads, g.idle_after.threads);
+	if (g.idle_after.fds > g.idle_before.fds + cfg.fd_slack)
+		grew("fds", g.idle_before.fds, g.idle_after.fds);
+	if (g.warm
+	    && g.peak_rss_after_warm * 100
+			       > g.warm->rss_kb * (100 + cfg.rss_growth_pct))
+		grew("RSS after warmup (KiB)", g.warm->rss_kb,
+		     g.peak_rss_after_warm);
+
+	return failures;
+}
+
+void print_sample(std::uint64_t done, double rate,
+		  const drop::bench::ProcStats& s)
+{
+	std::printf("%12llu conns %9.0f conn/s  %s\n",
+		    static_cast<unsigned long long>(done), rate,
+		    drop::bench::format(s).c_str());
+	std::fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+	using drop::bench::format;
+	using drop::bench::read_proc_stats;
+
+	try {
+		const auto cfg =
+				SoakConfig::load(argc >= 2 ? argv[1] : nullptr);
+
+		const MuteStreams mute;
+		drop::log::init(drop::log::Level::error);
+
+		drop::SshLibGuard	lib;
+		drop::bench::ScratchDir dir;
+
+		const auto host_key = drop::bench::generate_key();
+		const auto client   = drop::bench::generate_key();
+		const auto stranger = drop::bench::generate_key();
+		drop::bench::write_private_key(host_key.get(),
+					       dir.file("host_key"));
+		drop::bench::write_private_key(client.get(),
+					       dir.file("client"));
+		drop::bench::write_private_key(stranger.get(),
+					       dir.file("stranger"));
+		std::ofstream(dir.file("authorized_keys"))
+				<< drop::bench::public_key_line(client.get())
+				<< '\n';
+
+		drop::ServerConfig sc;
+		sc.port			= std::to_string(cfg.port);
+		sc.host_key_paths	= {dir.file("host_key").string()};
+		sc.authorized_keys_path = dir.file("authorized_keys").string();
+		sc.auth_timeout		= cfg.auth_timeout;
+		sc.auth_method		= "publickey";
+		sc.secret_encrypted = true;
+		sc.secret = drop::crypto::encrypt(kSecret, kPassphrase);
+		sc.validate();
+
+		drop::DropServer server{sc, drop::make_authenticator(sc),
+					drop::make_secret_provider(sc)};
+
+		std::atomic<bool> running{true};
+		std::string	  server_error;
+		std::jthread	  server_thread{[&] {
+			     try {
+				     server.run(running);
+			     } catch (const std::exception& e) {
+				     server_error = e.what();
+			     }
+		     }};
+
+		Growth g;
+		wait_for_listener(cfg);
+		settle();
+		g.idle_before = read_proc_stats(0);
+		std::printf("idle before  %s\n", format(g.idle_before).c_str());
+
+		Tally			  tally;
+		std::vector<std::jthread> workers;
+		for (int i = 0; i < cfg.concurrency; ++i)
+			workers.emplace_back(run_worker, std::cref(cfg),
+					     dir.file("client").string(),
+					     dir.file("stranger").string(),
+					     std::ref(tally));
+
+		auto	      last_time = Clock::now();
+		std::uint64_t last_done = 0;
+		while (last_done < static_cast<std::uint64_t>(cfg.total)) {
+			std::this_thread::sleep_for(
+					std::chrono::seconds{cfg.interval});
+
+			const auto done = tally.total();
+			const auto now	= Clock::now();
+			const auto s	= read_proc_stats(0);
+			const std::chrono::duration<double> dt =
+					now - last_time;
+			print_sample(done,
+				     static_cast<double>(done - last_done)
+						     / dt.count(),
+				     s);
+
+			if (g.warm)
+				g.peak_rss_after_warm =
+						std::max(g.peak_rss_after_warm,
+							 s.rss_kb);
+			else if (done >= static_cast<std::uint64_t>(cfg.warmup))
+				g.warm = s;
+
+			last_time = now;
+			last_done = done;
+		}
+		workers.clear();
+
+		settle();
+		g.idle_after = read_proc_stats(0);
+		std::printf("idle after   %s\n\n",
+			    format(g.idle_after).c_str());
+
+		running = false;
+		server_thread.join();
+
+		for (std::size_t k = 0; k < kKindCount; ++k) {
+			const auto done = tally.done[k].load();
+			const auto odd	= tally.unexpected[k].load();
+			std::printf("%-18s %12llu done %10llu unexpected\n",
+				    kind_name(static_cast<Kind>(k)),
+				    static_cast<unsigned long long>(done),
+				    static_cast<unsigned long long>(odd));
+		}
+
+		auto failures = check(cfg, g);
+		if (!server_error.empty())
+			failures.push_back("server stopped: " + server_error);
+		if (tally.unexpected[0] > 0)
+			failures.push_back("well-behaved connections failed");
+
+		for (const auto& f : failures)
+			std::printf("FAIL: %s\n", f.c_str());
+		if (failures.empty())
+			std::printf("PASS\n");
+		return failures.empty() ? 0 : 1;
+	} catch (const std::exception& e) {
+		std::fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+}
@@ -0,0 +1,17 @@
+#ifndef SSH_DROP_BENCH_SUITES_H_
+#define SSH_DROP_BENCH_SUITES_H_
+
+#include "runner.h"
+
+namespace drop::bench {
+
+// crypto, base64, authorized_keys lookup, config parsing and logging
+void micro_suite(Runner& runner);
+
+// Full handshakes over a socketpair: functional checks for every auth mode
+// and encrypted secrets, then wall and CPU time per handshake
+void loopback_suite(Runner& runner);
+
+} // namespace drop::bench
+
+#endif // SSH_DROP_BENCH_SUITES_H_
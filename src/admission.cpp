@@ -0,0 +1,111 @@
+#include "admission.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "log.h"
+#include "metrics.h"
+
+namespace drop {
+
+namespace {
+
+constexpr std::uint64_t kMinSamples = 20;
+
+} // namespace
+
+AdmissionController::AdmissionController(const Limits& limits)
+    : limits_{limits},
+      limit_{limits.max},
+      exact_limit_{static_cast<double>(limits.max)},
+      window_start_{std::chrono::steady_clock::now()}
+{
+	metrics::add(metrics::Gauge::admission_limit, limits.max);
+}
+
+bool AdmissionController::try_acquire() noexcept
+{
+	const int limit = limit_.load(std::memory_order_relaxed);
+	int	  n	= in_flight_.load(std::memory_order_relaxed);
+	do {
+		if (n >= limit) {
+			saturated_.store(true, std::memory_order_relaxed);
+			return false;
+		}
+	} while (!in_flight_.compare_exchange_weak(n, n + 1,
+						   std::memory_order_relaxed));
+
+	if (n + 1 >= limit)
+		saturated_.store(true, std::memory_order_relaxed);
+	return true;
+}
+
+void AdmissionController::acquire() noexcept
+{
+	const int n = in_flight_.fetch_add(1, std::memory_order_relaxed);
+	if (n + 1 >= limit())
+		saturated_.store(true, std::memory_order_relaxed);
+}
+
+void AdmissionController::release() noexcept
+{
+	in_flight_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void AdmissionController::tick()
+{
+	const auto	 now = std::chrono::steady_clock::now();
+	std::scoped_lock lock{mutex_};
+	if (now - window_start_ >= limits_.window)
+		close_window(now);
+}
+
+void AdmissionController::record(std::chrono::nanoseconds latency)
+{
+	const auto	 now = std::chrono::steady_clock::now();
+	std::scoped_lock lock{mutex_};
+
+	samples_++;
+	if (latency > limits_.target)
+		slow_++;
+
+	const auto wanted = std::max<std::uint64_t>(
+			static_cast<std::uint64_t>(limit()), kMinSamples);
+	if (samples_ < wanted && now - window_start_ < limits_.window)
+		return;
+
+	close_window(now);
+}
+
+void AdmissionController::close_window(
+		std::chrono::steady_clock::time_point now)
+{
+	const int  before    = limit();
+	const bool saturated = saturated_.exchange(false,
+						   std::memory_order_relaxed);
+
+	// More than 1% over target means p99 is over target. Only grow when
+	// the limit was actually in the way.
+	if (slow_ * 100 > samples_)
+		exact_limit_ = std::max(exact_limit_ * limits_.decrease,
+					static_cast<double>(limits_.min));
+	else if (saturated)
+		exact_limit_ = std::min(exact_limit_ + 1.0,
+					static_cast<double>(limits_.max));
+
+	const int after = static_cast<int>(std::floor(exact_limit_));
+	if (after != before) {
+		limit_.store(after, std::memory_order_relaxed);
+		metrics::add(metrics::Gauge::admission_limit, after - before);
+		if (after < before)
+			log::debug("Admission limit lowered to "
+				   + std::to_string(after));
+	}
+
+	samples_      = 0;
+	slow_	      = 0;
+	window_start_ = now;
+}
+
+} // namespace drop
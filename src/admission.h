@@ -0,0 +1,81 @@
+#ifndef SSH_DROP_ADMISSION_H_
+#define SSH_DROP_ADMISSION_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace drop {
+
+// Adaptive cap on server-side work in flight. A connection holds a slot
+// through key exchange, and again while its credentials are checked and
+// its secret is read and written, but not while the server waits on the
+// client. Completed connections report their server-side latency; once per
+// window the limit grows by one if it was reached and no more than 1% of
+// samples missed the target, and shrinks by a constant factor if more did.
+// It starts at the maximum. Connections beyond the limit are turned away
+// before any SSH work is done, so overload shows up as refused connections
+// rather than as latency for everyone.
+class AdmissionController {
+public:
+	struct Limits {
+		int			  min = 8;
+		int			  max = 1024;
+		std::chrono::milliseconds target{250};
+		// A window closes after `limit` samples (at least 20) or
+		// this long, whichever is first
+		std::chrono::milliseconds window{1000};
+		double			  decrease = 0.9;
+	};
+
+	explicit AdmissionController(const Limits& limits);
+
+	AdmissionController(const AdmissionController&)		   = delete;
+	AdmissionController& operator=(const AdmissionController&) = delete;
+
+	// Takes a slot for a new connection; false when the limit is reached.
+	[[nodiscard]] bool try_acquire() noexcept;
+
+	// Takes a slot for work on a connection already admitted: counted
+	// like any other, never refused.
+	void acquire() noexcept;
+
+	void release() noexcept;
+
+	// One connection's server-side latency, once it ends.
+	void record(std::chrono::nanoseconds latency);
+
+	// Closes the window once its time is up, with or without samples;
+	// call at least once a window.
+	void tick();
+
+	[[nodiscard]] int limit() const noexcept
+	{
+		return limit_.load(std::memory_order_relaxed);
+	}
+
+	// Every slot taken: the next connection would be shed
+	[[nodiscard]] bool at_limit() const noexcept
+	{
+		return in_flight_.load(std::memory_order_relaxed) >= limit();
+	}
+
+private:
+	void close_window(std::chrono::steady_clock::time_point now);
+
+	const Limits	  limits_;
+	std::atomic<int>  limit_;
+	std::atomic<int>  in_flight_{0};
+	std::atomic<bool> saturated_{false};
+
+	std::mutex			      mutex_;
+	double				      exact_limit_;
+	std::uint64_t			      samples_ = 0;
+	std::uint64_t			      slow_    = 0;
+	std::chrono::steady_clock::time_point window_start_;
+};
+
+} // namespace drop
+
+#endif // SSH_DROP_ADMISSION_H_
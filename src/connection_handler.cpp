@@ -1,26 +1,137 @@
 #include "connection_handler.h"
 
+#include <algorithm>
+#include <cerrno>
 #include <chrono>
+#include <cstdio>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <utility>
+#include <vector>
 
+#include "flight_recorder.h"
 #include "log.h"
+#include "metrics.h"
+#include "session_protocol.h"
+#include "trace.h"
 
 namespace drop {
 
+namespace {
+
+// Names a single exec request may ask for; each is a file read and
+// possibly a PBKDF2 run
+constexpr std::size_t kMaxBatch = 64;
+
+// How often a session waiting for its next request checks for shutdown
+constexpr int kIdleSliceMs = 200;
+
+// Counts one piece of server-side work on an admitted connection against
+// the admission limit while it runs
+class AdmissionWork {
+public:
+	explicit AdmissionWork(AdmissionController* admission) noexcept
+	    : admission_{admission}
+	{
+		if (admission_)
+			admission_->acquire();
+	}
+
+	~AdmissionWork()
+	{
+		if (admission_)
+			admission_->release();
+	}
+
+	AdmissionWork(const AdmissionWork&)	       = delete;
+	AdmissionWork& operator=(const AdmissionWork&) = delete;
+
+private:
+	AdmissionController* admission_;
+};
+
+std::chrono::nanoseconds cpu_time(double seconds)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::duration<double>{seconds});
+}
+
+// "get [name...]" -> the names, none for the default secret
+std::optional<std::vector<std::string>> parse_get(std::string_view command)
+{
+	std::vector<std::string> words;
+	for (std::size_t i = 0;;) {
+		i = command.find_first_not_of(" \t", i);
+		if (i == std::string_view::npos)
+			break;
+		const auto end = std::min(command.find_first_of(" \t", i),
+					  command.size());
+		words.emplace_back(command.substr(i, end - i));
+		i = end;
+	}
+
+	if (words.empty() || words.front() != "get"
+	    || words.size() > kMaxBatch + 1)
+		return std::nullopt;
+	words.erase(words.begin());
+	return words;
+}
+
+// Several secrets go out as "<name> <length>\n<bytes>\n" each, so values
+// may hold any bytes
+void append_frame(std::string& out, const std::string& name,
+		  const std::string& value)
+{
+	out += name;
+	out += ' ';
+	out += std::to_string(value.size());
+	out += '\n';
+	out += value;
+	out += '\n';
+}
+
+} // namespace
+
 ConnectionHandler::ConnectionHandler(SshSession		    session,
 				     const IAuthenticator&  authenticator,
 				     const ISecretProvider& secret_provider,
-				     int		    auth_timeout)
+				     int		    auth_timeout,
+				     std::uint64_t	    conn_id,
+				     ConnectionOptions	    options)
     : session_{std::move(session)},
       authenticator_{authenticator},
       secret_provider_{secret_provider},
-      auth_timeout_{auth_timeout}
+      auth_timeout_{auth_timeout},
+      conn_id_{conn_id},
+      options_{options},
+      prompt_passphrase_{options.prompt_passphrase
+			 && secret_provider.needs_passphrase()},
+      admission_held_{options.admission != nullptr}
 {
 }
 
+ConnectionHandler::~ConnectionHandler()
+{
+	leave_admission();
+	if (options_.admission && server_latency_.count() > 0)
+		options_.admission->record(server_latency_);
+	cpu_clock_.stop();
+
+	const auto& t = cpu_clock_.times();
+	cpu::record(auth_method_, secret_provider_.type_name(), t);
+
+	char buf[128];
+	std::snprintf(buf, sizeof(buf),
+		      "CPU ms: kex=%.3f auth=%.3f decrypt=%.3f write=%.3f",
+		      t[0] * 1e3, t[1] * 1e3, t[2] * 1e3, t[3] * 1e3);
+	log::debug(buf);
+}
+
 void ConnectionHandler::run()
 {
+	trace::Span span{"connection", conn_id_};
+
 	const int supported = authenticator_.supported_methods();
 	requires_both_	    = supported
 			 == (SSH_AUTH_METHOD_PUBLICKEY
@@ -38,13 +149,30 @@ void ConnectionHandler::run()
 	ssh_callbacks_init(&server_cb);
 
 	session_.set_server_callbacks(&server_cb);
+	if (prompt_passphrase_)
+		session_.set_message_callback(on_message, this);
 
 	// Only reveal pubkey initially if both required for security
 	const int initial =
 			requires_both_ ? SSH_AUTH_METHOD_PUBLICKEY : supported;
 	session_.set_auth_methods(initial);
 
-	session_.handle_key_exchange();
+	try {
+		trace::Span kex_span{"kex", conn_id_};
+		session_.handle_key_exchange();
+	} catch (const SshError& e) {
+		recorder::note(conn_id_, recorder::Phase::kex,
+			       recorder::Outcome::error, e.os_error());
+		metrics::add(metrics::Counter::kex_failures);
+		throw;
+	}
+	recorder::note(conn_id_, recorder::Phase::kex, recorder::Outcome::ok);
+	// From here most of the time is the client's
+	leave_admission();
+	cpu_clock_.enter(cpu::Phase::auth);
+	// Wall time would count the client's round trips, which a slow or
+	// hostile client can stretch at will
+	server_latency_ = cpu_time(cpu_clock_.seconds(cpu::Phase::kex));
 
 	SshEvent event;
 	event.add_session(session_);
@@ -52,10 +180,18 @@ void ConnectionHandler::run()
 	const auto deadline = std::chrono::steady_clock::now()
 			      + std::chrono::seconds(auth_timeout_);
 
+	std::optional<trace::Span> auth_span{std::in_place, "auth", conn_id_};
 	while (!authenticated_ || raw_channel_ == nullptr) {
-		if (std::chrono::steady_clock::now() >= deadline)
+		if (std::chrono::steady_clock::now() >= deadline) {
+			recorder::note(conn_id_, recorder::Phase::auth,
+				       recorder::Outcome::timeout);
+			metrics::add(metrics::Counter::connections_timed_out);
 			throw SshError{"Authentication timed out"};
+		}
 		if (event.poll(100) == SSH_ERROR) {
+			const int err = errno;
+			recorder::note(conn_id_, recorder::Phase::auth,
+				       recorder::Outcome::error, err);
 			if (raw_channel_) {
 				ssh_channel_free(raw_channel_);
 				raw_channel_ = nullptr;
@@ -65,42 +201,318 @@ void ConnectionHandler::run()
 		}
 	}
 
+	auth_span.reset();
+	recorder::note(conn_id_, recorder::Phase::auth, recorder::Outcome::ok);
+	if (options_.limiter)
+		options_.limiter->auth_succeeded(options_.source);
 	log::info("Client authenticated");
 
 	SshChannel channel{raw_channel_};
 	raw_channel_ = nullptr;
 
-	ssh_channel_callbacks_struct channel_cb	  = {};
-	channel_cb.userdata			  = this;
-	channel_cb.channel_shell_request_function = on_shell_request;
-	channel_cb.channel_pty_request_function	  = on_pty_request;
+	ssh_channel_callbacks_struct channel_cb	      = {};
+	channel_cb.userdata			      = this;
+	channel_cb.channel_shell_request_function     = on_shell_request;
+	channel_cb.channel_pty_request_function	      = on_pty_request;
+	channel_cb.channel_exec_request_function      = on_exec_request;
+	channel_cb.channel_subsystem_request_function = on_subsystem_request;
 	ssh_callbacks_init(&channel_cb);
 
 	channel.set_callbacks(&channel_cb);
 
-	while (!got_shell_) {
-		if (std::chrono::steady_clock::now() >= deadline)
+	while (!got_shell_ && !got_exec_ && !got_subsystem_) {
+		if (std::chrono::steady_clock::now() >= deadline) {
+			recorder::note(conn_id_, recorder::Phase::channel,
+				       recorder::Outcome::timeout);
+			metrics::add(metrics::Counter::connections_timed_out);
 			throw SshError{"Authentication timed out"};
-		if (event.poll(100) == SSH_ERROR)
+		}
+		if (event.poll(100) == SSH_ERROR) {
+			const int err = errno;
+			recorder::note(conn_id_, recorder::Phase::channel,
+				       recorder::Outcome::error, err);
 			throw SshError::from(
 					session_.get(),
 					"Event poll failed waiting for shell");
+		}
 	}
 
-	std::string passphrase;
-	if (secret_provider_.needs_passphrase()) {
+	if (got_subsystem_) {
+		recorder::note(conn_id_, recorder::Phase::channel,
+			       recorder::Outcome::ok);
+		serve_session(channel);
+		if (!watching_)
+			return;
+
+		// The hub's thread owns the session from here, and nothing
+		// may call back into this handler
+		channel.remove_callbacks(&channel_cb);
+		session_.clear_callbacks();
+		event.remove_session(session_);
+		if (options_.watch->adopt(std::move(session_),
+					  std::move(channel)))
+			return;
+		// Filled up since the request was checked
+		log::warn("Watch hub full, closing session");
+		metrics::add(metrics::Counter::session_request_errors);
+		channel.write(protocol::reply(protocol::Status::error,
+					      "Watch not available"));
+		channel.send_eof();
+		return;
+	}
+
+	std::vector<std::string> names;
+	if (got_exec_) {
+		auto parsed = parse_get(exec_command_);
+		if (!parsed) {
+			recorder::note(conn_id_, recorder::Phase::channel,
+				       recorder::Outcome::denied);
+			log::warn("Unsupported command: " + exec_command_);
+			fail_exec(channel, 2, "usage: get [name...]\n");
+			return;
+		}
+		names = std::move(*parsed);
+		for (const auto& name : names) {
+			if (options_.secrets
+			    && options_.secrets->contains(name))
+				continue;
+			recorder::note(conn_id_, recorder::Phase::channel,
+				       recorder::Outcome::denied);
+			fail_exec(channel, 1, "Unknown secret: " + name + "\n");
+			return;
+		}
+	}
+	recorder::note(conn_id_, recorder::Phase::channel,
+		       recorder::Outcome::ok);
+
+	const bool needs_passphrase =
+			names.empty() ? secret_provider_.needs_passphrase()
+				      : options_.secrets->needs_passphrase();
+
+	// Given at the keyboard-interactive prompt, or else the first line
+	std::string passphrase = std::move(passphrase_);
+	if (needs_passphrase && !secret_) {
+		trace::Span read_span{"passphrase", conn_id_};
 		passphrase = channel.read(auth_timeout_ * 1000);
 		if (passphrase.empty()) {
+			recorder::note(conn_id_, recorder::Phase::passphrase,
+				       recorder::Outcome::timeout);
 			log::warn("No passphrase received");
+			fail_exec(channel, 1, "No passphrase received\n");
 			return;
 		}
 	}
 
-	std::string secret = secret_provider_.get_secret(passphrase);
-	channel.write(secret);
+	AdmissionWork work{options_.admission};
+	cpu_clock_.enter(cpu::Phase::decrypt);
+	const auto  deliver_start = std::chrono::steady_clock::now();
+	std::string secret;
+	if (names.empty() && secret_) {
+		// Already decrypted during keyboard-interactive auth
+		secret = std::move(*secret_);
+	} else {
+		trace::Span decrypt_span{"decrypt", conn_id_};
+		try {
+			secret = load(names, passphrase);
+		} catch (const std::exception& e) {
+			recorder::note(conn_id_, recorder::Phase::decrypt,
+				       recorder::Outcome::error,
+				       os_error_of(e));
+			// A wrong passphrase costs a PBKDF2 run: treat it
+			// like a failed login
+			if (options_.limiter && needs_passphrase && !secret_)
+				options_.limiter->auth_failed(options_.source);
+			fail_exec(channel, 1, "Decryption failed\n");
+			throw;
+		}
+	}
+
+	// The write can wait on the client's window: only its CPU time counts
+	server_latency_ += std::chrono::steady_clock::now() - deliver_start;
+	const double write_before = cpu_clock_.seconds(cpu::Phase::write);
+	cpu_clock_.enter(cpu::Phase::write);
+	{
+		trace::Span write_span{"write", conn_id_};
+		channel.write(secret);
+	}
+	{
+		trace::Span eof_span{"eof", conn_id_};
+		channel.send_eof();
+		if (got_exec_)
+			channel.send_exit_status(0);
+	}
+	cpu_clock_.stop();
+	server_latency_ += cpu_time(cpu_clock_.seconds(cpu::Phase::write)
+				    - write_before);
+
+	recorder::note(conn_id_, recorder::Phase::write, recorder::Outcome::ok);
+	metrics::add(metrics::Counter::secrets_delivered,
+		     std::max<std::size_t>(names.size(), 1));
+	metrics::add(metrics::Counter::bytes_written, secret.size());
+
+	if (names.size() > 1)
+		log::info(std::to_string(names.size()) + " secrets delivered");
+	else
+		log::info("Secret delivered");
+}
+
+// The default secret with no names, one raw value for one name, framed
+// values for several. One passphrase covers them all.
+std::string ConnectionHandler::load(const std::vector<std::string>& names,
+				    std::string_view passphrase) const
+{
+	if (names.empty())
+		return secret_provider_.get_secret(passphrase);
+	if (names.size() == 1)
+		return options_.secrets->get_secret(names.front(), passphrase);
+
+	std::string out;
+	for (const auto& name : names)
+		append_frame(out, name,
+			     options_.secrets->get_secret(name, passphrase));
+	return out;
+}
+
+// Answers requests on one channel until the client closes it, goes idle
+// or spends its request budget. Only a request being answered counts
+// against the admission limit, not the session waiting for the next one.
+void ConnectionHandler::serve_session(SshChannel& channel)
+{
+	trace::Span span{"session", conn_id_};
+	metrics::add(metrics::Gauge::open_sessions, 1);
+	cpu_clock_.enter(cpu::Phase::write);
+	log::info("Session opened");
+
+	const int idle_ms = options_.session_idle_timeout * 1000;
+	int	  served  = 0;
+	try {
+		while (served < options_.session_max_requests
+		       && await_request(channel)) {
+			const auto request = protocol::read_frame(
+					channel, protocol::kMaxRequest,
+					idle_ms);
+			if (!request)
+				break;
+			served++;
+			// The reply comes from the hub, now and on every change
+			if (*request == "WATCH" && options_.watch
+			    && !options_.watch->full()) {
+				watching_ = true;
+				break;
+			}
+			channel.write(answer(*request));
+		}
+	} catch (const std::exception& e) {
+		log::warn(std::string{"Session aborted: "} + e.what());
+	}
+
+	cpu_clock_.stop();
+	metrics::add(metrics::Gauge::open_sessions, -1);
+	recorder::note(conn_id_, recorder::Phase::write,
+		       recorder::Outcome::ok);
+	if (watching_) {
+		log::info("Session watching for changes");
+		return;
+	}
+
 	channel.send_eof();
+	log::info("Session closed after " + std::to_string(served)
+		  + " requests");
+}
 
-	log::info("Secret delivered");
+// Waits for the next request in short slices, so shutdown does not sit
+// out an idle client. False once the session idled out or the server is
+// stopping; true at EOF too, for the read to find it.
+bool ConnectionHandler::await_request(SshChannel& channel) const
+{
+	using std::chrono::milliseconds;
+	using std::chrono::steady_clock;
+
+	const auto deadline =
+			steady_clock::now()
+			+ std::chrono::seconds{options_.session_idle_timeout};
+	for (;;) {
+		if (options_.running
+		    && !options_.running->load(std::memory_order_relaxed))
+			return false;
+		const auto left = std::chrono::duration_cast<milliseconds>(
+				deadline - steady_clock::now());
+		if (left.count() <= 0)
+			return false;
+		const auto slice = std::min(left, milliseconds{kIdleSliceMs});
+		if (channel.wait_readable(static_cast<int>(slice.count())))
+			return true;
+	}
+}
+
+std::string ConnectionHandler::answer(std::string_view request)
+{
+	using protocol::Status;
+
+	auto fail = [](std::string_view message) {
+		metrics::add(metrics::Counter::session_request_errors);
+		return protocol::reply(Status::error, message);
+	};
+
+	if (request == "PING") {
+		metrics::add(metrics::Counter::session_requests_ping);
+		return protocol::reply(Status::ok, {});
+	}
+
+	if (request == "LIST") {
+		metrics::add(metrics::Counter::session_requests_list);
+		std::string names;
+		if (options_.secrets)
+			for (const auto& name : options_.secrets->list())
+				names += name + '\n';
+		return protocol::reply(Status::ok, names);
+	}
+
+	// Only gets here when the hub is off or full
+	if (request == "WATCH")
+		return fail("Watch not available");
+
+	if (request != "GET" && !request.starts_with("GET "))
+		return fail("Unknown request");
+	metrics::add(metrics::Counter::session_requests_get);
+
+	std::vector<std::string> names;
+	if (request.size() > 4)
+		names.emplace_back(request.substr(4));
+	if (!names.empty()
+	    && (!options_.secrets || !options_.secrets->contains(names[0])))
+		return fail("Unknown secret: " + names[0]);
+
+	const bool needs_passphrase =
+			names.empty() ? secret_provider_.needs_passphrase()
+				      : options_.secrets->needs_passphrase();
+
+	// The default secret was decrypted once at the prompt; anything
+	// else encrypted needs the passphrase from it
+	std::string value;
+	if (names.empty() && secret_) {
+		value = *secret_;
+	} else if (needs_passphrase && passphrase_.empty()) {
+		return fail("Passphrase required");
+	} else {
+		trace::Span   decrypt_span{"decrypt", conn_id_};
+		AdmissionWork work{options_.admission};
+		try {
+			value = load(names, passphrase_);
+		} catch (const std::exception&) {
+			return fail("Decryption failed");
+		}
+	}
+
+	metrics::add(metrics::Counter::secrets_delivered);
+	metrics::add(metrics::Counter::bytes_written, value.size());
+	return protocol::reply(Status::ok, value);
+}
+
+void ConnectionHandler::leave_admission() noexcept
+{
+	if (std::exchange(admission_held_, false))
+		options_.admission->release();
 }
 
 int ConnectionHandler::on_auth_pubkey(ssh_session session, const char* user,
@@ -109,7 +521,12 @@ int ConnectionHandler::on_auth_pubkey(ssh_session session, const char* user,
 {
 	(void)session;
 
-	auto* self = static_cast<ConnectionHandler*>(userdata);
+	auto*	      self = static_cast<ConnectionHandler*>(userdata);
+	trace::Span   span{"auth_pubkey", self->conn_id_};
+	AdmissionWork work{self->options_.admission};
+
+	if (self->backing_off())
+		return self->deny(metrics::Counter::auth_failure_publickey);
 
 	if (signature_state == SSH_PUBLICKEY_STATE_NONE) {
 		if (self->authenticator_.check_pubkey(pubkey))
@@ -119,29 +536,27 @@ int ConnectionHandler::on_auth_pubkey(ssh_session session, const char* user,
 	}
 
 	if (signature_state == SSH_PUBLICKEY_STATE_VALID) {
-		if (!self->authenticator_.check_pubkey(pubkey)) {
-			log::warn("Authentication denied");
-			return SSH_AUTH_DENIED;
-		}
+		if (!self->authenticator_.check_pubkey(pubkey))
+			return self->deny(
+					metrics::Counter::auth_failure_publickey);
 
 		if (self->requires_both_) {
 			self->pubkey_passed_ = true;
 			self->session_.set_auth_methods(
 					SSH_AUTH_METHOD_PASSWORD);
+			metrics::add(metrics::Counter::auth_success_publickey);
 			return SSH_AUTH_PARTIAL;
 		}
 
-		if (!self->authenticator_.check_user(user)) {
-			log::warn("Authentication denied");
-			return SSH_AUTH_DENIED;
-		}
+		if (!self->authenticator_.check_user(user))
+			return self->deny(
+					metrics::Counter::auth_failure_publickey);
 
-		self->authenticated_ = true;
-		return SSH_AUTH_SUCCESS;
+		metrics::add(metrics::Counter::auth_success_publickey);
+		return self->grant("publickey");
 	}
 
-	log::warn("Authentication denied");
-	return SSH_AUTH_DENIED;
+	return self->deny(metrics::Counter::auth_failure_publickey);
 }
 
 int ConnectionHandler::on_auth_password(ssh_session session, const char* user,
@@ -149,31 +564,148 @@ int ConnectionHandler::on_auth_password(ssh_session session, const char* user,
 {
 	(void)session;
 
+	auto*	      self = static_cast<ConnectionHandler*>(userdata);
+	trace::Span   span{"auth_password", self->conn_id_};
+	AdmissionWork work{self->options_.admission};
+
+	if (self->backing_off())
+		return self->deny(metrics::Counter::auth_failure_password);
+
+	if (self->requires_both_ && !self->pubkey_passed_)
+		return self->deny(metrics::Counter::auth_failure_password);
+
+	if (!self->authenticator_.check_password(password))
+		return self->deny(metrics::Counter::auth_failure_password);
+
+	if (!self->authenticator_.check_user(user))
+		return self->deny(metrics::Counter::auth_failure_password);
+
+	metrics::add(metrics::Counter::auth_success_password);
+	return self->grant(self->requires_both_ ? "both" : "password");
+}
+
+// The client has proven who it is. With a passphrase prompt still to come
+// that is only a partial success.
+int ConnectionHandler::grant(const char* method)
+{
+	auth_method_ = method;
+	if (prompt_passphrase_) {
+		identity_passed_ = true;
+		session_.set_auth_methods(SSH_AUTH_METHOD_INTERACTIVE);
+		return SSH_AUTH_PARTIAL;
+	}
+
+	authenticated_ = true;
+	return SSH_AUTH_SUCCESS;
+}
+
+// libssh has no server callback for keyboard-interactive, so it arrives
+// through the generic message callback. Returning 1 lets libssh send its
+// default reply, a failure listing the methods still allowed.
+int ConnectionHandler::on_message(ssh_session session, ssh_message message,
+				  void* userdata)
+{
+	(void)session;
+
 	auto* self = static_cast<ConnectionHandler*>(userdata);
+	if (ssh_message_type(message) != SSH_REQUEST_AUTH
+	    || ssh_message_subtype(message) != SSH_AUTH_METHOD_INTERACTIVE)
+		return 1;
+	return self->on_kbdint(message);
+}
 
-	if (self->requires_both_ && !self->pubkey_passed_) {
-		log::warn("Authentication denied");
-		return SSH_AUTH_DENIED;
+int ConnectionHandler::on_kbdint(ssh_message message)
+{
+	trace::Span span{"auth_kbdint", conn_id_};
+
+	// Not offered until the identity check has passed
+	if (!identity_passed_)
+		return 1;
+	if (backing_off()) {
+		(void)deny(metrics::Counter::auth_failure_kbdint);
+		return 1;
 	}
 
-	if (!self->authenticator_.check_password(password)) {
-		log::warn("Authentication denied");
-		return SSH_AUTH_DENIED;
+	if (!ssh_message_auth_kbdint_is_response(message)) {
+		const char* prompts[] = {"Passphrase: "};
+		char	    echo[]    = {0};
+		ssh_message_auth_interactive_request(message, "ssh-drop", "",
+						     1, prompts, echo);
+		return 0;
 	}
 
-	if (!self->authenticator_.check_user(user)) {
-		log::warn("Authentication denied");
-		return SSH_AUTH_DENIED;
+	ssh_session session = session_.get();
+	if (ssh_userauth_kbdint_getnanswers(session) != 1) {
+		(void)deny(metrics::Counter::auth_failure_kbdint);
+		return 1;
 	}
 
-	self->authenticated_ = true;
-	return SSH_AUTH_SUCCESS;
+	// Decrypting is the passphrase check, so a wrong one is refused
+	// before any channel exists and the plaintext is ready by the time
+	// the shell or exec request arrives.
+	cpu_clock_.enter(cpu::Phase::decrypt);
+	const auto start = std::chrono::steady_clock::now();
+	try {
+		trace::Span   decrypt_span{"decrypt", conn_id_};
+		AdmissionWork work{options_.admission};
+		passphrase_ = ssh_userauth_kbdint_getanswer(session, 0);
+		secret_	    = secret_provider_.get_secret(passphrase_);
+	} catch (const std::exception& e) {
+		recorder::note(conn_id_, recorder::Phase::decrypt,
+			       recorder::Outcome::error, os_error_of(e));
+	}
+	server_latency_ += std::chrono::steady_clock::now() - start;
+	cpu_clock_.enter(cpu::Phase::auth);
+
+	if (!secret_) {
+		passphrase_.clear();
+		(void)deny(metrics::Counter::auth_failure_kbdint);
+		return 1;
+	}
+
+	authenticated_ = true;
+	metrics::add(metrics::Counter::auth_success_kbdint);
+	ssh_message_auth_reply_success(message, 0);
+	return 0;
+}
+
+int ConnectionHandler::deny(metrics::Counter counter)
+{
+	log::warn("Authentication denied");
+	recorder::note(conn_id_, recorder::Phase::auth,
+		       recorder::Outcome::denied);
+	metrics::add(counter);
+	if (options_.limiter)
+		options_.limiter->auth_failed(options_.source);
+	return SSH_AUTH_DENIED;
+}
+
+// A source that starts backing off mid-connection gets no more attempts,
+// right or wrong, until the block expires.
+bool ConnectionHandler::backing_off() const noexcept
+{
+	return options_.limiter
+	       && options_.limiter->backing_off(options_.source);
+}
+
+// Only meaningful on the exec path; a shell client just sees the channel
+// close.
+void ConnectionHandler::fail_exec(SshChannel& channel, int status,
+				  std::string_view message)
+{
+	if (!got_exec_)
+		return;
+	channel.write_stderr(message);
+	channel.send_eof();
+	channel.send_exit_status(status);
 }
 
 ssh_channel ConnectionHandler::on_channel_open(ssh_session session,
 					       void*	   userdata)
 {
-	auto* self	   = static_cast<ConnectionHandler*>(userdata);
+	auto*	    self = static_cast<ConnectionHandler*>(userdata);
+	trace::Span span{"channel_open", self->conn_id_};
+
 	self->raw_channel_ = ssh_channel_new(session);
 	return self->raw_channel_;
 }
@@ -184,7 +716,9 @@ int ConnectionHandler::on_shell_request(ssh_session session,
 	(void)session;
 	(void)channel;
 
-	auto* self	 = static_cast<ConnectionHandler*>(userdata);
+	auto*	    self = static_cast<ConnectionHandler*>(userdata);
+	trace::Span span{"shell", self->conn_id_};
+
 	self->got_shell_ = true;
 	return 0;
 }
@@ -200,11 +734,47 @@ int ConnectionHandler::on_pty_request(ssh_session session, ssh_channel channel,
 	(void)rows;
 	(void)py;
 	(void)px;
-	(void)userdata;
+
+	auto*	    self = static_cast<ConnectionHandler*>(userdata);
+	trace::Span span{"pty", self->conn_id_};
 
 	// Accept — puts client in raw mode (no local echo),
 	// which hides passphrase input.
 	return 0;
 }
 
+int ConnectionHandler::on_exec_request(ssh_session session,
+				       ssh_channel channel, const char* command,
+				       void* userdata)
+{
+	(void)session;
+	(void)channel;
+
+	auto*	    self = static_cast<ConnectionHandler*>(userdata);
+	trace::Span span{"exec", self->conn_id_};
+
+	// Always accepted; an unknown command gets its answer as an exit
+	// status, like a real shell would give.
+	self->exec_command_ = command ? command : "";
+	self->got_exec_	    = true;
+	return 0;
+}
+
+int ConnectionHandler::on_subsystem_request(ssh_session session,
+					    ssh_channel channel,
+					    const char* subsystem,
+					    void*	userdata)
+{
+	(void)session;
+	(void)channel;
+
+	auto*	    self = static_cast<ConnectionHandler*>(userdata);
+	trace::Span span{"subsystem", self->conn_id_};
+
+	if (!subsystem || std::string_view{subsystem} != protocol::kSubsystem)
+		return SSH_ERROR;
+	self->got_subsystem_ = true;
+	return 0;
+}
+
 } // namespace drop
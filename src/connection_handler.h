@@ -1,23 +1,82 @@
 #ifndef SSH_DROP_CONNECTION_HANDLER_H_
 #define SSH_DROP_CONNECTION_HANDLER_H_
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
 #include <libssh/libssh.h>
 
+#include "admission.h"
 #include "authenticator.h"
+#include "cpu_accounting.h"
+#include "metrics.h"
+#include "rate_limiter.h"
 #include "secret_provider.h"
 #include "ssh_types.h"
+#include "watch_hub.h"
 
 namespace drop {
 
+struct ConnectionOptions {
+	// Failed auth and wrong passphrases feed the per-source backoff
+	RateLimiter*  limiter = nullptr;
+	std::uint64_t source  = 0;
+
+	// With an encrypted secret, ask for the passphrase as a
+	// keyboard-interactive step after the identity check instead of
+	// reading it from the channel
+	bool prompt_passphrase = false;
+
+	// Named secrets for "get <name...>"; without one only the default
+	// secret can be fetched
+	const SecretDirectory* secrets = nullptr;
+
+	// Holds the slot taken at accept until key exchange is done; auth
+	// checks and deliveries take one again while they run, and the
+	// connection's latency is reported when it ends
+	AdmissionController* admission = nullptr;
+
+	// ssh-drop subsystem sessions close after this long without a
+	// request, or after this many requests
+	int session_idle_timeout = 300;
+	int session_max_requests = 10000;
+
+	// Takes over sessions that send WATCH; none when watching is off
+	WatchHub* watch = nullptr;
+
+	// The server's run flag: an idle session closes soon after it is
+	// cleared instead of holding up shutdown
+	const std::atomic<bool>* running = nullptr;
+};
+
 class ConnectionHandler {
 public:
 	ConnectionHandler(SshSession		 session,
 			  const IAuthenticator&	 authenticator,
 			  const ISecretProvider& secret_provider,
-			  int			 auth_timeout);
+			  int			 auth_timeout,
+			  std::uint64_t		 conn_id,
+			  ConnectionOptions	 options = {});
+	~ConnectionHandler();
+
+	ConnectionHandler(const ConnectionHandler&)	       = delete;
+	ConnectionHandler& operator=(const ConnectionHandler&) = delete;
 
 	void run();
 
+	// CPU time of key exchange and of writing the reply, which both
+	// wait on the client, plus wall time of decrypting; what overload
+	// makes worse and the client cannot stretch.
+	[[nodiscard]] std::chrono::nanoseconds server_latency() const noexcept
+	{
+		return server_latency_;
+	}
+
 private:
 	static int	   on_auth_pubkey(ssh_session session, const char* user,
 					  ssh_key_struct* pubkey, char signature_state,
@@ -26,25 +85,76 @@ private:
 					    const char* user,
 					    const char* password,
 					    void*	userdata);
+	static int on_message(ssh_session session, ssh_message message,
+			      void* userdata);
+	int	   on_kbdint(ssh_message message);
+
+	int  grant(const char* method);
+	int  deny(metrics::Counter counter);
+	bool backing_off() const noexcept;
+
 	static ssh_channel on_channel_open(ssh_session session, void* userdata);
 	static int on_shell_request(ssh_session session, ssh_channel channel,
 				    void* userdata);
 	static int on_pty_request(ssh_session session, ssh_channel channel,
 				  const char* term, int cols, int rows,
 				  int py, int px, void* userdata);
+	static int on_exec_request(ssh_session session, ssh_channel channel,
+				   const char* command, void* userdata);
+	static int on_subsystem_request(ssh_session session,
+					ssh_channel channel,
+					const char* subsystem, void* userdata);
+
+	void fail_exec(SshChannel& channel, int status,
+		       std::string_view message);
+	[[nodiscard]] std::string load(const std::vector<std::string>& names,
+				       std::string_view passphrase) const;
+
+	void			  serve_session(SshChannel& channel);
+	[[nodiscard]] bool	  await_request(SshChannel& channel) const;
+	[[nodiscard]] std::string answer(std::string_view request);
+	void			  leave_admission() noexcept;
 
 	SshSession	       session_;
 	const IAuthenticator&  authenticator_;
 	const ISecretProvider& secret_provider_;
 
-	int auth_timeout_;
+	int		  auth_timeout_;
+	std::uint64_t	  conn_id_;
+	ConnectionOptions options_;
 
 	ssh_channel raw_channel_   = nullptr;
 	bool	    authenticated_ = false;
 	bool	    got_shell_	   = false;
 
+	// Set instead of got_shell_ by an exec request; the secret then goes
+	// out with an exit-status and no PTY or shell round trips
+	bool	    got_exec_ = false;
+	std::string exec_command_;
+
+	// Set by a request for the ssh-drop subsystem: the channel then
+	// carries framed requests until the client is done
+	bool got_subsystem_ = false;
+	// Set when a subsystem session asks to WATCH and goes to the hub
+	bool watching_ = false;
+
 	bool pubkey_passed_ = false;
 	bool requires_both_ = false;
+
+	// Keyboard-interactive passphrase step: identity_passed_ once the
+	// key or password is accepted, secret_ once the answer decrypts.
+	// The answer is kept for named secrets until delivery.
+	bool			   prompt_passphrase_ = false;
+	bool			   identity_passed_   = false;
+	std::optional<std::string> secret_;
+	std::string		   passphrase_;
+
+	// The slot taken by the accept loop, until key exchange is done
+	bool admission_held_ = false;
+
+	const char*		 auth_method_ = "none";
+	cpu::PhaseClock		 cpu_clock_{cpu::Phase::kex};
+	std::chrono::nanoseconds server_latency_{0};
 };
 
 } // namespace drop
@@ -0,0 +1,160 @@
+#include "cpu_accounting.h"
+
+#include <atomic>
+#include <mutex>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <ctime>
+#endif
+
+namespace drop::cpu {
+
+namespace {
+
+// Far more than the auth methods times the secret sources there are
+constexpr std::size_t kMaxEntries = 64;
+
+// The names are written once, before the entry is published through
+// g_count, and never change; the sums are plain atomic adds.
+struct Entry {
+	std::string					    auth_method;
+	std::string					    provider;
+	std::atomic<std::uint64_t>			    connections{0};
+	std::array<std::atomic<std::uint64_t>, kPhaseCount> ns{};
+};
+
+std::array<Entry, kMaxEntries> g_entries;
+std::atomic<std::size_t>       g_count{0};
+// Only taken the first time a pair is seen
+std::mutex g_insert_mutex;
+
+Entry* find(std::string_view auth_method, std::string_view provider,
+	    std::size_t count) noexcept
+{
+	for (std::size_t i = 0; i < count; ++i)
+		if (g_entries[i].auth_method == auth_method
+		    && g_entries[i].provider == provider)
+			return &g_entries[i];
+	return nullptr;
+}
+
+Entry* entry_for(std::string_view auth_method, std::string_view provider)
+{
+	if (auto* e = find(auth_method, provider,
+			   g_count.load(std::memory_order_acquire)))
+		return e;
+
+	std::lock_guard lock{g_insert_mutex};
+	const auto	count = g_count.load(std::memory_order_relaxed);
+	if (auto* e = find(auth_method, provider, count))
+		return e;
+	if (count == kMaxEntries)
+		return nullptr;
+
+	auto& e	      = g_entries[count];
+	e.auth_method = auth_method;
+	e.provider    = provider;
+	g_count.store(count + 1, std::memory_order_release);
+	return &e;
+}
+
+} // namespace
+
+double thread_seconds() noexcept
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel,
+			    &user))
+		return 0.0;
+
+	auto to_100ns = [](const FILETIME& ft) {
+		return (static_cast<std::uint64_t>(ft.dwHighDateTime) << 32)
+		       | ft.dwLowDateTime;
+	};
+	return static_cast<double>(to_100ns(kernel) + to_100ns(user)) * 1e-7;
+#else
+	struct timespec ts{};
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+		return 0.0;
+	return static_cast<double>(ts.tv_sec)
+	       + static_cast<double>(ts.tv_nsec) * 1e-9;
+#endif
+}
+
+const char* phase_name(Phase phase) noexcept
+{
+	switch (phase) {
+	case Phase::kex:
+		return "kex";
+	case Phase::auth:
+		return "auth";
+	case Phase::decrypt:
+		return "decrypt";
+	case Phase::write:
+		return "write";
+	}
+	return "?";
+}
+
+PhaseClock::PhaseClock(Phase first) noexcept
+    : current_{first},
+      mark_{thread_seconds()}
+{
+}
+
+void PhaseClock::enter(Phase next) noexcept
+{
+	const double now = thread_seconds();
+	if (running_)
+		times_[static_cast<std::size_t>(current_)] += now - mark_;
+
+	current_ = next;
+	mark_	 = now;
+	running_ = true;
+}
+
+void PhaseClock::stop() noexcept
+{
+	if (!running_)
+		return;
+
+	times_[static_cast<std::size_t>(current_)] += thread_seconds() - mark_;
+	running_ = false;
+}
+
+void record(std::string_view auth_method, std::string_view provider,
+	    const PhaseTimes& times)
+{
+	auto* entry = entry_for(auth_method, provider);
+	if (!entry)
+		return;
+
+	entry->connections.fetch_add(1, std::memory_order_relaxed);
+	for (std::size_t i = 0; i < kPhaseCount; ++i)
+		entry->ns[i].fetch_add(
+				static_cast<std::uint64_t>(times[i] * 1e9),
+				std::memory_order_relaxed);
+}
+
+std::vector<Totals> snapshot()
+{
+	const auto	    count = g_count.load(std::memory_order_acquire);
+	std::vector<Totals> out(count);
+	for (std::size_t i = 0; i < count; ++i) {
+		const auto& e	   = g_entries[i];
+		out[i].auth_method = e.auth_method;
+		out[i].provider	   = e.provider;
+		out[i].connections = e.connections.load(
+				std::memory_order_relaxed);
+		for (std::size_t p = 0; p < kPhaseCount; ++p) {
+			const auto ns = e.ns[p].load(std::memory_order_relaxed);
+			out[i].seconds[p] = static_cast<double>(ns) * 1e-9;
+		}
+	}
+	return out;
+}
+
+} // namespace drop::cpu
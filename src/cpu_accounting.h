@@ -0,0 +1,71 @@
+#ifndef SSH_DROP_CPU_ACCOUNTING_H_
+#define SSH_DROP_CPU_ACCOUNTING_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace drop::cpu {
+
+enum class Phase {
+	kex,
+	auth,
+	decrypt,
+	write
+};
+
+constexpr std::size_t kPhaseCount = 4;
+
+using PhaseTimes = std::array<double, kPhaseCount>;
+
+// CPU time consumed by the calling thread, in seconds.
+[[nodiscard]] double thread_seconds() noexcept;
+
+[[nodiscard]] const char* phase_name(Phase phase) noexcept;
+
+// Charges the calling thread's CPU time to the phase that is currently
+// active. Must be used from a single thread.
+class PhaseClock {
+public:
+	explicit PhaseClock(Phase first) noexcept;
+
+	void enter(Phase next) noexcept;
+	void stop() noexcept;
+
+	[[nodiscard]] const PhaseTimes& times() const noexcept
+	{
+		return times_;
+	}
+
+	[[nodiscard]] double seconds(Phase phase) const noexcept
+	{
+		return times_[static_cast<std::size_t>(phase)];
+	}
+
+private:
+	Phase	   current_;
+	double	   mark_;
+	bool	   running_ = true;
+	PhaseTimes times_{};
+};
+
+struct Totals {
+	std::string   auth_method;
+	std::string   provider;
+	std::uint64_t connections = 0;
+	PhaseTimes    seconds{};
+};
+
+// Lock-free once a pair of names has been seen; the first connection
+// with a new pair takes a lock to add it.
+void record(std::string_view auth_method, std::string_view provider,
+	    const PhaseTimes& times);
+
+[[nodiscard]] std::vector<Totals> snapshot();
+
+} // namespace drop::cpu
+
+#endif // SSH_DROP_CPU_ACCOUNTING_H_
@@ -1,7 +1,6 @@
 #include "crypto.h"
 
 #include <stdexcept>
-#include <vector>
 
 #include <mbedtls/base64.h>
 #include <mbedtls/ctr_drbg.h>
@@ -68,45 +67,6 @@ void derive_key(const unsigned char* salt, std::string_view passphrase,
 		throw std::runtime_error{"PBKDF2 derivation failed"};
 }
 
-std::string base64_encode(const unsigned char* data, std::size_t len)
-{
-	std::size_t out_len = 0;
-	mbedtls_base64_encode(nullptr, 0, &out_len, data, len);
-
-	std::string result(out_len, '\0');
-	if (mbedtls_base64_encode(
-			    reinterpret_cast<unsigned char*>(result.data()),
-			    result.size(), &out_len, data, len)
-	    != 0)
-		throw std::runtime_error{"Base64 encode failed"};
-
-	// mbedtls adds a null terminator in the count; trim it
-	if (!result.empty() && result.back() == '\0')
-		result.pop_back();
-
-	return result;
-}
-
-std::vector<unsigned char> base64_decode(std::string_view b64)
-{
-	std::size_t out_len = 0;
-	mbedtls_base64_decode(nullptr, 0, &out_len,
-			      reinterpret_cast<const unsigned char*>(b64.data()),
-			      b64.size());
-
-	std::vector<unsigned char> result(out_len);
-	if (mbedtls_base64_decode(
-			    result.data(), result.size(), &out_len,
-			    reinterpret_cast<const unsigned char*>(b64.data()),
-			    b64.size())
-	    != 0)
-		throw std::runtime_error{
-				"Base64 decode failed (corrupt data)"};
-
-	result.resize(out_len);
-	return result;
-}
-
 } // namespace
 
 std::string encrypt(std::string_view plaintext, std::string_view passphrase)
@@ -192,4 +152,43 @@ std::optional<std::string> decrypt(std::string_view data_b64, std::string_view p
 	return plaintext;
 }
 
+std::string base64_encode(const unsigned char* data, std::size_t len)
+{
+	std::size_t out_len = 0;
+	mbedtls_base64_encode(nullptr, 0, &out_len, data, len);
+
+	std::string result(out_len, '\0');
+	if (mbedtls_base64_encode(
+			    reinterpret_cast<unsigned char*>(result.data()),
+			    result.size(), &out_len, data, len)
+	    != 0)
+		throw std::runtime_error{"Base64 encode failed"};
+
+	// mbedtls adds a null terminator in the count; trim it
+	if (!result.empty() && result.back() == '\0')
+		result.pop_back();
+
+	return result;
+}
+
+std::vector<unsigned char> base64_decode(std::string_view b64)
+{
+	std::size_t out_len = 0;
+	mbedtls_base64_decode(nullptr, 0, &out_len,
+			      reinterpret_cast<const unsigned char*>(b64.data()),
+			      b64.size());
+
+	std::vector<unsigned char> result(out_len);
+	if (mbedtls_base64_decode(
+			    result.data(), result.size(), &out_len,
+			    reinterpret_cast<const unsigned char*>(b64.data()),
+			    b64.size())
+	    != 0)
+		throw std::runtime_error{
+				"Base64 decode failed (corrupt data)"};
+
+	result.resize(out_len);
+	return result;
+}
+
 } // namespace drop::crypto
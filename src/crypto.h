@@ -1,9 +1,11 @@
 #ifndef SSH_DROP_CRYPTO_H_
 #define SSH_DROP_CRYPTO_H_
 
+#include <cstddef>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <vector>
 
 namespace drop::crypto {
 
@@ -20,6 +22,11 @@ constexpr int kHeaderLen   = kSaltLen + kNonceLen + kTagLen;
 [[nodiscard]] std::optional<std::string> decrypt(std::string_view data_b64,
 						  std::string_view passphrase);
 
+[[nodiscard]] std::string base64_encode(const unsigned char* data,
+					std::size_t	     len);
+
+[[nodiscard]] std::vector<unsigned char> base64_decode(std::string_view b64);
+
 } // namespace drop::crypto
 
 #endif // SSH_DROP_CRYPTO_H_
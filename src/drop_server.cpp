@@ -1,67 +1,800 @@
 #include "drop_server.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 #include "connection_handler.h"
+#include "cpu_accounting.h"
+#include "flight_recorder.h"
+#include "handoff.h"
+#include "local_endpoint.h"
 #include "log.h"
+#include "metrics.h"
+#include "service_manager.h"
+#include "signal_guard.h"
 #include "ssh_types.h"
+#include "trace.h"
+#include "worker_pool.h"
 
 namespace drop {
 
+namespace {
+
+// The accept loop comes round at least once a second when healthy
+constexpr auto kStalledAfter = std::chrono::seconds{5};
+
+// How long a new binary gets to load its config and keys and start serving
+constexpr auto kUpgradeReadyTimeout = std::chrono::seconds{30};
+
+// Worker n numbers its connections from n * kWorkerConnIds + 1, so ids in
+// logs, traces and recorder dumps say which worker they came from
+constexpr std::uint64_t kWorkerConnIds = 1'000'000'000;
+
+std::chrono::steady_clock::rep now_ticks() noexcept
+{
+	return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+void log_cpu_summary()
+{
+	for (const auto& t : cpu::snapshot()) {
+		double total = 0.0;
+		for (double s : t.seconds)
+			total += s;
+
+		const double n = static_cast<double>(t.connections);
+
+		// CPU-seconds per connection x 1000 = cores per 1k conn/s
+		char buf[256];
+		std::snprintf(buf, sizeof(buf),
+			      "CPU [%s/%s]: %llu connections, per connection "
+			      "kex=%.3fms auth=%.3fms decrypt=%.3fms "
+			      "write=%.3fms (%.2f cores per 1k conn/s)",
+			      t.auth_method.c_str(), t.provider.c_str(),
+			      static_cast<unsigned long long>(t.connections),
+			      t.seconds[0] / n * 1e3, t.seconds[1] / n * 1e3,
+			      t.seconds[2] / n * 1e3, t.seconds[3] / n * 1e3,
+			      total / n * 1e3);
+		log::info(buf);
+	}
+}
+
+void write_trace(const std::string& path)
+{
+	try {
+		trace::write_json(path);
+		log::info("Trace written to " + path);
+	} catch (const std::exception& e) {
+		log::error(e.what());
+	}
+}
+
+void handle_trace_toggle(const std::string& path)
+{
+	if (path.empty()) {
+		log::warn("SIGUSR2 ignored: trace_file is not configured");
+		return;
+	}
+
+	if (trace::enabled()) {
+		trace::set_enabled(false);
+		write_trace(path);
+	} else {
+		trace::set_enabled(true);
+		log::info("Tracing enabled");
+	}
+}
+
+void set_algorithms(SshBind& bind, const ServerConfig& config)
+{
+	if (!config.kex_algorithms.empty())
+		bind.set_kex_algorithms(config.kex_algorithms);
+	if (!config.ciphers.empty())
+		bind.set_ciphers(config.ciphers);
+	if (!config.macs.empty())
+		bind.set_macs(config.macs);
+	if (!config.hostkey_algorithms.empty())
+		bind.set_hostkey_algorithms(config.hostkey_algorithms);
+}
+
+void configure_bind(SshBind& bind, const ServerConfig& config)
+{
+	for (const auto& path : config.host_key_paths)
+		bind.set_host_key(path);
+	set_algorithms(bind, config);
+}
+
+// Processes the limits are split between: every worker enforces its own,
+// on roughly an equal part of the traffic
+int limit_shares(const ServerConfig& config)
+{
+#ifdef _WIN32
+	// workers is ignored there
+	(void)config;
+	return 1;
+#else
+	return std::max(1, config.workers);
+#endif
+}
+
+// A worker's part of a server-wide limit, at least 1
+int worker_share(int limit, const ServerConfig& config)
+{
+	if (limit <= 0)
+		return limit;
+	return std::max(1, limit / limit_shares(config));
+}
+
+std::unique_ptr<AdmissionController>
+make_admission(const ServerConfig& config)
+{
+	if (config.latency_target_ms <= 0)
+		return nullptr;
+
+	AdmissionController::Limits limits;
+	limits.min    = worker_share(config.concurrency_min, config);
+	limits.max    = worker_share(config.concurrency_max, config);
+	limits.target = std::chrono::milliseconds{config.latency_target_ms};
+	return std::make_unique<AdmissionController>(limits);
+}
+
+// Only a plain secret can be shared: an encrypted one would be pushed as
+// ciphertext, or decrypted once per subscriber
+std::unique_ptr<WatchHub>
+make_watch_hub(const ServerConfig&		      config,
+	       std::shared_ptr<const ISecretProvider> provider)
+{
+	if (config.watch_max_subscribers <= 0 || config.secret_encrypted)
+		return nullptr;
+
+	WatchHub::Limits limits;
+	limits.max_subscribers = static_cast<std::size_t>(
+			worker_share(config.watch_max_subscribers, config));
+	limits.stall_timeout = std::chrono::seconds{config.watch_stall_timeout};
+	return std::make_unique<WatchHub>(std::move(provider),
+					  config.secret_file.value_or(""),
+					  limits);
+}
+
+// Null when neither list is set
+std::shared_ptr<const IpFilter> make_ip_filter(const ServerConfig& config)
+{
+	if (config.allow_from.empty() && config.deny_from.empty())
+		return nullptr;
+	return std::make_shared<const IpFilter>(config.allow_from,
+						config.deny_from);
+}
+
+// Keys behind things built once at startup: the listener, the local
+// endpoints, the limiters and the watch hub
+void warn_restart_only(const ServerConfig& was, const ServerConfig& now)
+{
+	const std::pair<const char*, bool> keys[] = {
+			{"port", was.port != now.port},
+			{"workers", was.workers != now.workers},
+			{"metrics_socket",
+			 was.metrics_socket != now.metrics_socket},
+			{"health_listen",
+			 was.health_listen != now.health_listen},
+			{"log_level", was.log_level != now.log_level},
+			{"log_file", was.log_file != now.log_file},
+			{"rate_limit", was.rate_limit != now.rate_limit},
+			{"rate_burst", was.rate_burst != now.rate_burst},
+			{"auth_failures_allowed",
+			 was.auth_failures_allowed
+					 != now.auth_failures_allowed},
+			{"auth_backoff", was.auth_backoff != now.auth_backoff},
+			{"auth_backoff_max",
+			 was.auth_backoff_max != now.auth_backoff_max},
+			{"rate_table_size",
+			 was.rate_table_size != now.rate_table_size},
+			{"latency_target_ms",
+			 was.latency_target_ms != now.latency_target_ms},
+			{"concurrency_min",
+			 was.concurrency_min != now.concurrency_min},
+			{"concurrency_max",
+			 was.concurrency_max != now.concurrency_max},
+			{"watch_max_subscribers",
+			 was.watch_max_subscribers
+					 != now.watch_max_subscribers},
+			{"watch_stall_timeout",
+			 was.watch_stall_timeout != now.watch_stall_timeout},
+	};
+	for (const auto& [key, changed] : keys)
+		if (changed)
+			log::warn(std::string{key}
+				  + " changed; it applies after a restart");
+}
+
+std::unique_ptr<RateLimiter> make_limiter(const ServerConfig& config)
+{
+	if (config.rate_limit <= 0.0 && config.auth_backoff <= 0)
+		return nullptr;
+
+	RateLimiter::Limits limits;
+	limits.connections_per_s = config.rate_limit;
+	limits.burst		 = config.rate_burst;
+	limits.failures_allowed	 = config.auth_failures_allowed;
+	limits.backoff		 = std::chrono::seconds{config.auth_backoff};
+	limits.backoff_max = std::chrono::seconds{config.auth_backoff_max};
+	limits.capacity	   = static_cast<std::size_t>(config.rate_table_size);
+	// Built before any worker is forked: one table serves them all and
+	// their replacements, so a source is held to one set of limits
+	// whichever worker the kernel gives its connections to
+	limits.shared = config.workers > 0;
+	return std::make_unique<RateLimiter>(limits);
+}
+
+// Refused sources cost an accept and a close, never a kex
+void refuse(socket_t fd, std::uint64_t conn_id, const sockaddr* peer,
+	    const char* why)
+{
+	close_socket(fd);
+	log::debug("Refused connection from " + format_address(peer) + " ("
+		   + why + ")");
+	recorder::note(conn_id, recorder::Phase::accept,
+		       recorder::Outcome::denied);
+	metrics::add(metrics::Counter::connections_rejected);
+}
+
+// Over the admission limit: RST instead of FIN, so the client fails at
+// once instead of waiting on a banner, and no TIME_WAIT is left behind.
+void shed(socket_t fd, std::uint64_t conn_id, const sockaddr* peer)
+{
+	linger lg{};
+	lg.l_onoff  = 1;
+	lg.l_linger = 0;
+	(void)setsockopt(fd, SOL_SOCKET, SO_LINGER,
+			 reinterpret_cast<const char*>(&lg), sizeof(lg));
+	refuse(fd, conn_id, peer, "over admission limit");
+	metrics::add(metrics::Counter::connections_shed);
+}
+
+bool admit(RateLimiter& limiter, std::uint64_t source, socket_t fd,
+	   std::uint64_t conn_id, const sockaddr* peer)
+{
+	switch (limiter.admit(source)) {
+	case RateLimiter::Verdict::admit:
+		return true;
+	case RateLimiter::Verdict::rate_limited:
+		refuse(fd, conn_id, peer, "rate limited");
+		metrics::add(metrics::Counter::throttled_rate);
+		return false;
+	case RateLimiter::Verdict::backing_off:
+		refuse(fd, conn_id, peer, "backing off");
+		metrics::add(metrics::Counter::throttled_backoff);
+		return false;
+	}
+	return false;
+}
+
+} // namespace
+
+void reconfigure_bind(SshBind& bind, const ServerConfig& config)
+{
+	// Keys are read and checked, and the lists tried on a bind of its
+	// own, before the live one is touched; past that nothing can fail
+	std::vector<SshKeyPtr>	    keys;
+	std::vector<ssh_keytypes_e> types;
+	for (const auto& path : config.host_key_paths) {
+		keys.push_back(load_private_key(path));
+		const auto type = ssh_key_type(keys.back().get());
+		if (std::find(types.begin(), types.end(), type) != types.end())
+			throw SshError{std::string{"Duplicate "}
+				       + ssh_key_type_to_char(type)
+				       + " host key: " + path};
+		types.push_back(type);
+	}
+	SshBind scratch;
+	set_algorithms(scratch, config);
+
+	bind.reset_host_keys();
+	for (std::size_t i = 0; i < keys.size(); ++i)
+		bind.set_host_key(std::move(keys[i]),
+				  config.host_key_paths[i]);
+	set_algorithms(bind, config);
+}
+
 DropServer::DropServer(ServerConfig			config,
 		       std::unique_ptr<IAuthenticator>	authenticator,
 		       std::unique_ptr<ISecretProvider> secret_provider)
     : config_{std::move(config)},
-      authenticator_{std::move(authenticator)},
-      secret_provider_{std::move(secret_provider)}
+      limiter_{make_limiter(config_)},
+      admission_{make_admission(config_)}
+{
+	auto gen	     = std::make_shared<Generation>();
+	gen->authenticator   = std::move(authenticator);
+	gen->secret_provider = std::move(secret_provider);
+	gen->secrets	     = make_secret_directory(config_);
+
+	generation_.store(std::move(gen), std::memory_order_release);
+	set_ip_filter(make_ip_filter(config_));
+}
+
+void DropServer::set_config_loader(ConfigLoader loader)
+{
+	load_config_ = std::move(loader);
+}
+
+void DropServer::set_upgrade_command(std::vector<std::string> command)
+{
+	upgrade_command_ = std::move(command);
+}
+
+void DropServer::set_ip_filter(std::shared_ptr<const IpFilter> filter) noexcept
+{
+	ip_filter_.store(std::move(filter), std::memory_order_release);
+}
+
+LocalEndpoint::Reply DropServer::health(std::string_view path) const
+{
+	const auto last = last_pass_.load(std::memory_order_relaxed);
+	const std::chrono::steady_clock::duration since{now_ticks() - last};
+	const bool live = listening_.load(std::memory_order_relaxed)
+			  && since < kStalledAfter;
+
+	if (path == "/livez") {
+		if (!live)
+			return {503, "accept loop stalled\n"};
+		return {200, "ok\n"};
+	}
+	if (path != "/readyz" && path != "/")
+		return {404, "Not found\n"};
+
+	std::string why;
+	if (!live)
+		why += "not accepting\n";
+	const auto gen = generation_.load(std::memory_order_acquire);
+	if (!gen->secret_provider->readable())
+		why += "secret source unreadable\n";
+	if (admission_ && admission_->at_limit())
+		why += "at admission limit\n";
+	if (!why.empty())
+		return {503, why};
+	return {200, "ok\n"};
+}
+
+bool DropServer::reload(SshBind& bind)
 {
+	if (!load_config_) {
+		log::warn("SIGHUP ignored: no configuration to reload");
+		return false;
+	}
+	log::info("Reloading configuration");
+
+	// Everything that can fail is built before anything is swapped, and
+	// the bind, which cannot be built aside, is changed last and all at
+	// once, so a bad config leaves the running one untouched
+	ServerConfig			config;
+	std::shared_ptr<Generation>	next;
+	std::shared_ptr<const IpFilter> filter;
+	try {
+		config = load_config_();
+		if (watch_ && config.secret_encrypted)
+			throw std::runtime_error{
+					"secret_encrypted cannot be set while "
+					"watching is on; restart to apply"};
+		next		      = std::make_shared<Generation>();
+		next->authenticator   = make_authenticator(config);
+		next->secret_provider = make_secret_provider(config);
+		next->secrets	      = make_secret_directory(config);
+		filter		      = make_ip_filter(config);
+
+		reconfigure_bind(bind, config);
+	} catch (const std::exception& e) {
+		log::error(std::string{"Reload failed, keeping the running "
+				       "configuration: "}
+			   + e.what());
+		metrics::add(metrics::Counter::config_reload_failures);
+		return false;
+	}
+
+	warn_restart_only(config_, config);
+	set_ip_filter(std::move(filter));
+	if (watch_)
+		watch_->reload(next->secret_provider,
+			       config.secret_file.value_or(""));
+	generation_.store(std::move(next), std::memory_order_release);
+	config_ = std::move(config);
+
+	metrics::add(metrics::Counter::config_reloads);
+	log::info("Configuration reloaded");
+	return true;
+}
+
+bool DropServer::upgrade(const SshBind& bind)
+{
+	if (upgrade_command_.empty()) {
+		log::warn("SIGQUIT ignored: no command to upgrade with");
+		return false;
+	}
+	log::info("Upgrading: starting " + upgrade_command_.front());
+
+	std::optional<int> pid;
+	try {
+		pid = handoff::spawn(upgrade_command_,
+				     ssh_bind_get_fd(bind.get()),
+				     kUpgradeReadyTimeout);
+	} catch (const std::exception& e) {
+		log::error(std::string{"Upgrade failed: "} + e.what());
+		return false;
+	}
+	if (!pid) {
+		log::error("Upgrade failed: the new process did not start "
+			   "serving; carrying on");
+		return false;
+	}
+
+	log::info("Upgrade handed the listener to pid "
+		  + std::to_string(*pid));
+	return true;
 }
 
 void DropServer::run(std::atomic<bool>& running)
 {
 	SshBind bind;
 	bind.set_port(config_.port);
-	bind.set_host_key(config_.host_key_path);
-	bind.listen();
+	configure_bind(bind, config_);
+
+	// With socket activation systemd holds the port while this process
+	// is down or starting, so connections queue instead of being refused
+	const auto activated = service::listen_fds();
+	const auto inherited = handoff::inherited_listener();
+	if (inherited) {
+		bind.listen_on(*inherited);
+		log::info("Took over the listener on port " + config_.port);
+	} else if (!activated.empty()) {
+		if (activated.size() > 1)
+			log::warn("systemd passed "
+				  + std::to_string(activated.size())
+				  + " sockets; serving the first");
+		for (std::size_t i = 1; i < activated.size(); ++i)
+			close_socket(activated[i]);
+		bind.listen_on(activated.front());
+		log::info("Listening on the socket passed by systemd");
+	} else {
+		bind.listen();
+		log::info("Listening on port " + config_.port);
+	}
+
+	handed_over_ = inherited.has_value();
+	// Only systemd can start the server again when a client turns up
+	may_idle_exit_ = !activated.empty() && !inherited
+			 && config_.workers == 0;
+	if (config_.idle_exit > 0 && !may_idle_exit_)
+		log::warn("idle_exit ignored: it needs the listener passed by "
+			  "systemd and no workers");
+
+#ifndef _WIN32
+	if (config_.workers > 0) {
+		supervise(bind, running);
+		return;
+	}
+#else
+	if (config_.workers > 0)
+		log::warn("workers ignored: not supported on this platform");
+#endif
+	serve(bind, running);
+}
+
+void DropServer::announce_ready() const
+{
+	// The process this one replaces stops accepting on this; under
+	// systemd the new pid becomes the main one
+	handoff::ready();
+	std::string state = "READY=1";
+#ifndef _WIN32
+	if (handed_over_)
+		state = "MAINPID=" + std::to_string(::getpid()) + '\n' + state;
+#endif
+	service::notify(state);
+}
+
+std::string DropServer::local_address(const std::string& address) const
+{
+	if (worker_index_ < 0 || address.empty()
+	    || LocalEndpoint::is_tcp(address))
+		return address;
+	return address + '.' + std::to_string(worker_index_);
+}
+
+#ifndef _WIN32
+void DropServer::supervise(SshBind& bind, std::atomic<bool>& running)
+{
+	log::info("Starting " + std::to_string(config_.workers) + " workers");
+	auto body = [this, &bind, &running](int index, int retire_fd) {
+		worker_index_ = index;
+		retire_fd_    = retire_fd;
+		serve(bind, running);
+	};
+	WorkerPool pool{config_.workers, std::move(body)};
+	announce_ready();
 
-	log::info("Listening on port " + config_.port);
+	while (running.load(std::memory_order_relaxed)) {
+		// Each worker acts on these itself
+		if (SignalGuard::consume(Signal::toggle_trace))
+			pool.signal(SIGUSR2);
+		if (SignalGuard::consume(Signal::dump_recorder))
+			pool.signal(SIGUSR1);
+		// Reloaded here first, so workers started from now on
+		// come up with the new config rather than the one from
+		// startup; running ones then reload on their own
+		if (SignalGuard::consume(Signal::reload) && reload(bind))
+			pool.signal(SIGHUP);
+		if (SignalGuard::consume(Signal::upgrade) && upgrade(bind))
+			break;
+
+		pool.tend(std::chrono::seconds{1});
+	}
+
+	// After an upgrade the new process is the main one; STOPPING=1 from
+	// here would have systemd stop the service, new process and all
+	log::info("Stopping workers");
+	pool.stop(std::chrono::seconds{config_.drain_timeout});
+}
+#endif
+
+void DropServer::serve(SshBind& bind, std::atomic<bool>& running)
+{
+	const bool worker = worker_index_ >= 0;
+
+	// Not in the constructor: its thread must not exist when workers
+	// are forked
+	const auto gen = generation_.load(std::memory_order_acquire);
+	watch_	       = make_watch_hub(config_, gen->secret_provider);
+
+	const std::string metrics_address =
+			local_address(config_.metrics_socket);
+	std::optional<LocalEndpoint> metrics_endpoint;
+	if (!metrics_address.empty()) {
+		metrics_endpoint.emplace(metrics_address,
+					 [](std::string_view) {
+						 return LocalEndpoint::Reply{
+								 200,
+								 metrics::render()};
+					 });
+		log::info("Metrics on " + metrics_address);
+	}
+
+	listening_.store(true, std::memory_order_relaxed);
+	last_pass_.store(now_ticks(), std::memory_order_relaxed);
+
+	// Load balancer checks land here instead of on the SSH port, where
+	// each one would cost an accept and a failed key exchange
+	const std::string health_address =
+			local_address(config_.health_listen);
+	std::optional<LocalEndpoint> health_endpoint;
+	if (!health_address.empty()) {
+		health_endpoint.emplace(health_address,
+					[this](std::string_view path) {
+						return health(path);
+					});
+		log::info("Health checks on " + health_address);
+	}
+
+	trace::set_enabled(config_.trace_enabled);
+
+	// A worker's parent announces for all of them
+	if (!worker)
+		announce_ready();
+
+	bool upgraded	= false;
+	bool recycled	= false;
+	int  served	= 0;
+	auto idle_since = std::chrono::steady_clock::now();
 
 	std::vector<std::unique_ptr<ActiveConnection>> connections;
+	std::uint64_t next_conn_id =
+			static_cast<std::uint64_t>(std::max(worker_index_, 0))
+					* kWorkerConnIds
+			+ 1;
 
 	while (running.load(std::memory_order_relaxed)) {
+		last_pass_.store(now_ticks(), std::memory_order_relaxed);
 		std::erase_if(connections, [](const auto& c) {
 			return c->done.load(std::memory_order_relaxed);
 		});
 
-		SshSession session;
+		// Clients arriving from here on wait in the socket's backlog,
+		// and systemd starts the server again for them. A watching
+		// session has left its connection thread but is still open.
+		const auto now	    = std::chrono::steady_clock::now();
+		const bool watching = watch_ && watch_->subscribers() > 0;
+		if (!connections.empty() || watching || !may_idle_exit_
+		    || config_.idle_exit == 0)
+			idle_since = now;
+		else if (now - idle_since
+			 >= std::chrono::seconds{config_.idle_exit}) {
+			log::info("Idle for "
+				  + std::to_string(config_.idle_exit)
+				  + " s, exiting");
+			service::notify("STOPPING=1");
+			break;
+		}
+
+		if (SignalGuard::consume(Signal::toggle_trace))
+			handle_trace_toggle(local_address(config_.trace_file));
+		if (SignalGuard::consume(Signal::dump_recorder))
+			recorder::dump();
+		if (SignalGuard::consume(Signal::reload))
+			reload(bind);
+		// In a worker the parent owns upgrades
+		if (SignalGuard::consume(Signal::upgrade) && !worker
+		    && upgrade(bind)) {
+			upgraded = true;
+			break;
+		}
 
-		if (!bind.accept(session, 1000))
+		// A quiet spell still ends the window
+		if (admission_)
+			admission_->tick();
+
+		if (!bind.wait_for_connection(1000))
 			continue;
 
+		sockaddr_storage peer{};
+		const socket_t	 fd = bind.accept_socket(peer);
+		if (fd == SSH_INVALID_SOCKET)
+			continue;
+
+		const std::uint64_t conn_id = next_conn_id++;
+
+		const auto filter = ip_filter_.load(std::memory_order_acquire);
+		const auto* addr  = reinterpret_cast<const sockaddr*>(&peer);
+		if (filter && !filter->permits(addr)) {
+			refuse(fd, conn_id, addr, "filtered");
+			continue;
+		}
+
+		std::uint64_t source = 0;
+		if (limiter_) {
+			source = RateLimiter::source_key(addr);
+			if (!admit(*limiter_, source, fd, conn_id, addr))
+				continue;
+		}
+
+		if (admission_ && !admission_->try_acquire()) {
+			shed(fd, conn_id, addr);
+			continue;
+		}
+
+		// A session that cannot be set up is closed before key
+		// exchange like any refused one, without ending the loop
+		SshSession session;
+		try {
+			trace::Span span{"accept", conn_id};
+			bind.accept_fd(session, fd);
+		} catch (const SshError& e) {
+			if (admission_)
+				admission_->release();
+			log::warn(e.what());
+			recorder::note(conn_id, recorder::Phase::accept,
+				       recorder::Outcome::error, e.os_error());
+			metrics::add(metrics::Counter::connections_rejected);
+			continue;
+		}
+
 		log::info("Connection accepted");
+		recorder::note(conn_id, recorder::Phase::accept,
+			       recorder::Outcome::ok);
+		metrics::add(metrics::Counter::connections_accepted);
+		metrics::add(metrics::Gauge::active_connections, 1);
 
 		auto  conn	= std::make_unique<ActiveConnection>();
 		auto* done_flag = &conn->done;
 		int   timeout	= config_.auth_timeout;
 
-		conn->thread = std::jthread([this, s = std::move(session),
-					     done_flag, timeout]() mutable {
+		// Keeps this generation alive until the connection ends,
+		// whatever reloads happen meanwhile
+		auto gen = generation_.load(std::memory_order_acquire);
+
+		ConnectionOptions options;
+		options.limiter		     = limiter_.get();
+		options.source		     = source;
+		options.prompt_passphrase    = config_.passphrase_prompt;
+		options.secrets		     = gen->secrets.get();
+		options.admission	     = admission_.get();
+		options.session_idle_timeout = config_.session_idle_timeout;
+		options.session_max_requests = config_.session_max_requests;
+		options.watch		     = watch_.get();
+		options.running		     = &running;
+
+		conn->thread = std::jthread([s = std::move(session),
+					     gen = std::move(gen), done_flag,
+					     timeout, conn_id,
+					     options]() mutable {
+			metrics::add(metrics::Gauge::active_threads, 1);
 			try {
+				// Gives the admission slot back after key
+				// exchange, or when it goes
 				ConnectionHandler handler{
-						std::move(s), *authenticator_,
-						*secret_provider_, timeout};
+						std::move(s),
+						*gen->authenticator,
+						*gen->secret_provider, timeout,
+						conn_id, options};
 				handler.run();
 			} catch (const std::exception& e) {
+				recorder::note(conn_id, recorder::Phase::close,
+					       recorder::Outcome::error,
+					       os_error_of(e));
 				log::error(e.what());
 			}
+			metrics::add(metrics::Gauge::active_connections, -1);
+			metrics::add(metrics::Gauge::active_threads, -1);
 			done_flag->store(true, std::memory_order_relaxed);
 		});
 
 		connections.push_back(std::move(conn));
+
+		// Bounds what a long-lived worker can grow to
+		if (worker && config_.worker_max_connections > 0
+		    && ++served >= config_.worker_max_connections) {
+			log::info("Recycling worker "
+				  + std::to_string(worker_index_) + " after "
+				  + std::to_string(served) + " connections");
+			recycled = true;
+			break;
+		}
 	}
 
 	log::info("Server shutting down");
+	// Draining: readiness fails while connections finish
+	listening_.store(false, std::memory_order_relaxed);
+
+#ifndef _WIN32
+	// The parent starts a replacement as soon as it sees this
+	if (retire_fd_ >= 0)
+		::close(retire_fd_);
+#endif
+
+	if (upgraded || recycled) {
+		// Checks and scrapes go to the new process from here on
+		health_endpoint.reset();
+		metrics_endpoint.reset();
+
+		// Watchers and idle sessions would hold on indefinitely
+		const auto deadline =
+				std::chrono::steady_clock::now()
+				+ std::chrono::seconds{config_.drain_timeout};
+		while (!connections.empty()
+		       && std::chrono::steady_clock::now() < deadline) {
+			std::this_thread::sleep_for(
+					std::chrono::milliseconds{100});
+			std::erase_if(connections, [](const auto& c) {
+				return c->done.load(std::memory_order_relaxed);
+			});
+		}
+		if (!connections.empty()) {
+			log::warn("Drain timed out with "
+				  + std::to_string(connections.size())
+				  + " connections open; closing them");
+			log_cpu_summary();
+			log::flush();
+			std::_Exit(0);
+		}
+	}
+
+	connections.clear();
+	log_cpu_summary();
+
+	if (trace::enabled())
+		write_trace(local_address(config_.trace_file));
 }
 
 } // namespace drop
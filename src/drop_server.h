@@ -2,33 +2,107 @@
 #define SSH_DROP_DROP_SERVER_H_
 
 #include <atomic>
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
 
+#include "admission.h"
 #include "authenticator.h"
+#include "ip_filter.h"
+#include "local_endpoint.h"
+#include "rate_limiter.h"
 #include "secret_provider.h"
 #include "server_config.h"
+#include "ssh_types.h"
+#include "watch_hub.h"
 
 namespace drop {
 
+// Replaces the host keys and algorithm lists of a bind that is already
+// serving. All or nothing: on a throw the bind is as it was.
+void reconfigure_bind(SshBind& bind, const ServerConfig& config);
+
 class DropServer {
 public:
+	// Reads and validates the configuration again; throws when it is
+	// unusable.
+	using ConfigLoader = std::function<ServerConfig()>;
+
 	DropServer(ServerConfig			    config,
 		   std::unique_ptr<IAuthenticator>  authenticator,
 		   std::unique_ptr<ISecretProvider> secret_provider);
 
+	// Enables reloading on SIGHUP; without a loader SIGHUP is ignored.
+	void set_config_loader(ConfigLoader loader);
+
+	// Enables handing the listener to a new process on SIGQUIT; without
+	// a command SIGQUIT is ignored.
+	void set_upgrade_command(std::vector<std::string> command);
+
 	void run(std::atomic<bool>& running);
 
+	// Replaces the source-address filter (nullptr admits everyone). Safe
+	// from any thread; applies from the next accepted connection.
+	void set_ip_filter(std::shared_ptr<const IpFilter> filter) noexcept;
+
 private:
 	struct ActiveConnection {
 		std::jthread	  thread;
 		std::atomic<bool> done{false};
 	};
 
-	ServerConfig			 config_;
-	std::unique_ptr<IAuthenticator>	 authenticator_;
-	std::unique_ptr<ISecretProvider> secret_provider_;
+	// What a reload replaces. Each connection holds on to the generation
+	// it was accepted under, so handshakes and deliveries in flight
+	// finish on the old authenticator and secret source.
+	struct Generation {
+		std::unique_ptr<IAuthenticator>	       authenticator;
+		std::shared_ptr<const ISecretProvider> secret_provider;
+		std::unique_ptr<SecretDirectory>       secrets;
+	};
+
+	// /livez and /readyz, from the server's own state only
+	[[nodiscard]] LocalEndpoint::Reply health(std::string_view path) const;
+	// Accept loop only, between connections: the listener stays open.
+	// False when there was nothing to reload or the new config failed.
+	bool reload(SshBind& bind);
+	// Starts the upgrade command on the listener; true once it serves
+	[[nodiscard]] bool upgrade(const SshBind& bind);
+	// Tells the previous process and systemd that the listener is served
+	void announce_ready() const;
+	// The accept loop, in this process or in a worker
+	void serve(SshBind& bind, std::atomic<bool>& running);
+	// Keeps config_.workers workers serving bind until shutdown
+	void supervise(SshBind& bind, std::atomic<bool>& running);
+	// In a worker, address with the worker's index appended, unless it is
+	// TCP, which all workers share
+	[[nodiscard]] std::string
+	local_address(const std::string& address) const;
+
+	ServerConfig					 config_;
+	ConfigLoader					 load_config_;
+	std::vector<std::string>			 upgrade_command_;
+	std::atomic<std::shared_ptr<const Generation>> generation_;
+
+	std::atomic<std::shared_ptr<const IpFilter>> ip_filter_;
+	std::unique_ptr<RateLimiter>		     limiter_;
+	std::unique_ptr<AdmissionController>	     admission_;
+	std::unique_ptr<WatchHub>		     watch_;
+
+	// How run() got the listener
+	bool handed_over_   = false;
+	bool may_idle_exit_ = false;
+	// Set in workers only; the parent sees the pipe close when this one
+	// stops accepting
+	int worker_index_ = -1;
+	int retire_fd_	  = -1;
+
+	// Written by the accept loop, read by health checks
+	std::atomic<bool>			    listening_{false};
+	std::atomic<std::chrono::steady_clock::rep> last_pass_{0};
 };
 
 } // namespace drop
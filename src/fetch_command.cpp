@@ -0,0 +1,710 @@
+#include "fetch_command.h"
+
+#include <iostream>
+
+#ifndef _WIN32
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "secret_provider.h"
+#include "ssh_client.h"
+#include "ssh_lib_guard.h"
+#endif
+
+namespace drop {
+
+#ifdef _WIN32
+
+int run_fetch(int argc, char* argv[])
+{
+	(void)argc;
+	(void)argv;
+	std::cerr << "--fetch is not supported on this platform\n";
+	return 1;
+}
+
+#else
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int kDefaultPort = 22;
+
+// Fetch times remembered per replica, and how many it takes to trust a p95
+constexpr std::size_t kHistorySize = 64;
+constexpr std::size_t kMinSamples  = 8;
+
+// Hedge delay for a replica without enough history
+constexpr auto kFallbackHedge = std::chrono::milliseconds{500};
+
+// Slice of a pending TCP connect, so a losing attempt notices it lost
+constexpr int kConnectSliceMs = 50;
+
+constexpr const char* kUsage =
+		"Usage: ssh-drop --fetch host[:port][,host[:port]...] "
+		"[options]\n"
+		"  --user NAME          SSH user (default $USER)\n"
+		"  --key PATH           private key (default: ssh-agent)\n"
+		"  --known-hosts PATH   known hosts file (default "
+		"~/.ssh/known_hosts)\n"
+		"  --name NAME          named secret instead of the default\n"
+		"  --passphrase-stdin   read the passphrase from stdin\n"
+		"  --connect-timeout S  per replica connect and handshake "
+		"(default 5)\n"
+		"  --timeout S          whole fetch (default 30)\n"
+		"  --hedge-ms MS        fixed hedge delay instead of each "
+		"replica's p95\n"
+		"  --history PATH       latency history, 'none' to disable\n"
+		"                       (default ~/.cache/ssh-drop/latency)\n"
+		"  --timing             JSON timing record on stderr\n";
+
+struct Replica {
+	std::string host;
+	int	    port = kDefaultPort;
+	// host:port, for the history file and output
+	std::string label;
+};
+
+struct FetchOptions {
+	std::vector<Replica>			 replicas;
+	std::string				 user;
+	std::string				 key_path;
+	std::string				 known_hosts;
+	std::string				 name;
+	bool					 passphrase_stdin = false;
+	int					 connect_timeout  = 5;
+	int					 timeout	  = 30;
+	std::optional<std::chrono::milliseconds> hedge;
+	std::string				 history_path;
+	bool					 timing = false;
+};
+
+// One replica's try. Phase times are milliseconds from the attempt's own
+// start, negative until reached; the fetch thread only reads them after
+// joining.
+struct Attempt {
+	enum class State { running, ok, failed, cancelled };
+
+	const Replica* replica	 = nullptr;
+	double	       start_ms	 = 0.0;
+	double	       hedge_ms	 = 0.0;
+	double	       connected = -1.0;
+	double	       handshake = -1.0;
+	double	       authed	 = -1.0;
+	double	       done	 = -1.0;
+	State	       state	 = State::running;
+	std::string    error;
+	std::string    secret;
+
+	// Guarded by Race::mutex: the socket while it is open, so a losing
+	// attempt can be cut short
+	int		  fd = -1;
+	std::atomic<bool> cancel{false};
+
+	std::jthread thread;
+};
+
+struct Race {
+	std::mutex			      mutex;
+	std::condition_variable		      cv;
+	bool				      settled = false;
+	Attempt*			      winner  = nullptr;
+	std::vector<std::unique_ptr<Attempt>> attempts;
+};
+
+double ms_since(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start)
+			.count();
+}
+
+bool all_digits(std::string_view s)
+{
+	return !s.empty() && std::all_of(s.begin(), s.end(), [](char c) {
+		return c >= '0' && c <= '9';
+	});
+}
+
+// "host", "host:port", "[v6]" or "[v6]:port", comma separated
+std::vector<Replica> parse_replicas(std::string_view list)
+{
+	std::vector<Replica> replicas;
+	while (!list.empty()) {
+		const auto	 comma = list.find(',');
+		std::string_view item  = list.substr(0, comma);
+		list.remove_prefix(comma == std::string_view::npos
+						   ? list.size()
+						   : comma + 1);
+
+		std::string_view host = item;
+		std::string_view port;
+		const auto	 colon = item.rfind(':');
+		if (item.starts_with('[')) {
+			const auto close = item.find(']');
+			const bool tail = close != std::string_view::npos
+					  && close + 1 < item.size();
+			if (close == std::string_view::npos
+			    || (tail && colon != close + 1))
+				throw std::runtime_error{"Bad replica: "
+							 + std::string{item}};
+			host = item.substr(1, close - 1);
+			if (tail)
+				port = item.substr(colon + 1);
+		} else if (colon != std::string_view::npos
+			   && item.find(':') == colon) {
+			// One colon is a port; bare IPv6 needs brackets for one
+			host = item.substr(0, colon);
+			port = item.substr(colon + 1);
+		}
+
+		Replica r;
+		r.host = host;
+		if (!port.empty()) {
+			r.port = all_digits(port) && port.size() <= 5
+					 ? std::stoi(std::string{port})
+					 : 0;
+		}
+		if (r.host.empty() || r.port < 1 || r.port > 65535)
+			throw std::runtime_error{"Bad replica: "
+						 + std::string{item}};
+
+		const bool v6 = r.host.find(':') != std::string::npos;
+		r.label = (v6 ? "[" + r.host + "]" : r.host) + ":"
+			  + std::to_string(r.port);
+		replicas.push_back(std::move(r));
+	}
+
+	if (replicas.empty())
+		throw std::runtime_error{"No replicas given"};
+	return replicas;
+}
+
+FetchOptions parse_args(int argc, char* argv[])
+{
+	FetchOptions opts;
+	opts.replicas = parse_replicas(argv[2]);
+	if (const char* user = std::getenv("USER"))
+		opts.user = user;
+	if (const char* home = std::getenv("HOME"))
+		opts.history_path = std::string{home}
+				    + "/.cache/ssh-drop/latency";
+
+	for (int i = 3; i < argc; ++i) {
+		const std::string arg	= argv[i];
+		auto		  value = [&] {
+			if (i + 1 >= argc)
+				throw std::runtime_error{arg
+							 + " needs a value"};
+			return std::string{argv[++i]};
+		};
+
+		if (arg == "--user")
+			opts.user = value();
+		else if (arg == "--key")
+			opts.key_path = value();
+		else if (arg == "--known-hosts")
+			opts.known_hosts = value();
+		else if (arg == "--name")
+			opts.name = value();
+		else if (arg == "--passphrase-stdin")
+			opts.passphrase_stdin = true;
+		else if (arg == "--connect-timeout")
+			opts.connect_timeout = std::stoi(value());
+		else if (arg == "--timeout")
+			opts.timeout = std::stoi(value());
+		else if (arg == "--hedge-ms")
+			opts.hedge = std::chrono::milliseconds{
+					std::stoi(value())};
+		else if (arg == "--history")
+			opts.history_path = value();
+		else if (arg == "--timing")
+			opts.timing = true;
+		else
+			throw std::runtime_error{"Unknown option: " + arg};
+	}
+
+	if (opts.history_path == "none")
+		opts.history_path.clear();
+	if (opts.connect_timeout < 1 || opts.timeout < 1)
+		throw std::runtime_error{"Timeouts must be >= 1"};
+	if (opts.hedge && opts.hedge->count() < 0)
+		throw std::runtime_error{"--hedge-ms must be >= 0"};
+	if (!opts.name.empty() && !SecretDirectory::valid_name(opts.name))
+		throw std::runtime_error{"Invalid secret name: " + opts.name};
+	return opts;
+}
+
+// Recent fetch times per replica, kept between runs in a small text file:
+// one line per replica, its label and then milliseconds, oldest first. A
+// missing or unreadable file only means no history yet.
+class LatencyHistory {
+public:
+	explicit LatencyHistory(std::filesystem::path path)
+	    : path_{std::move(path)}
+	{
+		if (path_.empty())
+			return;
+
+		std::ifstream in{path_};
+		std::string   line;
+		while (std::getline(in, line)) {
+			std::istringstream ss{line};
+			std::string	   label;
+			double		   ms = 0.0;
+			if (!(ss >> label))
+				continue;
+			auto& samples = samples_[label];
+			while (ss >> ms && samples.size() < kHistorySize)
+				samples.push_back(ms);
+		}
+	}
+
+	[[nodiscard]] std::optional<std::chrono::milliseconds>
+	p95(const std::string& label) const
+	{
+		const auto it = samples_.find(label);
+		if (it == samples_.end() || it->second.size() < kMinSamples)
+			return std::nullopt;
+
+		std::vector<double> sorted{it->second.begin(),
+					   it->second.end()};
+		const auto	    n	 = static_cast<double>(sorted.size());
+		const auto	    rank = static_cast<std::size_t>(
+				       std::ceil(0.95 * n) - 1.0);
+		std::nth_element(sorted.begin(), sorted.begin() + rank,
+				 sorted.end());
+		const auto ms = std::ceil(sorted[rank]);
+		return std::chrono::milliseconds{static_cast<long long>(ms)};
+	}
+
+	void record(const std::string& label, double ms)
+	{
+		auto& samples = samples_[label];
+		samples.push_back(ms);
+		if (samples.size() > kHistorySize)
+			samples.pop_front();
+	}
+
+	// Best effort. Written aside and renamed into place, so a concurrent
+	// fetch never reads half a file.
+	void save() const
+	{
+		if (path_.empty())
+			return;
+
+		std::error_code ec;
+		std::filesystem::create_directories(path_.parent_path(), ec);
+		auto tmp = path_;
+		tmp += ".tmp." + std::to_string(::getpid());
+		{
+			std::ofstream out{tmp};
+			for (const auto& [label, samples] : samples_) {
+				out << label;
+				for (double ms : samples)
+					out << ' ' << ms;
+				out << '\n';
+			}
+			if (!out) {
+				std::filesystem::remove(tmp, ec);
+				return;
+			}
+		}
+		std::filesystem::rename(tmp, path_, ec);
+	}
+
+private:
+	std::filesystem::path			    path_;
+	std::map<std::string, std::deque<double>> samples_;
+};
+
+// Non-blocking connect, bounded by timeout_ms and given up early on
+// cancel. The socket comes back blocking, as libssh expects.
+int tcp_connect(const Replica& r, int timeout_ms,
+		const std::atomic<bool>& cancel)
+{
+	addrinfo hints{};
+	hints.ai_family	  = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo*	  res  = nullptr;
+	const std::string port = std::to_string(r.port);
+	if (const int rc = ::getaddrinfo(r.host.c_str(), port.c_str(), &hints,
+					 &res);
+	    rc != 0)
+		throw std::runtime_error{"Could not resolve " + r.host + ": "
+					 + ::gai_strerror(rc)};
+
+	std::string err = "no address";
+	int	    fd	= -1;
+	for (auto* ai = res; ai && fd < 0; ai = ai->ai_next) {
+		fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+			      ai->ai_protocol);
+		if (fd < 0)
+			continue;
+
+		const int flags = ::fcntl(fd, F_GETFL);
+		(void)::fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+		int rc = ::connect(fd, ai->ai_addr, ai->ai_addrlen);
+		if (rc != 0 && errno == EINPROGRESS) {
+			int soerr = ETIMEDOUT;
+			for (int waited = 0; waited < timeout_ms && !cancel;
+			     waited += kConnectSliceMs) {
+				pollfd	  pfd{fd, POLLOUT, 0};
+				const int ready = ::poll(&pfd, 1,
+							 kConnectSliceMs);
+				if (ready == 0)
+					continue;
+				socklen_t len = sizeof(soerr);
+				if (ready < 0)
+					soerr = errno;
+				else
+					(void)::getsockopt(fd, SOL_SOCKET,
+							   SO_ERROR, &soerr,
+							   &len);
+				break;
+			}
+			if (cancel)
+				soerr = ECANCELED;
+			rc    = soerr == 0 ? 0 : -1;
+			errno = soerr;
+		}
+
+		if (rc == 0) {
+			(void)::fcntl(fd, F_SETFL, flags);
+			break;
+		}
+		err = std::strerror(errno);
+		::close(fd);
+		fd = -1;
+	}
+	::freeaddrinfo(res);
+
+	if (fd < 0)
+		throw std::runtime_error{"Connect to " + r.label
+					 + " failed: " + err};
+	return fd;
+}
+
+// The key from --key, or else the agent's. A server with
+// passphrase_prompt set then asks for the passphrase over
+// keyboard-interactive; true when it was sent that way.
+bool authenticate(SshClient& client, const FetchOptions& opts,
+		  const std::string& passphrase)
+{
+	bool accepted = false;
+	if (!opts.key_path.empty()) {
+		const auto key = load_private_key(opts.key_path);
+		accepted       = client.auth_pubkey(key.get());
+	} else {
+		accepted = client.auth_agent();
+	}
+	if (!accepted)
+		throw std::runtime_error{"Authentication denied"};
+	if (client.authenticated())
+		return false;
+
+	if (passphrase.empty())
+		throw std::runtime_error{"Server asks for more than a key "
+					 "(try --passphrase-stdin)"};
+	if (!client.auth_kbdint(passphrase) || !client.authenticated())
+		throw std::runtime_error{"Passphrase denied"};
+	return true;
+}
+
+// Called with the race lock held
+void cut_losers(Race& race)
+{
+	for (auto& a : race.attempts) {
+		if (a->state != Attempt::State::running)
+			continue;
+		a->cancel = true;
+		if (a->fd >= 0)
+			(void)::shutdown(a->fd, SHUT_RDWR);
+	}
+}
+
+void run_attempt(Race& race, Attempt& a, const FetchOptions& opts,
+		 const std::string& passphrase)
+{
+	const auto  start = Clock::now();
+	SshClient   client;
+	std::string secret;
+	std::string error;
+	bool	    ok = false;
+
+	try {
+		const auto& r  = *a.replica;
+		const int   fd = tcp_connect(r, opts.connect_timeout * 1000,
+						 a.cancel);
+		{
+			std::scoped_lock lock{race.mutex};
+			a.fd = fd;
+			if (race.settled)
+				(void)::shutdown(fd, SHUT_RDWR);
+		}
+		a.connected = ms_since(start);
+
+		// The session owns the socket from here on
+		client.connect_fd(fd, opts.user, opts.connect_timeout, r.host,
+				  r.port);
+		client.verify_host_key(opts.known_hosts);
+		a.handshake = ms_since(start);
+
+		const bool sent = authenticate(client, opts, passphrase);
+		a.authed	= ms_since(start);
+
+		std::string command = "get";
+		if (!opts.name.empty())
+			command += ' ' + opts.name;
+		secret = client.fetch_exec(command, sent ? "" : passphrase,
+					   opts.timeout * 1000);
+		ok     = true;
+	} catch (const std::exception& e) {
+		error = e.what();
+	}
+	a.done = ms_since(start);
+
+	// Before the client closes the socket, so nobody shuts down a
+	// descriptor number that has been reused
+	std::scoped_lock lock{race.mutex};
+	a.fd = -1;
+	if (ok) {
+		a.state	 = Attempt::State::ok;
+		a.secret = std::move(secret);
+		if (!race.settled) {
+			race.settled = true;
+			race.winner  = &a;
+			cut_losers(race);
+		}
+	} else {
+		a.state = race.settled ? Attempt::State::cancelled
+				       : Attempt::State::failed;
+		a.error = std::move(error);
+	}
+	race.cv.notify_all();
+}
+
+std::string json_string(std::string_view s)
+{
+	std::string out = "\"";
+	for (char c : s) {
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += c;
+		} else if (static_cast<unsigned char>(c) < 0x20) {
+			char buf[8];
+			std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+			out += buf;
+		} else {
+			out += c;
+		}
+	}
+	return out + '"';
+}
+
+std::string json_ms(double ms)
+{
+	if (ms < 0.0)
+		return "null";
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), "%.3f", ms);
+	return buf;
+}
+
+const char* state_name(Attempt::State state)
+{
+	switch (state) {
+	case Attempt::State::running:
+		return "running";
+	case Attempt::State::ok:
+		return "ok";
+	case Attempt::State::failed:
+		return "failed";
+	case Attempt::State::cancelled:
+		return "cancelled";
+	}
+	return "unknown";
+}
+
+// One line: the outcome, then every attempt with its phases in
+// milliseconds from that attempt's start
+void print_timing(const Race& race, double total_ms)
+{
+	std::string out = "{\"ok\":";
+	out += race.winner ? "true" : "false";
+	out += ",\"replica\":";
+	out += race.winner ? json_string(race.winner->replica->label) : "null";
+	out += ",\"total_ms\":" + json_ms(total_ms);
+	out += ",\"hedged\":";
+	out += race.attempts.size() > 1 ? "true" : "false";
+	out += ",\"attempts\":[";
+	for (std::size_t i = 0; i < race.attempts.size(); ++i) {
+		const auto& a = *race.attempts[i];
+		if (i > 0)
+			out += ',';
+		out += "{\"replica\":" + json_string(a.replica->label);
+		out += ",\"start_ms\":" + json_ms(a.start_ms);
+		out += ",\"hedge_after_ms\":" + json_ms(a.hedge_ms);
+		out += ",\"connect_ms\":" + json_ms(a.connected);
+		out += ",\"handshake_ms\":" + json_ms(a.handshake);
+		out += ",\"auth_ms\":" + json_ms(a.authed);
+		out += ",\"end_ms\":" + json_ms(a.done);
+		out += ",\"result\":";
+		out += json_string(state_name(a.state));
+		if (!a.error.empty())
+			out += ",\"error\":" + json_string(a.error);
+		out += '}';
+	}
+	out += "]}\n";
+	std::cerr << out;
+}
+
+int fetch(const FetchOptions& opts)
+{
+	std::string passphrase;
+	if (opts.passphrase_stdin && !std::getline(std::cin, passphrase))
+		throw std::runtime_error{"No passphrase on stdin"};
+	if (passphrase.ends_with('\r'))
+		passphrase.pop_back();
+
+	LatencyHistory history{opts.history_path};
+	SshLibGuard    lib;
+	Race	       race;
+
+	const auto  begin    = Clock::now();
+	const auto  deadline = begin + std::chrono::seconds{opts.timeout};
+	auto	    hedge_at = deadline;
+	std::size_t next     = 0;
+
+	// Called with the race lock held: the new thread waits for it
+	auto launch = [&] {
+		const auto& replica = opts.replicas[next++];
+		const auto  p95	    = history.p95(replica.label);
+		const auto  delay   = opts.hedge.value_or(
+				   p95.value_or(kFallbackHedge));
+		hedge_at = Clock::now() + delay;
+
+		auto a	    = std::make_unique<Attempt>();
+		a->replica  = &replica;
+		a->start_ms = ms_since(begin);
+		a->hedge_ms = static_cast<double>(delay.count());
+		auto* raw   = a.get();
+		race.attempts.push_back(std::move(a));
+		raw->thread = std::jthread{[&race, raw, &opts, &passphrase] {
+			run_attempt(race, *raw, opts, passphrase);
+		}};
+	};
+
+	std::unique_lock lock{race.mutex};
+	launch();
+	while (!race.settled && Clock::now() < deadline) {
+		const bool more	      = next < opts.replicas.size();
+		const bool all_failed = std::all_of(
+				race.attempts.begin(), race.attempts.end(),
+				[](const auto& a) {
+					return a->state
+					       == Attempt::State::failed;
+				});
+
+		// The next replica goes as soon as the last one is overdue
+		// for its p95, or at once when everything so far has failed
+		if (more && (all_failed || Clock::now() >= hedge_at)) {
+			launch();
+			continue;
+		}
+		if (all_failed)
+			break;
+		race.cv.wait_until(lock, more ? std::min(hedge_at, deadline)
+					      : deadline);
+	}
+	const bool timed_out = !race.settled && Clock::now() >= deadline;
+	race.settled	     = true;
+	cut_losers(race);
+	lock.unlock();
+
+	for (auto& a : race.attempts)
+		a->thread.join();
+	const double total_ms = ms_since(begin);
+
+	for (const auto& a : race.attempts)
+		if (a->state == Attempt::State::ok)
+			history.record(a->replica->label, a->done);
+	history.save();
+
+	if (opts.timing)
+		print_timing(race, total_ms);
+
+	if (!race.winner) {
+		for (const auto& a : race.attempts)
+			if (!a->error.empty())
+				std::cerr << a->replica->label << ": "
+					  << a->error << '\n';
+		if (timed_out)
+			std::cerr << "Timed out after " << opts.timeout
+				  << "s\n";
+		return 1;
+	}
+
+	std::cout.write(race.winner->secret.data(),
+			static_cast<std::streamsize>(
+					race.winner->secret.size()));
+	std::cout.flush();
+	return std::cout ? 0 : 1;
+}
+
+} // namespace
+
+int run_fetch(int argc, char* argv[])
+{
+	// Losing attempts have their sockets shut down under them
+	std::signal(SIGPIPE, SIG_IGN);
+
+	FetchOptions opts;
+	try {
+		opts = parse_args(argc, argv);
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << '\n' << kUsage;
+		return 1;
+	}
+
+	try {
+		return fetch(opts);
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << '\n';
+		return 1;
+	}
+}
+
+#endif
+
+} // namespace drop
@@ -0,0 +1,12 @@
+#ifndef SSH_DROP_FETCH_COMMAND_H_
+#define SSH_DROP_FETCH_COMMAND_H_
+
+namespace drop {
+
+// ssh-drop --fetch host[:port][,host[:port]...] [options]; argv[2] is the
+// replica list. Prints the secret on stdout.
+int run_fetch(int argc, char* argv[]);
+
+} // namespace drop
+
+#endif // SSH_DROP_FETCH_COMMAND_H_
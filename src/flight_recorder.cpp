@@ -0,0 +1,166 @@
+#include "flight_recorder.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "log.h"
+
+namespace drop::recorder {
+
+namespace {
+
+// Each slot is guarded by its own sequence number: odd while a writer is
+// filling it in, 2 * (index + 1) once complete. Readers discard slots whose
+// sequence changed underneath them.
+struct Slot {
+	std::atomic<std::uint64_t> seq{0};
+	std::atomic<std::uint64_t> time_ns{0};
+	std::atomic<std::uint64_t> conn_id{0};
+	std::atomic<std::uint64_t> packed{0};
+};
+
+struct Entry {
+	std::uint64_t index;
+	std::uint64_t time_ns;
+	std::uint64_t conn_id;
+	std::uint64_t packed;
+};
+
+std::array<Slot, kCapacity> g_ring;
+std::atomic<std::uint64_t>  g_head{0};
+
+const char* phase_name(Phase phase)
+{
+	switch (phase) {
+	case Phase::accept:
+		return "accept";
+	case Phase::kex:
+		return "kex";
+	case Phase::auth:
+		return "auth";
+	case Phase::channel:
+		return "channel";
+	case Phase::passphrase:
+		return "passphrase";
+	case Phase::decrypt:
+		return "decrypt";
+	case Phase::write:
+		return "write";
+	case Phase::close:
+		return "close";
+	}
+	return "?";
+}
+
+const char* outcome_name(Outcome outcome)
+{
+	switch (outcome) {
+	case Outcome::ok:
+		return "ok";
+	case Outcome::denied:
+		return "denied";
+	case Outcome::timeout:
+		return "timeout";
+	case Outcome::error:
+		return "error";
+	}
+	return "?";
+}
+
+std::string format_entry(const Entry& e)
+{
+	const auto phase   = static_cast<Phase>(e.packed & 0xff);
+	const auto outcome = static_cast<Outcome>((e.packed >> 8) & 0xff);
+	const auto err	   = static_cast<int>(e.packed >> 32);
+
+	const auto time =
+			static_cast<std::time_t>(e.time_ns / 1'000'000'000);
+	std::tm tm_buf{};
+#ifdef _WIN32
+	localtime_s(&tm_buf, &time);
+#else
+	localtime_r(&time, &tm_buf);
+#endif
+	char ts[32];
+	std::strftime(ts, sizeof(ts), "%H:%M:%S", &tm_buf);
+
+	char buf[160];
+	std::snprintf(buf, sizeof(buf),
+		      "recorder: %s.%06llu conn=%llu %s %s errno=%d", ts,
+		      static_cast<unsigned long long>(
+				      (e.time_ns / 1000) % 1'000'000),
+		      static_cast<unsigned long long>(e.conn_id),
+		      phase_name(phase), outcome_name(outcome), err);
+	return buf;
+}
+
+} // namespace
+
+void note(std::uint64_t conn_id, Phase phase, Outcome outcome,
+	  int err) noexcept
+{
+	using std::chrono::nanoseconds;
+
+	const auto index = g_head.fetch_add(1, std::memory_order_relaxed);
+	Slot&	   slot	 = g_ring[index % kCapacity];
+
+	const auto now = std::chrono::duration_cast<nanoseconds>(
+			std::chrono::system_clock::now().time_since_epoch());
+
+	slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.time_ns.store(static_cast<std::uint64_t>(now.count()),
+			   std::memory_order_relaxed);
+	slot.conn_id.store(conn_id, std::memory_order_relaxed);
+	slot.packed.store(static_cast<std::uint64_t>(phase)
+				  | (static_cast<std::uint64_t>(outcome) << 8)
+				  | (static_cast<std::uint64_t>(
+					     static_cast<std::uint32_t>(err))
+				     << 32),
+			  std::memory_order_relaxed);
+
+	slot.seq.store(2 * index + 2, std::memory_order_release);
+}
+
+void dump()
+{
+	std::vector<Entry> entries;
+	entries.reserve(kCapacity);
+
+	for (const auto& slot : g_ring) {
+		const std::uint64_t before =
+				slot.seq.load(std::memory_order_acquire);
+		if (before == 0 || (before & 1) != 0)
+			continue;
+
+		Entry e{before / 2 - 1,
+			slot.time_ns.load(std::memory_order_relaxed),
+			slot.conn_id.load(std::memory_order_relaxed),
+			slot.packed.load(std::memory_order_relaxed)};
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.seq.load(std::memory_order_relaxed) != before)
+			continue;
+
+		entries.push_back(e);
+	}
+
+	std::sort(entries.begin(), entries.end(),
+		  [](const Entry& a, const Entry& b) {
+			  return a.index < b.index;
+		  });
+
+	log::warn("recorder: dumping " + std::to_string(entries.size())
+		  + " events");
+	for (const auto& e : entries)
+		log::warn(format_entry(e));
+}
+
+} // namespace drop::recorder
@@ -0,0 +1,39 @@
+#ifndef SSH_DROP_FLIGHT_RECORDER_H_
+#define SSH_DROP_FLIGHT_RECORDER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace drop::recorder {
+
+enum class Phase {
+	accept,
+	kex,
+	auth,
+	channel,
+	passphrase,
+	decrypt,
+	write,
+	close
+};
+
+enum class Outcome {
+	ok,
+	denied,
+	timeout,
+	error
+};
+
+// Number of most recent events kept in memory.
+constexpr std::size_t kCapacity = 8192;
+
+// Lock-free and allocation-free; safe to call on every connection event.
+void note(std::uint64_t conn_id, Phase phase, Outcome outcome,
+	  int err = 0) noexcept;
+
+// Writes the retained events, oldest first, to the log.
+void dump();
+
+} // namespace drop::recorder
+
+#endif // SSH_DROP_FLIGHT_RECORDER_H_
@@ -0,0 +1,214 @@
+#include "handoff.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+#include "log.h"
+
+namespace drop::handoff {
+
+namespace {
+
+constexpr const char* kListenFdVar = "SSH_DROP_LISTEN_FD";
+constexpr const char* kReadyFdVar  = "SSH_DROP_READY_FD";
+
+// Where the new process finds them
+constexpr int kListenFd = 3;
+constexpr int kReadyFd	= 4;
+
+// Descriptor lookups below use the first free number from here, clear of
+// the two targets above
+constexpr int kScratchFd = 10;
+
+#ifndef _WIN32
+std::optional<int> take_fd(const char* var)
+{
+	const char* value = std::getenv(var);
+	if (!value)
+		return std::nullopt;
+
+	char*	   end = nullptr;
+	const long fd  = std::strtol(value, &end, 10);
+	::unsetenv(var);
+	if (*end != '\0' || fd < 0
+	    || ::fcntl(static_cast<int>(fd), F_GETFD) < 0)
+		throw std::runtime_error{std::string{var}
+					 + " is not an open descriptor"};
+
+	// Not for any process this one starts later
+	(void)::fcntl(static_cast<int>(fd), F_SETFD, FD_CLOEXEC);
+	return static_cast<int>(fd);
+}
+
+// Everything but the two handed-over descriptors; the new process must
+// not keep client connections of this one open
+void close_from(int first) noexcept
+{
+#ifdef SYS_close_range
+	if (::syscall(SYS_close_range, first, ~0U, 0) == 0)
+		return;
+#endif
+	rlimit lim{};
+	const int max = ::getrlimit(RLIMIT_NOFILE, &lim) == 0
+				&& lim.rlim_cur < 65536
+			? static_cast<int>(lim.rlim_cur)
+			: 65536;
+	for (int fd = first; fd < max; ++fd)
+		::close(fd);
+}
+#endif
+
+} // namespace
+
+#ifdef _WIN32
+
+std::vector<std::string> self_command(int argc, char* argv[])
+{
+	return {argv, argv + argc};
+}
+
+std::optional<socket_t> inherited_listener()
+{
+	return std::nullopt;
+}
+
+void ready()
+{
+}
+
+std::optional<int> spawn(const std::vector<std::string>& command,
+			 socket_t listener, std::chrono::milliseconds timeout)
+{
+	(void)command;
+	(void)listener;
+	(void)timeout;
+	log::warn("Listener handoff is not supported on this platform");
+	return std::nullopt;
+}
+
+#else
+
+std::vector<std::string> self_command(int argc, char* argv[])
+{
+	std::vector<std::string> command{argv, argv + argc};
+
+	// Once the binary is replaced, /proc/self/exe names the deleted file;
+	// its path as of now names the new one
+	std::error_code ec;
+	auto		exe = std::filesystem::canonical("/proc/self/exe", ec);
+	if (ec)
+		exe = std::filesystem::absolute(argv[0], ec);
+	if (!ec)
+		command.front() = exe.string();
+	return command;
+}
+
+std::optional<socket_t> inherited_listener()
+{
+	return take_fd(kListenFdVar);
+}
+
+void ready()
+{
+	const auto fd = take_fd(kReadyFdVar);
+	if (!fd)
+		return;
+	const char byte = 1;
+	(void)::write(*fd, &byte, 1);
+	::close(*fd);
+}
+
+std::optional<int> spawn(const std::vector<std::string>& command,
+			 socket_t listener, std::chrono::milliseconds timeout)
+{
+	int pipe_fds[2];
+	if (::pipe2(pipe_fds, O_CLOEXEC) != 0)
+		throw std::system_error{errno, std::generic_category(),
+					"pipe2"};
+	const int listen_copy = ::fcntl(listener, F_DUPFD_CLOEXEC, kScratchFd);
+	const int ready_copy  = ::fcntl(pipe_fds[1], F_DUPFD_CLOEXEC,
+					kScratchFd);
+	::close(pipe_fds[1]);
+
+	// Built before fork(): in the child of a threaded process only
+	// async-signal-safe calls are allowed
+	std::vector<std::string> env;
+	for (char** e = environ; *e; ++e) {
+		const std::string_view var{*e};
+		if (!var.starts_with(std::string{kListenFdVar} + '=')
+		    && !var.starts_with(std::string{kReadyFdVar} + '='))
+			env.emplace_back(var);
+	}
+	env.push_back(std::string{kListenFdVar} + '='
+		      + std::to_string(kListenFd));
+	env.push_back(std::string{kReadyFdVar} + '='
+		      + std::to_string(kReadyFd));
+
+	std::vector<char*> argv;
+	for (const auto& arg : command)
+		argv.push_back(const_cast<char*>(arg.c_str()));
+	argv.push_back(nullptr);
+	std::vector<char*> envp;
+	for (auto& var : env)
+		envp.push_back(var.data());
+	envp.push_back(nullptr);
+
+	const pid_t pid = listen_copy < 0 || ready_copy < 0 ? -1 : ::fork();
+	if (pid == 0) {
+		// dup2() leaves the targets open across exec
+		if (::dup2(listen_copy, kListenFd) < 0
+		    || ::dup2(ready_copy, kReadyFd) < 0)
+			::_exit(127);
+		close_from(kReadyFd + 1);
+		::execve(argv[0], argv.data(), envp.data());
+		::_exit(127);
+	}
+
+	const int err = errno;
+	if (listen_copy >= 0)
+		::close(listen_copy);
+	if (ready_copy >= 0)
+		::close(ready_copy);
+	if (pid < 0) {
+		::close(pipe_fds[0]);
+		throw std::system_error{err, std::generic_category(),
+					"Could not start " + command.front()};
+	}
+
+	// EOF means the new process exited, or failed to exec, before it
+	// got as far as serving
+	pollfd	   pfd{pipe_fds[0], POLLIN, 0};
+	char	   byte    = 0;
+	const int  wait_ms = static_cast<int>(timeout.count());
+	const bool ok	   = ::poll(&pfd, 1, wait_ms) == 1
+			&& ::read(pipe_fds[0], &byte, 1) == 1;
+	::close(pipe_fds[0]);
+	if (ok)
+		return pid;
+
+	// It never accepted anything, so nothing is lost
+	::kill(pid, SIGKILL);
+	(void)::waitpid(pid, nullptr, 0);
+	return std::nullopt;
+}
+
+#endif
+
+} // namespace drop::handoff
@@ -0,0 +1,40 @@
+#ifndef SSH_DROP_HANDOFF_H_
+#define SSH_DROP_HANDOFF_H_
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <libssh/libssh.h>
+
+namespace drop::handoff {
+
+// Binary upgrade without closing the listener. The running server starts
+// its replacement with the listening socket inherited as fd 3 and a pipe
+// as fd 4; the new process takes the socket over, writes one byte to the
+// pipe once it is about to accept, and the old one stops accepting and
+// drains. Nothing is ever refused: both hold the same socket throughout.
+
+// The command that starts this program again, taken at startup. The binary
+// path is resolved now, so an upgrade runs whatever has been installed
+// there since.
+[[nodiscard]] std::vector<std::string> self_command(int argc, char* argv[]);
+
+// The listening socket handed over by the previous process, if any.
+// Consumes it: a later upgrade hands it on afresh.
+[[nodiscard]] std::optional<socket_t> inherited_listener();
+
+// Tells the previous process, if there is one, that this one is serving.
+void ready();
+
+// Starts command with listener inherited and waits up to timeout for it
+// to call ready(). Returns its pid; on failure the new process is killed
+// and nullopt returned, and the caller carries on serving.
+[[nodiscard]] std::optional<int>
+spawn(const std::vector<std::string>& command, socket_t listener,
+      std::chrono::milliseconds timeout);
+
+} // namespace drop::handoff
+
+#endif // SSH_DROP_HANDOFF_H_
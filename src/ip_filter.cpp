@@ -0,0 +1,164 @@
+#include "ip_filter.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+namespace drop {
+
+namespace {
+
+constexpr std::uint8_t kAllow = 1;
+constexpr std::uint8_t kDeny  = 2;
+
+int bit_at(const std::uint8_t* addr, int i) noexcept
+{
+	return (addr[i / 8] >> (7 - i % 8)) & 1;
+}
+
+// Length of "/len", or -1 when it is not a plain number in [0, max]
+int parse_prefix_len(const std::string& s, int max)
+{
+	if (s.empty() || s.size() > 3)
+		return -1;
+	int len = 0;
+	for (char c : s) {
+		if (c < '0' || c > '9')
+			return -1;
+		len = len * 10 + (c - '0');
+	}
+	return len <= max ? len : -1;
+}
+
+} // namespace
+
+IpFilter::Trie::Trie()
+    : nodes_(1)
+{
+}
+
+void IpFilter::Trie::insert(const std::uint8_t* addr, int prefix_len,
+			    std::uint8_t mark)
+{
+	std::uint32_t node = 0;
+	for (int i = 0; i < prefix_len; ++i) {
+		auto& next = nodes_[node].next[bit_at(addr, i)];
+		if (next == 0) {
+			next = static_cast<std::uint32_t>(nodes_.size());
+			nodes_.emplace_back();
+		}
+		node = nodes_[node].next[bit_at(addr, i)];
+	}
+	nodes_[node].marks |= mark;
+}
+
+std::uint8_t IpFilter::Trie::match(const std::uint8_t* addr,
+				   int bits) const noexcept
+{
+	std::uint32_t node  = 0;
+	std::uint8_t  marks = nodes_[0].marks;
+	for (int i = 0; i < bits; ++i) {
+		node = nodes_[node].next[bit_at(addr, i)];
+		if (node == 0)
+			break;
+		marks |= nodes_[node].marks;
+	}
+	return marks;
+}
+
+IpFilter::IpFilter(const std::vector<std::string>& allow,
+		   const std::vector<std::string>& deny)
+{
+	for (const auto& entry : allow)
+		add(entry, kAllow);
+	for (const auto& entry : deny)
+		add(entry, kDeny);
+	has_allow_ = !allow.empty();
+}
+
+void IpFilter::add(const std::string& entry, std::uint8_t mark)
+{
+	const auto  slash = entry.find('/');
+	const auto  host  = entry.substr(0, slash);
+	const char* list  = mark == kAllow ? "allow_from" : "deny_from";
+
+	std::uint8_t addr[16];
+	int	     max_len = 0;
+	Trie*	     trie    = nullptr;
+	if (inet_pton(AF_INET, host.c_str(), addr) == 1) {
+		max_len = 32;
+		trie	= &v4_;
+	} else if (inet_pton(AF_INET6, host.c_str(), addr) == 1) {
+		max_len = 128;
+		trie	= &v6_;
+	} else {
+		throw std::runtime_error{std::string{"Invalid address in "}
+					 + list + ": " + entry};
+	}
+
+	int len = max_len;
+	if (slash != std::string::npos)
+		len = parse_prefix_len(entry.substr(slash + 1), max_len);
+	if (len < 0)
+		throw std::runtime_error{std::string{"Invalid prefix in "}
+					 + list + ": " + entry};
+
+	trie->insert(addr, len, mark);
+}
+
+bool IpFilter::decide(std::uint8_t marks) const noexcept
+{
+	if (marks & kDeny)
+		return false;
+	return !has_allow_ || (marks & kAllow);
+}
+
+bool IpFilter::permits(const sockaddr* peer) const noexcept
+{
+	if (peer->sa_family == AF_INET) {
+		const auto* in	 = reinterpret_cast<const sockaddr_in*>(peer);
+		const auto* addr = reinterpret_cast<const std::uint8_t*>(
+				&in->sin_addr);
+		return decide(v4_.match(addr, 32));
+	}
+
+	if (peer->sa_family == AF_INET6) {
+		const auto* in6 = reinterpret_cast<const sockaddr_in6*>(peer);
+		const auto* addr = reinterpret_cast<const std::uint8_t*>(
+				&in6->sin6_addr);
+
+		// ::ffff:a.b.c.d from a dual-stack listener
+		static constexpr std::uint8_t kMapped[12] = {
+				0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+		if (std::memcmp(addr, kMapped, sizeof(kMapped)) == 0)
+			return decide(v4_.match(addr + 12, 32));
+		return decide(v6_.match(addr, 128));
+	}
+
+	return false;
+}
+
+std::string format_address(const sockaddr* peer)
+{
+	char buf[INET6_ADDRSTRLEN] = "?";
+	if (peer->sa_family == AF_INET)
+		inet_ntop(AF_INET,
+			  &reinterpret_cast<const sockaddr_in*>(peer)->sin_addr,
+			  buf, sizeof(buf));
+	else if (peer->sa_family == AF_INET6)
+		inet_ntop(AF_INET6,
+			  &reinterpret_cast<const sockaddr_in6*>(peer)
+					   ->sin6_addr,
+			  buf, sizeof(buf));
+	return buf;
+}
+
+} // namespace drop
@@ -0,0 +1,65 @@
+#ifndef SSH_DROP_IP_FILTER_H_
+#define SSH_DROP_IP_FILTER_H_
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct sockaddr;
+
+namespace drop {
+
+// Source-address filter built from allow_from / deny_from CIDR lists and
+// checked on the raw peer address before any libssh state exists. A deny
+// match always wins; when the allow list is non-empty, anything not on it
+// is refused too.
+class IpFilter {
+public:
+	// Entries are "addr" or "addr/len", IPv4 or IPv6; throws
+	// std::runtime_error on a malformed one.
+	IpFilter(const std::vector<std::string>& allow,
+		 const std::vector<std::string>& deny);
+
+	// IPv4-mapped IPv6 peers are matched against the IPv4 rules. Unknown
+	// address families are refused.
+	[[nodiscard]] bool permits(const sockaddr* peer) const noexcept;
+
+private:
+	// Binary trie over address bits, one per family, stored as a flat
+	// node array; child index 0 means "none" since the root is never a
+	// child.
+	class Trie {
+	public:
+		Trie();
+
+		void insert(const std::uint8_t* addr, int prefix_len,
+			    std::uint8_t mark);
+
+		// Union of the marks on every prefix of addr
+		[[nodiscard]] std::uint8_t match(const std::uint8_t* addr,
+						 int bits) const noexcept;
+
+	private:
+		struct Node {
+			std::array<std::uint32_t, 2> next{};
+			std::uint8_t		     marks = 0;
+		};
+
+		std::vector<Node> nodes_;
+	};
+
+	void add(const std::string& entry, std::uint8_t mark);
+	[[nodiscard]] bool decide(std::uint8_t marks) const noexcept;
+
+	Trie v4_;
+	Trie v6_;
+	bool has_allow_ = false;
+};
+
+// "203.0.113.7" / "2001:db8::1" for logging; "?" for other families.
+[[nodiscard]] std::string format_address(const sockaddr* peer);
+
+} // namespace drop
+
+#endif // SSH_DROP_IP_FILTER_H_
@@ -0,0 +1,312 @@
+#include "local_endpoint.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#ifndef _WIN32
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "log.h"
+
+namespace drop {
+
+namespace {
+
+// Clients are served one at a time, so a slow one must not hold up the
+// next health probe for longer than this
+constexpr auto kClientDeadline = std::chrono::seconds{1};
+
+const char* status_text(int status)
+{
+	switch (status) {
+	case 200:
+		return "OK";
+	case 404:
+		return "Not Found";
+	case 503:
+		return "Service Unavailable";
+	}
+	return "Error";
+}
+
+// "host:port", "[v6]:port" or ":port" is TCP; anything else, including
+// every path with a '/', is a unix socket
+bool split_host_port(const std::string& address, std::string& host,
+		     std::string& port)
+{
+	const auto colon = address.rfind(':');
+	if (colon == std::string::npos || colon + 1 == address.size()
+	    || address.find('/') != std::string::npos)
+		return false;
+	for (char c : address.substr(colon + 1))
+		if (c < '0' || c > '9')
+			return false;
+
+	host = address.substr(0, colon);
+	port = address.substr(colon + 1);
+	if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+		host = host.substr(1, host.size() - 2);
+	return true;
+}
+
+} // namespace
+
+bool LocalEndpoint::is_tcp(const std::string& address)
+{
+	std::string host;
+	std::string port;
+	return split_host_port(address, host, port);
+}
+
+#ifdef _WIN32
+
+LocalEndpoint::LocalEndpoint(std::string address, Handler handler)
+    : socket_path_{std::move(address)},
+      handler_{std::move(handler)}
+{
+	throw std::runtime_error{"Unix socket endpoints are not supported on "
+				 "this platform: "
+				 + socket_path_};
+}
+
+LocalEndpoint::~LocalEndpoint() = default;
+
+void LocalEndpoint::listen_unix()
+{
+}
+
+void LocalEndpoint::listen_tcp(const std::string& host,
+			       const std::string& port)
+{
+	(void)host;
+	(void)port;
+}
+
+void LocalEndpoint::serve(std::stop_token stop)
+{
+	(void)stop;
+}
+
+void LocalEndpoint::serve_client(int fd)
+{
+	(void)fd;
+}
+
+#else
+
+LocalEndpoint::LocalEndpoint(std::string address, Handler handler)
+    : socket_path_{std::move(address)},
+      handler_{std::move(handler)}
+{
+	std::string host;
+	std::string port;
+	tcp_ = split_host_port(socket_path_, host, port);
+	if (tcp_)
+		listen_tcp(host, port);
+	else
+		listen_unix();
+
+	thread_ = std::jthread([this](std::stop_token stop) {
+		serve(std::move(stop));
+	});
+}
+
+void LocalEndpoint::listen_unix()
+{
+	sockaddr_un addr{};
+	addr.sun_family = AF_UNIX;
+	if (socket_path_.size() >= sizeof(addr.sun_path))
+		throw std::runtime_error{"Socket path too long: "
+					 + socket_path_};
+	std::memcpy(addr.sun_path, socket_path_.c_str(),
+		    socket_path_.size() + 1);
+
+	listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listen_fd_ < 0)
+		throw std::runtime_error{"socket() failed for "
+					 + socket_path_};
+
+	// Remove a stale socket left behind by an unclean exit
+	::unlink(socket_path_.c_str());
+
+	if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr),
+		   sizeof(addr))
+		    != 0
+	    || ::listen(listen_fd_, 16) != 0) {
+		const std::string err = std::strerror(errno);
+		::close(listen_fd_);
+		throw std::runtime_error{"Could not listen on " + socket_path_
+					 + ": " + err};
+	}
+
+	struct stat st{};
+	if (::stat(socket_path_.c_str(), &st) == 0)
+		inode_ = st.st_ino;
+}
+
+void LocalEndpoint::listen_tcp(const std::string& host,
+			       const std::string& port)
+{
+	addrinfo hints{};
+	hints.ai_family	  = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags	  = AI_PASSIVE;
+
+	addrinfo* res = nullptr;
+	if (const int rc = ::getaddrinfo(host.empty() ? nullptr : host.c_str(),
+					 port.c_str(), &hints, &res);
+	    rc != 0)
+		throw std::runtime_error{"Could not resolve " + socket_path_
+					 + ": " + ::gai_strerror(rc)};
+
+	std::string err = "no usable address";
+	for (auto* ai = res; ai && listen_fd_ < 0; ai = ai->ai_next) {
+		const int fd = ::socket(ai->ai_family,
+					ai->ai_socktype | SOCK_CLOEXEC,
+					ai->ai_protocol);
+		if (fd < 0)
+			continue;
+
+		const int on = 1;
+		(void)::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on,
+				   sizeof(on));
+#ifdef SO_REUSEPORT
+		// Old and new process both hold the port during an upgrade
+		(void)::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on,
+				   sizeof(on));
+#endif
+		if (::bind(fd, ai->ai_addr, ai->ai_addrlen) == 0
+		    && ::listen(fd, 16) == 0) {
+			listen_fd_ = fd;
+			break;
+		}
+		err = std::strerror(errno);
+		::close(fd);
+	}
+	::freeaddrinfo(res);
+
+	if (listen_fd_ < 0)
+		throw std::runtime_error{"Could not listen on " + socket_path_
+					 + ": " + err};
+}
+
+LocalEndpoint::~LocalEndpoint()
+{
+	thread_.request_stop();
+	if (thread_.joinable())
+		thread_.join();
+
+	::close(listen_fd_);
+
+	// After an upgrade the path belongs to the new process
+	struct stat st{};
+	if (!tcp_ && ::stat(socket_path_.c_str(), &st) == 0
+	    && st.st_ino == inode_)
+		::unlink(socket_path_.c_str());
+}
+
+void LocalEndpoint::serve(std::stop_token stop)
+{
+	while (!stop.stop_requested()) {
+		pollfd pfd{listen_fd_, POLLIN, 0};
+		if (::poll(&pfd, 1, 250) <= 0)
+			continue;
+
+		const int fd = ::accept4(listen_fd_, nullptr, nullptr,
+					 SOCK_CLOEXEC | SOCK_NONBLOCK);
+		if (fd < 0)
+			continue;
+
+		try {
+			serve_client(fd);
+		} catch (const std::exception& e) {
+			log::warn(socket_path_ + ": " + e.what());
+		}
+		::close(fd);
+	}
+}
+
+void LocalEndpoint::serve_client(int fd)
+{
+	const auto deadline = std::chrono::steady_clock::now()
+			      + kClientDeadline;
+	// Milliseconds left for this client, at most cap
+	auto left = [&](int cap) {
+		const auto ms = std::chrono::duration_cast<
+				std::chrono::milliseconds>(
+				deadline - std::chrono::steady_clock::now());
+		return static_cast<int>(std::clamp<std::int64_t>(ms.count(),
+								 0, cap));
+	};
+
+	// Give the client a moment to send a request line; raw readers
+	// (nc -U) may send nothing at all.
+	std::string request;
+	char	    buf[1024];
+	bool	    complete = false;
+	while (!complete) {
+		pollfd pfd{fd, POLLIN, 0};
+		if (::poll(&pfd, 1, left(request.empty() ? 100 : 1000)) <= 0)
+			break;
+		const ssize_t n = ::read(fd, buf, sizeof(buf));
+		complete	= n <= 0;
+		if (complete)
+			break;
+		request.append(buf, static_cast<std::size_t>(n));
+		complete = request.find("\r\n\r\n") != std::string::npos
+			   || request.find("\n\n") != std::string::npos
+			   || request.size() > 8192;
+	}
+	// Out of time halfway through a request
+	if (!request.empty() && !complete)
+		return;
+
+	const bool  http = request.starts_with("GET ");
+	std::string path = "/";
+	if (http) {
+		const auto end = request.find(' ', 4);
+		path	       = request.substr(4, end == std::string::npos
+							   ? std::string::npos
+							   : end - 4);
+	}
+
+	const Reply reply = handler_(path);
+
+	std::string out;
+	if (http) {
+		out = "HTTP/1.0 " + std::to_string(reply.status) + ' '
+		      + status_text(reply.status)
+		      + "\r\nContent-Type: text/plain; version=0.0.4"
+			"\r\nContent-Length: "
+		      + std::to_string(reply.body.size()) + "\r\n\r\n";
+	}
+	out += reply.body;
+
+	// A client that stops reading is dropped at the deadline too
+	std::size_t off = 0;
+	while (off < out.size()) {
+		pollfd pfd{fd, POLLOUT, 0};
+		if (::poll(&pfd, 1, left(1000)) <= 0)
+			break;
+		const ssize_t n = ::send(fd, out.data() + off,
+					 out.size() - off, MSG_NOSIGNAL);
+		if (n <= 0)
+			break;
+		off += static_cast<std::size_t>(n);
+	}
+}
+
+#endif
+
+} // namespace drop
@@ -0,0 +1,53 @@
+#ifndef SSH_DROP_LOCAL_ENDPOINT_H_
+#define SSH_DROP_LOCAL_ENDPOINT_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace drop {
+
+// Tiny request/response listener on a unix-domain socket, or on TCP when
+// the address is host:port (":port" for every interface). Clients that send
+// an HTTP request line get an HTTP/1.0 reply, anything else gets the raw
+// body, so both `curl --unix-socket` and `nc -U` work.
+class LocalEndpoint {
+public:
+	struct Reply {
+		int	    status = 200;
+		std::string body;
+	};
+
+	using Handler = std::function<Reply(std::string_view path)>;
+
+	LocalEndpoint(std::string address, Handler handler);
+	~LocalEndpoint();
+
+	// Whether address names a TCP listener rather than a unix socket
+	[[nodiscard]] static bool is_tcp(const std::string& address);
+
+	LocalEndpoint(const LocalEndpoint&)	       = delete;
+	LocalEndpoint& operator=(const LocalEndpoint&) = delete;
+	LocalEndpoint(LocalEndpoint&&)		       = delete;
+	LocalEndpoint& operator=(LocalEndpoint&&)      = delete;
+
+private:
+	void listen_unix();
+	void listen_tcp(const std::string& host, const std::string& port);
+	void serve(std::stop_token stop);
+	void serve_client(int fd);
+
+	std::string   socket_path_;
+	Handler	      handler_;
+	int	      listen_fd_ = -1;
+	bool	      tcp_	 = false;
+	// The socket file as bound, so it is only removed while still ours
+	std::uint64_t inode_ = 0;
+	std::jthread  thread_;
+};
+
+} // namespace drop
+
+#endif // SSH_DROP_LOCAL_ENDPOINT_H_
@@ -92,6 +92,15 @@ void error(std::string_view msg)
 	log_impl(Level::error, msg);
 }
 
+void flush()
+{
+	std::lock_guard lock{g_mutex};
+	std::cout.flush();
+	std::cerr.flush();
+	if (g_log_file.is_open())
+		g_log_file.flush();
+}
+
 Level level_from_string(std::string_view str)
 {
 	if (str == "debug")
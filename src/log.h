@@ -20,6 +20,9 @@ void  warn(std::string_view msg);
 void  error(std::string_view msg);
 Level level_from_string(std::string_view str);
 
+// Before fork() or _Exit(), which would duplicate or drop buffered output
+void flush();
+
 } // namespace drop::log
 
 #endif // SSH_DROP_LOG_H_
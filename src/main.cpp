@@ -7,6 +7,9 @@
 #include "authenticator.h"
 #include "drop_server.h"
 #include "encrypt_command.h"
+#include "fetch_command.h"
+#include "flight_recorder.h"
+#include "handoff.h"
 #include "log.h"
 #include "secret_provider.h"
 #include "server_config.h"
@@ -20,6 +23,8 @@ int main(int argc, char* argv[])
 		return drop::run_encrypt(argv[2]);
 	if (argc >= 3 && std::strcmp(argv[1], "--decrypt") == 0)
 		return drop::run_decrypt(argv[2]);
+	if (argc >= 3 && std::strcmp(argv[1], "--fetch") == 0)
+		return drop::run_fetch(argc, argv);
 
 	try {
 		auto config = drop::ServerConfig::load(argc, argv);
@@ -38,12 +43,21 @@ int main(int argc, char* argv[])
 
 		drop::DropServer server{std::move(config), std::move(auth),
 					std::move(secret)};
+		server.set_config_loader([argc, argv] {
+			auto reloaded = drop::ServerConfig::load(argc, argv);
+			reloaded.validate();
+			return reloaded;
+		});
+		server.set_upgrade_command(
+				drop::handoff::self_command(argc, argv));
 		server.run(running);
 	} catch (const drop::SshError& e) {
 		drop::log::error(e.what());
+		drop::recorder::dump();
 		return 1;
 	} catch (const std::exception& e) {
 		drop::log::error(e.what());
+		drop::recorder::dump();
 		return 1;
 	}
 
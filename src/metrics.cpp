@@ -0,0 +1,232 @@
+#include "metrics.h"
+
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <string_view>
+
+#include "cpu_accounting.h"
+
+namespace drop::metrics {
+
+namespace {
+
+constexpr std::size_t kShardCount = 32;
+
+struct alignas(64) Shard {
+	std::array<std::atomic<std::uint64_t>, kCounterCount> counters{};
+	std::array<std::atomic<std::int64_t>, kGaugeCount>    gauges{};
+};
+
+std::array<Shard, kShardCount> g_shards;
+std::atomic<std::size_t>       g_next_shard{0};
+
+Shard& local_shard() noexcept
+{
+	thread_local Shard& shard =
+			g_shards[g_next_shard.fetch_add(
+					 1, std::memory_order_relaxed)
+				 % kShardCount];
+	return shard;
+}
+
+struct Family {
+	const char* name;
+	const char* labels;
+	const char* help;
+};
+
+constexpr std::array<Family, kCounterCount> kCounters{{
+		{"ssh_drop_connections_accepted_total", "",
+		 "TCP connections accepted"},
+		{"ssh_drop_connections_rejected_total", "",
+		 "Connections closed before key exchange"},
+		{"ssh_drop_connections_timed_out_total", "",
+		 "Connections dropped by the auth timeout"},
+		{"ssh_drop_kex_failures_total", "", "Failed key exchanges"},
+		{"ssh_drop_auth_successes_total", "method=\"publickey\"",
+		 "Successful authentications"},
+		{"ssh_drop_auth_successes_total", "method=\"password\"",
+		 "Successful authentications"},
+		{"ssh_drop_auth_successes_total",
+		 "method=\"keyboard-interactive\"",
+		 "Successful authentications"},
+		{"ssh_drop_auth_failures_total", "method=\"publickey\"",
+		 "Rejected authentication attempts"},
+		{"ssh_drop_auth_failures_total", "method=\"password\"",
+		 "Rejected authentication attempts"},
+		{"ssh_drop_auth_failures_total",
+		 "method=\"keyboard-interactive\"",
+		 "Rejected authentication attempts"},
+		{"ssh_drop_secrets_delivered_total", "",
+		 "Secrets written to clients"},
+		{"ssh_drop_bytes_written_total", "",
+		 "Secret bytes written to clients"},
+		{"ssh_drop_decrypt_failures_total", "",
+		 "Secret decryptions that failed authentication"},
+		{"ssh_drop_connections_throttled_total", "reason=\"rate\"",
+		 "Connections refused by the per-source limiter"},
+		{"ssh_drop_connections_throttled_total", "reason=\"backoff\"",
+		 "Connections refused by the per-source limiter"},
+		{"ssh_drop_auth_backoffs_total", "",
+		 "Auth failures that started or extended a backoff"},
+		{"ssh_drop_rate_limiter_evictions_total", "",
+		 "Tracked sources displaced by newer ones"},
+		{"ssh_drop_connections_shed_total", "",
+		 "Connections reset because the admission limit was reached"},
+		{"ssh_drop_session_requests_total", "type=\"get\"",
+		 "Requests served on ssh-drop subsystem sessions"},
+		{"ssh_drop_session_requests_total", "type=\"list\"",
+		 "Requests served on ssh-drop subsystem sessions"},
+		{"ssh_drop_session_requests_total", "type=\"ping\"",
+		 "Requests served on ssh-drop subsystem sessions"},
+		{"ssh_drop_session_request_errors_total", "",
+		 "Subsystem requests answered with an error"},
+		{"ssh_drop_watch_pushes_total", "",
+		 "Secret values pushed in full to watching sessions"},
+		{"ssh_drop_watch_stalled_total", "",
+		 "Watching sessions dropped for not reading"},
+		{"ssh_drop_config_reloads_total", "",
+		 "Configuration reloads applied"},
+		{"ssh_drop_config_reload_failures_total", "",
+		 "Configuration reloads rejected, old config kept"},
+}};
+
+constexpr std::array<Family, kGaugeCount> kGauges{{
+		{"ssh_drop_active_threads", "", "Live connection threads"},
+		{"ssh_drop_active_connections", "", "Open client sessions"},
+		{"ssh_drop_rate_limiter_sources", "",
+		 "Source addresses tracked by the limiter"},
+		{"ssh_drop_admission_limit", "",
+		 "Current adaptive cap on connections in flight"},
+		{"ssh_drop_open_sessions", "",
+		 "Persistent ssh-drop subsystem sessions"},
+		{"ssh_drop_watch_subscribers", "",
+		 "Sessions waiting for secret changes"},
+}};
+
+void append_header(std::string& out, const Family& f, const char* type)
+{
+	out += "# HELP ";
+	out += f.name;
+	out += ' ';
+	out += f.help;
+	out += "\n# TYPE ";
+	out += f.name;
+	out += ' ';
+	out += type;
+	out += '\n';
+}
+
+void append_sample(std::string& out, const char* name,
+		   const std::string& labels, const std::string& value)
+{
+	out += name;
+	if (!labels.empty()) {
+		out += '{';
+		out += labels;
+		out += '}';
+	}
+	out += ' ';
+	out += value;
+	out += '\n';
+}
+
+std::string format_seconds(double s)
+{
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), "%.6f", s);
+	return buf;
+}
+
+} // namespace
+
+void add(Counter counter, std::uint64_t n) noexcept
+{
+	local_shard()
+			.counters[static_cast<std::size_t>(counter)]
+			.fetch_add(n, std::memory_order_relaxed);
+}
+
+void add(Gauge gauge, std::int64_t delta) noexcept
+{
+	local_shard()
+			.gauges[static_cast<std::size_t>(gauge)]
+			.fetch_add(delta, std::memory_order_relaxed);
+}
+
+std::uint64_t value(Counter counter) noexcept
+{
+	std::uint64_t sum = 0;
+	for (const auto& shard : g_shards)
+		sum += shard.counters[static_cast<std::size_t>(counter)].load(
+				std::memory_order_relaxed);
+	return sum;
+}
+
+std::int64_t value(Gauge gauge) noexcept
+{
+	std::int64_t sum = 0;
+	for (const auto& shard : g_shards)
+		sum += shard.gauges[static_cast<std::size_t>(gauge)].load(
+				std::memory_order_relaxed);
+	return sum;
+}
+
+std::string render()
+{
+	std::string out;
+	const char* last = "";
+
+	for (std::size_t i = 0; i < kCounterCount; ++i) {
+		const auto& f = kCounters[i];
+		if (std::string_view{f.name} != last)
+			append_header(out, f, "counter");
+		last = f.name;
+		append_sample(out, f.name, f.labels,
+			      std::to_string(value(static_cast<Counter>(i))));
+	}
+
+	for (std::size_t i = 0; i < kGaugeCount; ++i) {
+		const auto& f = kGauges[i];
+		append_header(out, f, "gauge");
+		append_sample(out, f.name, f.labels,
+			      std::to_string(value(static_cast<Gauge>(i))));
+	}
+
+	const auto cpu_totals = cpu::snapshot();
+
+	append_header(out,
+		      {"ssh_drop_cpu_seconds_total", "",
+		       "Connection thread CPU time by phase"},
+		      "counter");
+	for (const auto& t : cpu_totals) {
+		for (std::size_t p = 0; p < cpu::kPhaseCount; ++p) {
+			const std::string labels =
+					std::string{"phase=\""}
+					+ cpu::phase_name(
+							static_cast<cpu::Phase>(
+									p))
+					+ "\",auth_method=\"" + t.auth_method
+					+ "\",provider=\"" + t.provider + '"';
+			append_sample(out, "ssh_drop_cpu_seconds_total",
+				      labels, format_seconds(t.seconds[p]));
+		}
+	}
+
+	append_header(out,
+		      {"ssh_drop_cpu_connections_total", "",
+		       "Connections included in the CPU totals"},
+		      "counter");
+	for (const auto& t : cpu_totals) {
+		const std::string labels = "auth_method=\"" + t.auth_method
+					   + "\",provider=\"" + t.provider
+					   + '"';
+		append_sample(out, "ssh_drop_cpu_connections_total", labels,
+			      std::to_string(t.connections));
+	}
+
+	return out;
+}
+
+} // namespace drop::metrics
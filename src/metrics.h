@@ -0,0 +1,65 @@
+#ifndef SSH_DROP_METRICS_H_
+#define SSH_DROP_METRICS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace drop::metrics {
+
+enum class Counter {
+	connections_accepted,
+	connections_rejected,
+	connections_timed_out,
+	kex_failures,
+	auth_success_publickey,
+	auth_success_password,
+	auth_success_kbdint,
+	auth_failure_publickey,
+	auth_failure_password,
+	auth_failure_kbdint,
+	secrets_delivered,
+	bytes_written,
+	decrypt_failures,
+	throttled_rate,
+	throttled_backoff,
+	auth_backoffs,
+	limiter_evictions,
+	connections_shed,
+	session_requests_get,
+	session_requests_list,
+	session_requests_ping,
+	session_request_errors,
+	watch_pushes,
+	watch_stalled,
+	config_reloads,
+	config_reload_failures
+};
+
+constexpr std::size_t kCounterCount = 26;
+
+enum class Gauge {
+	active_threads,
+	active_connections,
+	limiter_sources,
+	admission_limit,
+	open_sessions,
+	watch_subscribers
+};
+
+constexpr std::size_t kGaugeCount = 6;
+
+// Hot-path updates land in the calling thread's cache-line-aligned shard;
+// shards are only summed when read.
+void add(Counter counter, std::uint64_t n = 1) noexcept;
+void add(Gauge gauge, std::int64_t delta) noexcept;
+
+[[nodiscard]] std::uint64_t value(Counter counter) noexcept;
+[[nodiscard]] std::int64_t  value(Gauge gauge) noexcept;
+
+// Prometheus text exposition format (version 0.0.4).
+[[nodiscard]] std::string render();
+
+} // namespace drop::metrics
+
+#endif // SSH_DROP_METRICS_H_
@@ -0,0 +1,285 @@
+#include "rate_limiter.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#endif
+
+#include "metrics.h"
+
+namespace drop {
+
+namespace {
+
+constexpr std::uint64_t kTokenUnit   = 256;
+constexpr std::uint64_t kTokenMask   = (std::uint64_t{1} << 24) - 1;
+constexpr std::uint64_t kCountMask   = 0xff;
+constexpr int		kMaxDoubling = 20;
+
+// splitmix64 finaliser: spreads neighbouring addresses over all sets
+std::uint64_t mix(std::uint64_t x) noexcept
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+std::uint64_t pack(std::uint64_t low, int low_bits,
+		   std::uint64_t ms) noexcept
+{
+	return (ms << low_bits) | low;
+}
+
+} // namespace
+
+RateLimiter::RateLimiter(const Limits& limits)
+    : limits_{limits},
+      epoch_{std::chrono::steady_clock::now()}
+{
+	const auto sets = std::bit_ceil(
+			std::max<std::size_t>(limits.capacity / kWays, 1));
+	set_mask_ = sets - 1;
+
+#ifndef _WIN32
+	if (limits_.shared) {
+		// Only lock-free atomics work between processes
+		static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+		void* mem = ::mmap(nullptr, sets * sizeof(Set),
+				   PROT_READ | PROT_WRITE,
+				   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (mem == MAP_FAILED)
+			throw std::system_error{errno, std::generic_category(),
+						"mmap"};
+		sets_ = static_cast<Set*>(mem);
+		for (std::size_t i = 0; i < sets; ++i)
+			new (sets_ + i) Set{};
+		return;
+	}
+#endif
+	limits_.shared = false;
+	sets_	       = new Set[sets];
+}
+
+RateLimiter::~RateLimiter()
+{
+#ifndef _WIN32
+	if (limits_.shared) {
+		::munmap(sets_, (set_mask_ + 1) * sizeof(Set));
+		return;
+	}
+#endif
+	delete[] sets_;
+}
+
+std::uint64_t RateLimiter::source_key(const sockaddr* peer) noexcept
+{
+	if (peer->sa_family == AF_INET6) {
+		const auto* in6 = reinterpret_cast<const sockaddr_in6*>(peer);
+		const auto* b	= in6->sin6_addr.s6_addr;
+
+		static constexpr std::uint8_t kMapped[12] = {
+				0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+		if (std::memcmp(b, kMapped, sizeof(kMapped)) != 0) {
+			std::uint64_t prefix;
+			std::memcpy(&prefix, b, sizeof(prefix));
+			return mix(prefix) | (std::uint64_t{1} << 63);
+		}
+
+		std::uint32_t v4;
+		std::memcpy(&v4, b + 12, sizeof(v4));
+		return (std::uint64_t{1} << 32) | v4;
+	}
+
+	if (peer->sa_family == AF_INET) {
+		const auto* in = reinterpret_cast<const sockaddr_in*>(peer);
+		return (std::uint64_t{1} << 32) | in->sin_addr.s_addr;
+	}
+
+	// Unknown families share one bucket
+	return 1;
+}
+
+std::uint64_t RateLimiter::now_ms() const noexcept
+{
+	using std::chrono::duration_cast;
+	using std::chrono::milliseconds;
+
+	// Starts at 1 so that 0 can mean "never"
+	const auto elapsed = std::chrono::steady_clock::now() - epoch_;
+	return static_cast<std::uint64_t>(
+		       duration_cast<milliseconds>(elapsed).count())
+	       + 1;
+}
+
+RateLimiter::Set& RateLimiter::set_for(std::uint64_t source) const noexcept
+{
+	return sets_[mix(source) & set_mask_];
+}
+
+RateLimiter::Slot* RateLimiter::find(std::uint64_t source) const noexcept
+{
+	for (auto& slot : set_for(source).ways)
+		if (slot.key.load(std::memory_order_acquire) == source)
+			return &slot;
+	return nullptr;
+}
+
+RateLimiter::Slot& RateLimiter::claim(std::uint64_t source,
+				      std::uint64_t now) noexcept
+{
+	auto& set = set_for(source);
+
+	for (auto& slot : set.ways) {
+		auto key = slot.key.load(std::memory_order_acquire);
+		if (key == 0
+		    && slot.key.compare_exchange_strong(
+				    key, source, std::memory_order_acq_rel)) {
+			metrics::add(metrics::Gauge::limiter_sources, 1);
+			key = source;
+		}
+		if (key == source) {
+			slot.seen.store(now, std::memory_order_relaxed);
+			return slot;
+		}
+	}
+
+	// Full set: replace the least recently seen way, sparing sources
+	// that are serving a backoff unless every way is.
+	auto rank = [now](const Slot& slot) {
+		const auto word = slot.backoff.load(std::memory_order_relaxed);
+		return std::pair{(word >> 8) > now,
+				 slot.seen.load(std::memory_order_relaxed)};
+	};
+
+	Slot* victim = &set.ways[0];
+	for (auto& slot : set.ways)
+		if (rank(slot) < rank(*victim))
+			victim = &slot;
+
+	auto old = victim->key.load(std::memory_order_acquire);
+	if (old != source
+	    && victim->key.compare_exchange_strong(
+			    old, source, std::memory_order_acq_rel)) {
+		victim->bucket.store(0, std::memory_order_relaxed);
+		victim->backoff.store(0, std::memory_order_relaxed);
+		metrics::add(metrics::Counter::limiter_evictions);
+	}
+	victim->seen.store(now, std::memory_order_relaxed);
+	return *victim;
+}
+
+bool RateLimiter::take_token(Slot& slot, std::uint64_t now) noexcept
+{
+	const double per_ms = limits_.connections_per_s / 1000.0;
+	const auto   full = static_cast<std::uint64_t>(limits_.burst)
+			  * kTokenUnit;
+	auto	     cur  = slot.bucket.load(std::memory_order_relaxed);
+
+	for (;;) {
+		// A zeroed word is a fresh source: start with a full bucket
+		auto tokens = full;
+		if (cur != 0) {
+			const auto last	 = cur >> 24;
+			const auto ms	 = now > last ? now - last : 0;
+			const auto refill = static_cast<std::uint64_t>(
+					static_cast<double>(ms) * per_ms
+					* kTokenUnit);
+			tokens = std::min((cur & kTokenMask) + refill, full);
+		}
+		if (tokens < kTokenUnit)
+			return false;
+
+		const auto next = pack(tokens - kTokenUnit, 24, now);
+		if (slot.bucket.compare_exchange_weak(
+				    cur, next, std::memory_order_relaxed))
+			return true;
+	}
+}
+
+RateLimiter::Verdict RateLimiter::admit(std::uint64_t source) noexcept
+{
+	const auto now	= now_ms();
+	auto&	   slot = claim(source, now);
+
+	if ((slot.backoff.load(std::memory_order_relaxed) >> 8) > now)
+		return Verdict::backing_off;
+	if (limits_.connections_per_s > 0.0 && !take_token(slot, now))
+		return Verdict::rate_limited;
+	return Verdict::admit;
+}
+
+bool RateLimiter::backing_off(std::uint64_t source) const noexcept
+{
+	const auto* slot = find(source);
+	if (!slot)
+		return false;
+	return (slot->backoff.load(std::memory_order_relaxed) >> 8) > now_ms();
+}
+
+std::uint64_t RateLimiter::backoff_ms(int over) const noexcept
+{
+	const auto base = static_cast<std::uint64_t>(limits_.backoff.count());
+	const auto cap	= static_cast<std::uint64_t>(
+			 limits_.backoff_max.count());
+	return std::min(base << std::min(over - 1, kMaxDoubling), cap);
+}
+
+void RateLimiter::auth_failed(std::uint64_t source) noexcept
+{
+	if (limits_.backoff.count() <= 0)
+		return;
+
+	const auto    now  = now_ms();
+	auto&	      slot = claim(source, now);
+	std::uint64_t cur  = slot.backoff.load(std::memory_order_relaxed);
+
+	for (;;) {
+		// The high bits hold the end of the block, or the time of the
+		// last failure when there is none. A quiet backoff_max
+		// forgives earlier failures.
+		const auto last	 = cur >> 8;
+		auto	   count = cur & kCountMask;
+		if (cur != 0
+		    && now > last + static_cast<std::uint64_t>(
+					   limits_.backoff_max.count()))
+			count = 0;
+
+		const auto failures = std::min(count + 1, kCountMask);
+		const auto over	    = static_cast<int>(failures)
+				  - limits_.failures_allowed;
+		auto until = now;
+		if (over > 0)
+			until = std::max(last, now + backoff_ms(over));
+
+		if (slot.backoff.compare_exchange_weak(
+				    cur, pack(failures, 8, until),
+				    std::memory_order_relaxed)) {
+			if (over > 0)
+				metrics::add(metrics::Counter::auth_backoffs);
+			return;
+		}
+	}
+}
+
+void RateLimiter::auth_succeeded(std::uint64_t source) noexcept
+{
+	if (auto* slot = find(source))
+		slot->backoff.store(0, std::memory_order_relaxed);
+}
+
+} // namespace drop
@@ -0,0 +1,103 @@
+#ifndef SSH_DROP_RATE_LIMITER_H_
+#define SSH_DROP_RATE_LIMITER_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+struct sockaddr;
+
+namespace drop {
+
+// Per-source connection token buckets and auth-failure backoff, checked
+// before key exchange. The table is a fixed array of 8-way sets indexed by
+// a hash of the source; a new source takes a free way or evicts the least
+// recently seen one, preferring sources that are not backing off, so memory
+// stays bounded however many addresses show up. All updates are CAS loops
+// on packed 64-bit words: no locks, and concurrent updates of one source
+// may at worst let a single extra connection through. The same holds
+// across processes when the table is shared with forked workers.
+class RateLimiter {
+public:
+	struct Limits {
+		// New connections per second per source; 0 disables the
+		// bucket
+		double connections_per_s = 0.0;
+		int    burst		 = 10;
+
+		// Failures tolerated before backing off; each further one
+		// doubles the block, up to backoff_max. A zero backoff
+		// disables it.
+		int			  failures_allowed = 3;
+		std::chrono::milliseconds backoff{0};
+		std::chrono::milliseconds backoff_max{300000};
+
+		// Rounded up to a whole number of sets
+		std::size_t capacity = 65536;
+
+		// Keep the table in memory that processes forked afterwards
+		// share, so they enforce one set of limits between them
+		bool shared = false;
+	};
+
+	enum class Verdict {
+		admit,
+		rate_limited,
+		backing_off
+	};
+
+	explicit RateLimiter(const Limits& limits);
+	~RateLimiter();
+
+	RateLimiter(const RateLimiter&)		   = delete;
+	RateLimiter& operator=(const RateLimiter&) = delete;
+
+	// IPv4 peers are keyed by address, IPv6 peers by their /64, since one
+	// host usually owns the whole prefix. Never 0.
+	[[nodiscard]] static std::uint64_t
+	source_key(const sockaddr* peer) noexcept;
+
+	// Spends a connection token unless the source is over its rate or
+	// backing off.
+	[[nodiscard]] Verdict admit(std::uint64_t source) noexcept;
+
+	[[nodiscard]] bool backing_off(std::uint64_t source) const noexcept;
+	void		   auth_failed(std::uint64_t source) noexcept;
+	void		   auth_succeeded(std::uint64_t source) noexcept;
+
+private:
+	static constexpr std::size_t kWays = 8;
+
+	struct Slot {
+		std::atomic<std::uint64_t> key{0};
+		// tokens in 1/256ths (low 24 bits) | last refill ms
+		std::atomic<std::uint64_t> bucket{0};
+		// failures (low 8 bits) | blocked until ms
+		std::atomic<std::uint64_t> backoff{0};
+		std::atomic<std::uint64_t> seen{0};
+	};
+
+	struct alignas(64) Set {
+		std::array<Slot, kWays> ways;
+	};
+
+	[[nodiscard]] std::uint64_t now_ms() const noexcept;
+	[[nodiscard]] std::uint64_t backoff_ms(int over) const noexcept;
+
+	[[nodiscard]] Set&  set_for(std::uint64_t source) const noexcept;
+	[[nodiscard]] Slot* find(std::uint64_t source) const noexcept;
+	[[nodiscard]] Slot& claim(std::uint64_t source,
+				  std::uint64_t now) noexcept;
+	[[nodiscard]] bool  take_token(Slot& slot, std::uint64_t now) noexcept;
+
+	Limits				      limits_;
+	std::chrono::steady_clock::time_point epoch_;
+	std::size_t			      set_mask_;
+	Set*				      sets_ = nullptr;
+};
+
+} // namespace drop
+
+#endif // SSH_DROP_RATE_LIMITER_H_
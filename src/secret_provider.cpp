@@ -1,11 +1,14 @@
 #include "secret_provider.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
+#include <system_error>
 
 #include "crypto.h"
+#include "metrics.h"
 #include "server_config.h"
 
 namespace drop {
@@ -38,6 +41,11 @@ std::string EnvSecretProvider::get_secret(std::string_view passphrase) const
 	return val;
 }
 
+bool EnvSecretProvider::readable() const
+{
+	return std::getenv(var_name_.c_str()) != nullptr;
+}
+
 FileSecretProvider::FileSecretProvider(std::filesystem::path path)
     : path_{std::move(path)}
 {
@@ -57,6 +65,11 @@ std::string FileSecretProvider::get_secret(std::string_view passphrase) const
 	return ss.str();
 }
 
+bool FileSecretProvider::readable() const
+{
+	return std::ifstream{path_}.is_open();
+}
+
 EncryptedSecretProvider::EncryptedSecretProvider(
 		std::unique_ptr<ISecretProvider> inner)
     : inner_{std::move(inner)}
@@ -68,12 +81,66 @@ EncryptedSecretProvider::get_secret(std::string_view passphrase) const
 {
 	std::string data_b64 = inner_->get_secret();
 	auto	    result   = crypto::decrypt(data_b64, passphrase);
-	if (!result)
+	if (!result) {
+		metrics::add(metrics::Counter::decrypt_failures);
 		throw std::runtime_error{
 				"Decryption failed (wrong passphrase)"};
+	}
 	return std::move(*result);
 }
 
+SecretDirectory::SecretDirectory(std::filesystem::path dir, bool encrypted)
+    : dir_{std::move(dir)},
+      encrypted_{encrypted}
+{
+}
+
+bool SecretDirectory::valid_name(std::string_view name) noexcept
+{
+	if (name.empty() || name.front() == '.')
+		return false;
+	for (char c : name) {
+		const bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+				|| (c >= '0' && c <= '9') || c == '.'
+				|| c == '_' || c == '-';
+		if (!ok)
+			return false;
+	}
+	return true;
+}
+
+bool SecretDirectory::contains(std::string_view name) const
+{
+	std::error_code ec;
+	return valid_name(name)
+	       && std::filesystem::is_regular_file(dir_ / name, ec);
+}
+
+std::vector<std::string> SecretDirectory::list() const
+{
+	std::vector<std::string> names;
+	for (const auto& entry : std::filesystem::directory_iterator{dir_}) {
+		auto name = entry.path().filename().string();
+		if (entry.is_regular_file() && valid_name(name))
+			names.push_back(std::move(name));
+	}
+	std::sort(names.begin(), names.end());
+	return names;
+}
+
+std::string SecretDirectory::get_secret(std::string_view name,
+					std::string_view passphrase) const
+{
+	if (!valid_name(name))
+		throw std::runtime_error{"Invalid secret name: "
+					 + std::string{name}};
+
+	auto file = std::make_unique<FileSecretProvider>(dir_ / name);
+	if (!encrypted_)
+		return file->get_secret();
+	return EncryptedSecretProvider{std::move(file)}.get_secret(passphrase);
+}
+
 std::unique_ptr<ISecretProvider>
 make_value_provider(const std::optional<std::string>& value,
 		    const std::optional<std::string>& file_path,
@@ -104,4 +171,13 @@ make_secret_provider(const ServerConfig& config)
 	return p;
 }
 
+std::unique_ptr<SecretDirectory>
+make_secret_directory(const ServerConfig& config)
+{
+	if (config.secrets_dir.empty())
+		return nullptr;
+	return std::make_unique<SecretDirectory>(config.secrets_dir,
+						 config.secret_encrypted);
+}
+
 } // namespace drop
@@ -6,6 +6,7 @@
 #include <optional>
 #include <string>
 #include <string_view>
+#include <vector>
 
 namespace drop {
 
@@ -20,8 +21,14 @@ public:
 		return false;
 	}
 
+	[[nodiscard]] virtual const char* type_name() const noexcept = 0;
+
 	[[nodiscard]] virtual std::string
 	get_secret(std::string_view passphrase = {}) const = 0;
+
+	// Whether the source is there to be read, without reading or
+	// decrypting it; for readiness checks.
+	[[nodiscard]] virtual bool readable() const = 0;
 };
 
 class StaticSecretProvider : public ISecretProvider {
@@ -31,6 +38,16 @@ public:
 	[[nodiscard]] std::string
 	get_secret(std::string_view passphrase = {}) const override;
 
+	[[nodiscard]] bool readable() const override
+	{
+		return true;
+	}
+
+	[[nodiscard]] const char* type_name() const noexcept override
+	{
+		return "static";
+	}
+
 private:
 	std::string secret_;
 };
@@ -42,6 +59,13 @@ public:
 	[[nodiscard]] std::string
 	get_secret(std::string_view passphrase = {}) const override;
 
+	[[nodiscard]] bool readable() const override;
+
+	[[nodiscard]] const char* type_name() const noexcept override
+	{
+		return "env";
+	}
+
 private:
 	std::string var_name_;
 };
@@ -53,6 +77,13 @@ public:
 	[[nodiscard]] std::string
 	get_secret(std::string_view passphrase = {}) const override;
 
+	[[nodiscard]] bool readable() const override;
+
+	[[nodiscard]] const char* type_name() const noexcept override
+	{
+		return "file";
+	}
+
 private:
 	std::filesystem::path path_;
 };
@@ -66,13 +97,52 @@ public:
 		return true;
 	}
 
+	[[nodiscard]] const char* type_name() const noexcept override
+	{
+		return "encrypted";
+	}
+
 	[[nodiscard]] std::string
 	get_secret(std::string_view passphrase = {}) const override;
 
+	[[nodiscard]] bool readable() const override
+	{
+		return inner_->readable();
+	}
+
 private:
 	std::unique_ptr<ISecretProvider> inner_;
 };
 
+// Named secrets for "get <name>": one file per secret, encrypted with the
+// same passphrase as the default secret when that one is. Files are read
+// on every request, so they can be replaced while the server runs.
+class SecretDirectory {
+public:
+	SecretDirectory(std::filesystem::path dir, bool encrypted);
+
+	[[nodiscard]] bool needs_passphrase() const noexcept
+	{
+		return encrypted_;
+	}
+
+	// Letters, digits, '.', '_' and '-', not starting with '.': a name
+	// can never reach outside the directory.
+	[[nodiscard]] static bool valid_name(std::string_view name) noexcept;
+
+	[[nodiscard]] bool contains(std::string_view name) const;
+	// Sorted names of every file that could be fetched
+	[[nodiscard]] std::vector<std::string> list() const;
+
+	[[nodiscard]] std::string
+	get_secret(std::string_view name,
+		   std::string_view passphrase = {}) const;
+
+private:
+	std::filesystem::path dir_;
+	bool		      encrypted_;
+};
+
 [[nodiscard]] std::unique_ptr<ISecretProvider>
 make_value_provider(const std::optional<std::string>& value,
 		    const std::optional<std::string>& file_path,
@@ -81,6 +151,10 @@ make_value_provider(const std::optional<std::string>& value,
 [[nodiscard]] std::unique_ptr<ISecretProvider>
 make_secret_provider(const ServerConfig& config);
 
+// Null when no secrets_dir is configured
+[[nodiscard]] std::unique_ptr<SecretDirectory>
+make_secret_directory(const ServerConfig& config);
+
 } // namespace drop
 
 #endif // SSH_DROP_SECRET_PROVIDER_H_
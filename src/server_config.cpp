@@ -7,6 +7,7 @@
 #include <stdexcept>
 
 #include "config_parser.h"
+#include "ip_filter.h"
 
 namespace drop {
 
@@ -29,6 +30,36 @@ bool parse_bool(const std::string& key, const std::string& value)
 				 + value};
 }
 
+// "a, b,c" -> {"a", "b", "c"}; empty entries are dropped.
+std::vector<std::string> split_list(const std::string& value)
+{
+	auto space = [&](std::size_t i) {
+		return std::isspace(static_cast<unsigned char>(value[i])) != 0;
+	};
+
+	std::vector<std::string> out;
+	std::size_t		 start = 0;
+
+	while (start <= value.size()) {
+		auto end = value.find(',', start);
+		if (end == std::string::npos)
+			end = value.size();
+
+		auto first = start;
+		auto last  = end;
+		while (first < last && space(first))
+			first++;
+		while (last > first && space(last - 1))
+			last--;
+		if (first < last)
+			out.emplace_back(value.substr(first, last - first));
+
+		start = end + 1;
+	}
+
+	return out;
+}
+
 } // namespace
 
 ServerConfig ServerConfig::load(int argc, char* argv[])
@@ -57,11 +88,11 @@ void ServerConfig::validate() const
 	if (port_num < 1 || port_num > 65535)
 		throw std::runtime_error{"Port out of range: " + port};
 
-	if (host_key_path.empty())
+	if (host_key_paths.empty())
 		throw std::runtime_error{"host_key is required"};
-	if (!std::filesystem::exists(host_key_path))
-		throw std::runtime_error{"Host key not found: "
-					 + host_key_path};
+	for (const auto& path : host_key_paths)
+		if (!std::filesystem::exists(path))
+			throw std::runtime_error{"Host key not found: " + path};
 
 	if (auth_method.empty())
 		throw std::runtime_error{"auth_method is required"};
@@ -81,8 +112,62 @@ void ServerConfig::validate() const
 					+ authorized_keys_path};
 	}
 
+	if (!secrets_dir.empty() && !std::filesystem::is_directory(secrets_dir))
+		throw std::runtime_error{"Secrets directory not found: "
+					 + secrets_dir};
+	if (passphrase_prompt && !secret_encrypted)
+		throw std::runtime_error{
+				"passphrase_prompt requires secret_encrypted"};
+
+	// Throws on a malformed entry
+	(void)IpFilter{allow_from, deny_from};
+
+	if (rate_limit < 0.0)
+		throw std::runtime_error{"rate_limit must be >= 0"};
+	if (rate_burst < 1 || rate_burst > 65535)
+		throw std::runtime_error{"rate_burst must be 1-65535"};
+	if (auth_failures_allowed < 0)
+		throw std::runtime_error{"auth_failures_allowed must be >= 0"};
+	if (auth_backoff < 0 || auth_backoff_max < auth_backoff)
+		throw std::runtime_error{
+				"auth_backoff must be >= 0 and at most "
+				"auth_backoff_max"};
+	if (rate_table_size < 8)
+		throw std::runtime_error{"rate_table_size must be >= 8"};
+
+	if (latency_target_ms < 0)
+		throw std::runtime_error{"latency_target_ms must be >= 0"};
+	if (concurrency_min < 1 || concurrency_max < concurrency_min)
+		throw std::runtime_error{
+				"concurrency_min must be >= 1 and at most "
+				"concurrency_max"};
+
 	if (auth_timeout < 1)
 		throw std::runtime_error{"auth_timeout must be >= 1"};
+	if (drain_timeout < 1)
+		throw std::runtime_error{"drain_timeout must be >= 1"};
+	if (idle_exit < 0)
+		throw std::runtime_error{"idle_exit must be >= 0"};
+	if (workers < 0 || worker_max_connections < 0)
+		throw std::runtime_error{
+				"workers and worker_max_connections must be "
+				">= 0"};
+	if (session_idle_timeout < 1)
+		throw std::runtime_error{"session_idle_timeout must be >= 1"};
+	if (session_max_requests < 1)
+		throw std::runtime_error{"session_max_requests must be >= 1"};
+	if (watch_max_subscribers < 0)
+		throw std::runtime_error{"watch_max_subscribers must be >= 0"};
+	if (watch_stall_timeout < 1)
+		throw std::runtime_error{"watch_stall_timeout must be >= 1"};
+
+	if (!health_listen.empty() && health_listen == metrics_socket)
+		throw std::runtime_error{
+				"health_listen and metrics_socket must differ"};
+
+	if (trace_enabled && trace_file.empty())
+		throw std::runtime_error{
+				"trace_file is required when trace_enabled is set"};
 
 	// Secret source: exactly one must be set
 	const int secret_count = (secret.has_value() ? 1 : 0)
@@ -162,15 +247,61 @@ ServerConfig::from_map(const std::unordered_map<std::string, std::string>& m)
 	if (auto* v = get("port"))
 		cfg.port = *v;
 	if (auto* v = get("host_key"))
-		cfg.host_key_path = *v;
+		cfg.host_key_paths = split_list(*v);
 	if (auto* v = get("authorized_keys"))
 		cfg.authorized_keys_path = *v;
+	if (auto* v = get("kex_algorithms"))
+		cfg.kex_algorithms = *v;
+	if (auto* v = get("ciphers"))
+		cfg.ciphers = *v;
+	if (auto* v = get("macs"))
+		cfg.macs = *v;
+	if (auto* v = get("hostkey_algorithms"))
+		cfg.hostkey_algorithms = *v;
+	if (auto* v = get("allow_from"))
+		cfg.allow_from = split_list(*v);
+	if (auto* v = get("deny_from"))
+		cfg.deny_from = split_list(*v);
+	if (auto* v = get("rate_limit"))
+		cfg.rate_limit = std::stod(*v);
+	if (auto* v = get("rate_burst"))
+		cfg.rate_burst = std::stoi(*v);
+	if (auto* v = get("auth_failures_allowed"))
+		cfg.auth_failures_allowed = std::stoi(*v);
+	if (auto* v = get("auth_backoff"))
+		cfg.auth_backoff = std::stoi(*v);
+	if (auto* v = get("auth_backoff_max"))
+		cfg.auth_backoff_max = std::stoi(*v);
+	if (auto* v = get("rate_table_size"))
+		cfg.rate_table_size = std::stoi(*v);
+	if (auto* v = get("latency_target_ms"))
+		cfg.latency_target_ms = std::stoi(*v);
+	if (auto* v = get("concurrency_min"))
+		cfg.concurrency_min = std::stoi(*v);
+	if (auto* v = get("concurrency_max"))
+		cfg.concurrency_max = std::stoi(*v);
 	if (auto* v = get("auth_timeout"))
 		cfg.auth_timeout = std::stoi(*v);
+	if (auto* v = get("drain_timeout"))
+		cfg.drain_timeout = std::stoi(*v);
+	if (auto* v = get("idle_exit"))
+		cfg.idle_exit = std::stoi(*v);
+	if (auto* v = get("workers"))
+		cfg.workers = std::stoi(*v);
+	if (auto* v = get("worker_max_connections"))
+		cfg.worker_max_connections = std::stoi(*v);
 	if (auto* v = get("log_level"))
 		cfg.log_level = *v;
 	if (auto* v = get("log_file"))
 		cfg.log_file = *v;
+	if (auto* v = get("metrics_socket"))
+		cfg.metrics_socket = *v;
+	if (auto* v = get("health_listen"))
+		cfg.health_listen = *v;
+	if (auto* v = get("trace_file"))
+		cfg.trace_file = *v;
+	if (auto* v = get("trace_enabled"))
+		cfg.trace_enabled = parse_bool("trace_enabled", *v);
 
 	if (auto* v = get("secret"))
 		cfg.secret = *v;
@@ -180,6 +311,18 @@ ServerConfig::from_map(const std::unordered_map<std::string, std::string>& m)
 		cfg.secret_env = *v;
 	if (auto* v = get("secret_encrypted"))
 		cfg.secret_encrypted = parse_bool("secret_encrypted", *v);
+	if (auto* v = get("passphrase_prompt"))
+		cfg.passphrase_prompt = parse_bool("passphrase_prompt", *v);
+	if (auto* v = get("secrets_dir"))
+		cfg.secrets_dir = *v;
+	if (auto* v = get("session_idle_timeout"))
+		cfg.session_idle_timeout = std::stoi(*v);
+	if (auto* v = get("session_max_requests"))
+		cfg.session_max_requests = std::stoi(*v);
+	if (auto* v = get("watch_max_subscribers"))
+		cfg.watch_max_subscribers = std::stoi(*v);
+	if (auto* v = get("watch_stall_timeout"))
+		cfg.watch_stall_timeout = std::stoi(*v);
 
 	if (auto* v = get("auth_method"))
 		cfg.auth_method = *v;
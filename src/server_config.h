@@ -4,23 +4,78 @@
 #include <optional>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace drop {
 
 struct ServerConfig {
-	std::string port;
-	std::string host_key_path;
-	std::string authorized_keys_path;
+	std::string		 port;
+	std::vector<std::string> host_key_paths;
+	std::string		 authorized_keys_path;
+
+	// OpenSSH-style comma-separated preference lists; empty keeps the
+	// libssh defaults
+	std::string kex_algorithms;
+	std::string ciphers;
+	std::string macs;
+	std::string hostkey_algorithms;
+
+	// CIDR lists checked right after accept(), before key exchange
+	std::vector<std::string> allow_from;
+	std::vector<std::string> deny_from;
+
+	// Per-source limits; rate_limit 0 and auth_backoff 0 switch the
+	// limiter off
+	double rate_limit	     = 0.0;
+	int    rate_burst	     = 10;
+	int    auth_failures_allowed = 3;
+	int    auth_backoff	     = 0;
+	int    auth_backoff_max	     = 300;
+	int    rate_table_size	     = 65536;
+
+	// Adaptive cap on connections in flight; 0 disables it
+	int latency_target_ms = 0;
+	int concurrency_min   = 8;
+	int concurrency_max   = 1024;
 
 	int auth_timeout = 30;
+	// Seconds an upgraded-away process waits for its connections
+	int drain_timeout = 30;
+	// Seconds without connections before a socket-activated server exits
+	// (0 = never)
+	int idle_exit = 0;
+
+	// Worker processes sharing the listener (0 = serve in this process)
+	int workers = 0;
+	// Connections a worker accepts before it is replaced (0 = no limit)
+	int worker_max_connections = 0;
 
 	std::string log_level = "info";
 	std::string log_file;
 
+	std::string metrics_socket;
+	// Unix socket path, or host:port for TCP, answering /livez and /readyz
+	std::string health_listen;
+
+	std::string trace_file;
+	bool	    trace_enabled = false;
+
 	std::optional<std::string> secret;
 	std::optional<std::string> secret_file;
 	std::optional<std::string> secret_env;
-	bool			   secret_encrypted = false;
+	bool			   secret_encrypted  = false;
+	bool			   passphrase_prompt = false;
+
+	// Named secrets for "get <name>", one file each
+	std::string secrets_dir;
+
+	// ssh-drop subsystem sessions
+	int session_idle_timeout = 300;
+	int session_max_requests = 10000;
+
+	// WATCH pushes; 0 subscribers turns watching off
+	int watch_max_subscribers = 4096;
+	int watch_stall_timeout	  = 30;
 
 	std::string auth_method;
 
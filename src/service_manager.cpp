@@ -0,0 +1,78 @@
+#include "service_manager.h"
+
+#ifdef __linux__
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#include <string>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace drop::service {
+
+#ifdef __linux__
+namespace {
+
+// Where systemd places the first passed descriptor
+constexpr int kListenFdsStart = 3;
+
+} // namespace
+#endif
+
+void notify(std::string_view state) noexcept
+{
+#ifdef __linux__
+	const char* path = std::getenv("NOTIFY_SOCKET");
+	if (!path || !*path)
+		return;
+
+	sockaddr_un	  addr{};
+	const std::size_t len = std::strlen(path);
+	if (len >= sizeof(addr.sun_path))
+		return;
+	addr.sun_family = AF_UNIX;
+	std::memcpy(addr.sun_path, path, len);
+	// A leading '@' names a socket in the abstract namespace
+	if (addr.sun_path[0] == '@')
+		addr.sun_path[0] = '\0';
+
+	const int fd = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return;
+	(void)::sendto(fd, state.data(), state.size(), MSG_NOSIGNAL,
+		       reinterpret_cast<const sockaddr*>(&addr),
+		       static_cast<socklen_t>(offsetof(sockaddr_un, sun_path)
+					      + len));
+	::close(fd);
+#else
+	(void)state;
+#endif
+}
+
+std::vector<int> listen_fds()
+{
+	std::vector<int> fds;
+#ifdef __linux__
+	const char* pid	  = std::getenv("LISTEN_PID");
+	const char* count = std::getenv("LISTEN_FDS");
+	const bool  ours  = pid && count
+			  && std::to_string(::getpid()) == pid;
+	const int   n	  = ours ? std::atoi(count) : 0;
+	::unsetenv("LISTEN_PID");
+	::unsetenv("LISTEN_FDS");
+	::unsetenv("LISTEN_FDNAMES");
+
+	for (int fd = kListenFdsStart; fd < kListenFdsStart + n; ++fd) {
+		(void)::fcntl(fd, F_SETFD, FD_CLOEXEC);
+		fds.push_back(fd);
+	}
+#endif
+	return fds;
+}
+
+} // namespace drop::service
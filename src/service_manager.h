@@ -0,0 +1,20 @@
+#ifndef SSH_DROP_SERVICE_MANAGER_H_
+#define SSH_DROP_SERVICE_MANAGER_H_
+
+#include <string_view>
+#include <vector>
+
+namespace drop::service {
+
+// Sends a state line ("READY=1", "MAINPID=...") to systemd when it started
+// us with Type=notify; does nothing otherwise.
+void notify(std::string_view state) noexcept;
+
+// Listening sockets passed by socket activation (LISTEN_FDS), meant for
+// this process (LISTEN_PID). Consumes them: the variables are cleared so
+// no process started later takes them for its own.
+[[nodiscard]] std::vector<int> listen_fds();
+
+} // namespace drop::service
+
+#endif // SSH_DROP_SERVICE_MANAGER_H_
@@ -0,0 +1,51 @@
+#include "session_protocol.h"
+
+#include <stdexcept>
+
+namespace drop::protocol {
+
+std::string frame(std::string_view payload)
+{
+	const auto  len = static_cast<std::uint32_t>(payload.size());
+	std::string out;
+	out.reserve(4 + payload.size());
+	out += static_cast<char>(len >> 24);
+	out += static_cast<char>(len >> 16);
+	out += static_cast<char>(len >> 8);
+	out += static_cast<char>(len);
+	out += payload;
+	return out;
+}
+
+std::string reply(Status status, std::string_view data)
+{
+	std::string payload;
+	payload.reserve(1 + data.size());
+	payload += static_cast<char>(status);
+	payload += data;
+	return frame(payload);
+}
+
+std::optional<std::string> read_frame(SshChannel& channel,
+				      std::size_t max_len, int timeout_ms)
+{
+	const auto header = channel.read_exact(4, timeout_ms);
+	if (header.empty())
+		return std::nullopt;
+	if (header.size() < 4)
+		throw std::runtime_error{"Truncated frame header"};
+
+	std::size_t len = 0;
+	for (char c : header)
+		len = (len << 8) | static_cast<unsigned char>(c);
+	if (len > max_len)
+		throw std::runtime_error{"Frame too long: "
+					 + std::to_string(len)};
+
+	auto payload = channel.read_exact(len, timeout_ms);
+	if (payload.size() < len)
+		throw std::runtime_error{"Truncated frame"};
+	return payload;
+}
+
+} // namespace drop::protocol
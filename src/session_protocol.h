@@ -0,0 +1,49 @@
+#ifndef SSH_DROP_SESSION_PROTOCOL_H_
+#define SSH_DROP_SESSION_PROTOCOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "ssh_types.h"
+
+// Request/response protocol of the "ssh-drop" subsystem, for clients that
+// keep one session open and fetch repeatedly. Every message is a frame: a
+// 4-byte big-endian length, then that many bytes. Requests are text:
+//
+//	GET		the default secret
+//	GET <name>	a secret from secrets_dir
+//	LIST		names in secrets_dir, one per line
+//	PING		empty reply
+//	WATCH		the default secret, then a reply frame again every
+//			time it changes; the client sends nothing more
+//
+// A reply starts with a status byte, then the value or an error message.
+// An error leaves the session open. WATCH gets an error when watching is
+// off or full; if the hub fills up while the session is being handed to
+// it, that error is the last frame and the channel is closed after it.
+namespace drop::protocol {
+
+constexpr auto kSubsystem = "ssh-drop";
+
+// Requests are short; anything longer is a broken or hostile client
+constexpr std::size_t kMaxRequest = 4096;
+
+enum class Status : std::uint8_t {
+	ok    = 0,
+	error = 1
+};
+
+[[nodiscard]] std::string frame(std::string_view payload);
+[[nodiscard]] std::string reply(Status status, std::string_view data);
+
+// Nullopt when the channel hits EOF or idles past the timeout between
+// frames. Throws on a frame over max_len or cut off midway.
+[[nodiscard]] std::optional<std::string>
+read_frame(SshChannel& channel, std::size_t max_len, int timeout_ms);
+
+} // namespace drop::protocol
+
+#endif // SSH_DROP_SESSION_PROTOCOL_H_
@@ -10,7 +10,10 @@ namespace drop {
 
 namespace {
 
+constexpr int kSignalCount = 4;
+
 std::atomic<bool>* g_running = nullptr;
+std::atomic<bool>  g_pending[kSignalCount];
 
 #ifdef _WIN32
 BOOL WINAPI console_handler(DWORD event)
@@ -31,6 +34,28 @@ void signal_handler(int sig)
 	if (g_running)
 		g_running->store(false, std::memory_order_relaxed);
 }
+
+void request_handler(int sig)
+{
+	Signal req;
+	switch (sig) {
+	case SIGUSR2:
+		req = Signal::toggle_trace;
+		break;
+	case SIGUSR1:
+		req = Signal::dump_recorder;
+		break;
+	case SIGHUP:
+		req = Signal::reload;
+		break;
+	case SIGQUIT:
+		req = Signal::upgrade;
+		break;
+	default:
+		return;
+	}
+	g_pending[static_cast<int>(req)].store(true, std::memory_order_relaxed);
+}
 #endif
 
 } // namespace
@@ -48,6 +73,15 @@ SignalGuard::SignalGuard(std::atomic<bool>& running)
 	sa.sa_flags = 0;
 	sigaction(SIGINT, &sa, nullptr);
 	sigaction(SIGTERM, &sa, nullptr);
+
+	struct sigaction req{};
+	req.sa_handler = request_handler;
+	sigemptyset(&req.sa_mask);
+	req.sa_flags = SA_RESTART;
+	sigaction(SIGUSR2, &req, nullptr);
+	sigaction(SIGUSR1, &req, nullptr);
+	sigaction(SIGHUP, &req, nullptr);
+	sigaction(SIGQUIT, &req, nullptr);
 #endif
 }
 
@@ -58,8 +92,18 @@ SignalGuard::~SignalGuard()
 #else
 	signal(SIGINT, SIG_DFL);
 	signal(SIGTERM, SIG_DFL);
+	signal(SIGUSR2, SIG_DFL);
+	signal(SIGUSR1, SIG_DFL);
+	signal(SIGHUP, SIG_DFL);
+	signal(SIGQUIT, SIG_DFL);
 #endif
 	g_running = nullptr;
 }
 
+bool SignalGuard::consume(Signal sig) noexcept
+{
+	return g_pending[static_cast<int>(sig)].exchange(
+			false, std::memory_order_relaxed);
+}
+
 } // namespace drop
@@ -5,6 +5,14 @@
 
 namespace drop {
 
+// Signals that ask the main loop to do something instead of shutting down.
+enum class Signal {
+	toggle_trace,  // SIGUSR2
+	dump_recorder, // SIGUSR1
+	reload,	       // SIGHUP
+	upgrade	       // SIGQUIT
+};
+
 class SignalGuard {
 public:
 	explicit SignalGuard(std::atomic<bool>& running);
@@ -14,6 +22,9 @@ public:
 	SignalGuard& operator=(const SignalGuard&) = delete;
 	SignalGuard(SignalGuard&&)		   = delete;
 	SignalGuard& operator=(SignalGuard&&)	   = delete;
+
+	// True once for each delivery of `sig` since the previous call.
+	[[nodiscard]] static bool consume(Signal sig) noexcept;
 };
 
 } // namespace drop
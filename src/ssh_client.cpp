@@ -0,0 +1,246 @@
+#include "ssh_client.h"
+
+#include <cstdint>
+#include <stdexcept>
+
+#include "session_protocol.h"
+#include "ssh_error.h"
+
+namespace drop {
+
+void SshClient::connect(const std::string& host, int port,
+			const std::string& user, int timeout_s)
+{
+	ssh_session s = session_.get();
+
+	ssh_options_set(s, SSH_OPTIONS_HOST, host.c_str());
+	ssh_options_set(s, SSH_OPTIONS_PORT, &port);
+	set_common_options(user, timeout_s);
+
+	if (ssh_connect(s) != SSH_OK)
+		throw SshError::from(s, "Connect to " + host + " failed");
+}
+
+void SshClient::connect_fd(socket_t fd, const std::string& user,
+			   int timeout_s, const std::string& host, int port)
+{
+	ssh_session s = session_.get();
+
+	// libssh still wants a host name for its own bookkeeping
+	ssh_options_set(s, SSH_OPTIONS_HOST, host.c_str());
+	ssh_options_set(s, SSH_OPTIONS_PORT, &port);
+	ssh_options_set(s, SSH_OPTIONS_FD, &fd);
+	set_common_options(user, timeout_s);
+
+	if (ssh_connect(s) != SSH_OK)
+		throw SshError::from(s, "Handshake over fd failed");
+}
+
+void SshClient::verify_host_key(const std::string& known_hosts)
+{
+	ssh_session s = session_.get();
+
+	if (!known_hosts.empty())
+		ssh_options_set(s, SSH_OPTIONS_KNOWNHOSTS, known_hosts.c_str());
+
+	switch (ssh_session_is_known_server(s)) {
+	case SSH_KNOWN_HOSTS_OK:
+		return;
+	case SSH_KNOWN_HOSTS_CHANGED:
+	case SSH_KNOWN_HOSTS_OTHER:
+		throw SshError{"Host key does not match known_hosts"};
+	case SSH_KNOWN_HOSTS_UNKNOWN:
+	case SSH_KNOWN_HOSTS_NOT_FOUND:
+		throw SshError{"Host key not in known_hosts"};
+	default:
+		throw SshError::from(s, "Host key check failed");
+	}
+}
+
+bool SshClient::auth_pubkey(ssh_key private_key)
+{
+	return handle_auth_result(
+			ssh_userauth_publickey(session_.get(), nullptr,
+					       private_key),
+			"Public key authentication");
+}
+
+bool SshClient::auth_agent()
+{
+	return handle_auth_result(ssh_userauth_agent(session_.get(), nullptr),
+				  "Agent authentication");
+}
+
+bool SshClient::auth_password(const std::string& password)
+{
+	return handle_auth_result(ssh_userauth_password(session_.get(),
+							nullptr,
+							password.c_str()),
+				  "Password authentication");
+}
+
+bool SshClient::auth_kbdint(const std::string& answer)
+{
+	ssh_session s  = session_.get();
+	int	    rc = ssh_userauth_kbdint(s, nullptr, nullptr);
+
+	// The server may send several rounds, some with no prompts at all
+	while (rc == SSH_AUTH_INFO) {
+		const int prompts = ssh_userauth_kbdint_getnprompts(s);
+		for (int i = 0; i < prompts; ++i)
+			if (ssh_userauth_kbdint_setanswer(
+					    s, static_cast<unsigned>(i),
+					    answer.c_str())
+			    < 0)
+				throw SshError::from(
+						s, "Could not answer prompt");
+		rc = ssh_userauth_kbdint(s, nullptr, nullptr);
+	}
+
+	return handle_auth_result(rc, "Keyboard-interactive authentication");
+}
+
+SshChannel SshClient::open_shell()
+{
+	SshChannel channel{ssh_channel_new(session_.get())};
+	channel.open_session();
+	channel.request_shell();
+	return channel;
+}
+
+SshChannel SshClient::open_subsystem()
+{
+	SshChannel channel{ssh_channel_new(session_.get())};
+	channel.open_session();
+	channel.request_subsystem(protocol::kSubsystem);
+	return channel;
+}
+
+std::string SshClient::request(SshChannel& channel, std::string_view request,
+			       int timeout_ms)
+{
+	channel.write(protocol::frame(request));
+	return read_reply(channel, timeout_ms);
+}
+
+std::string SshClient::read_reply(SshChannel& channel, int timeout_ms)
+{
+	auto reply = protocol::read_frame(channel, SIZE_MAX, timeout_ms);
+	if (!reply || reply->empty())
+		throw SshError{"No reply from server"};
+
+	const auto status = static_cast<protocol::Status>((*reply)[0]);
+	reply->erase(0, 1);
+	if (status != protocol::Status::ok)
+		throw std::runtime_error{"Server error: " + *reply};
+	return std::move(*reply);
+}
+
+std::string SshClient::fetch(std::string_view passphrase, int timeout_ms)
+{
+	SshChannel channel = open_shell();
+
+	if (!passphrase.empty()) {
+		std::string line{passphrase};
+		line += '\n';
+		channel.write(line);
+	}
+
+	return channel.read_all(timeout_ms);
+}
+
+std::string SshClient::fetch_exec(const std::string& command,
+				  std::string_view   passphrase,
+				  int		     timeout_ms)
+{
+	SshChannel channel{ssh_channel_new(session_.get())};
+	channel.open_session();
+	channel.request_exec(command);
+
+	if (!passphrase.empty()) {
+		std::string line{passphrase};
+		line += '\n';
+		channel.write(line);
+	}
+
+	auto	  secret = channel.read_all(timeout_ms);
+	const int status = channel.exit_status();
+	if (status != 0)
+		throw SshError{"'" + command + "' exited with status "
+			       + std::to_string(status)};
+	return secret;
+}
+
+std::vector<std::pair<std::string, std::string>>
+SshClient::fetch_batch(const std::vector<std::string>& names,
+		       std::string_view passphrase, int timeout_ms)
+{
+	std::string command = "get";
+	for (const auto& name : names)
+		command += ' ' + name;
+
+	auto reply = fetch_exec(command, passphrase, timeout_ms);
+
+	// One name comes back as the bare value
+	std::vector<std::pair<std::string, std::string>> secrets;
+	if (names.size() == 1) {
+		secrets.emplace_back(names.front(), std::move(reply));
+		return secrets;
+	}
+
+	// Otherwise "<name> <length>\n<bytes>\n" per secret
+	std::string_view rest = reply;
+	while (!rest.empty()) {
+		const auto space = rest.find(' ');
+		const auto eol	 = rest.find('\n');
+		if (space == std::string_view::npos || eol < space)
+			throw std::runtime_error{"Malformed batch reply"};
+
+		std::size_t len = 0;
+		for (char c : rest.substr(space + 1, eol - space - 1)) {
+			if (c < '0' || c > '9')
+				throw std::runtime_error{
+						"Malformed batch reply"};
+			len = len * 10 + static_cast<std::size_t>(c - '0');
+		}
+		const auto value = eol + 1;
+		if (len >= rest.size() - value || rest[value + len] != '\n')
+			throw std::runtime_error{"Malformed batch reply"};
+
+		secrets.emplace_back(rest.substr(0, space),
+				     rest.substr(value, len));
+		rest.remove_prefix(value + len + 1);
+	}
+	return secrets;
+}
+
+void SshClient::set_common_options(const std::string& user, int timeout_s)
+{
+	ssh_session s	      = session_.get();
+	const long  timeout   = timeout_s;
+	const int   no_config = 0;
+
+	ssh_options_set(s, SSH_OPTIONS_TIMEOUT, &timeout);
+	// Skip ~/.ssh/config parsing; every option is set explicitly
+	ssh_options_set(s, SSH_OPTIONS_PROCESS_CONFIG, &no_config);
+	if (!user.empty())
+		ssh_options_set(s, SSH_OPTIONS_USER, user.c_str());
+}
+
+bool SshClient::handle_auth_result(int rc, const char* method)
+{
+	switch (rc) {
+	case SSH_AUTH_SUCCESS:
+		authenticated_ = true;
+		return true;
+	case SSH_AUTH_PARTIAL:
+		return true;
+	case SSH_AUTH_DENIED:
+		return false;
+	default:
+		throw SshError::from(session_.get(),
+				     std::string{method} + " failed");
+	}
+}
+
+} // namespace drop
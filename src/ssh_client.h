@@ -0,0 +1,91 @@
+#ifndef SSH_DROP_SSH_CLIENT_H_
+#define SSH_DROP_SSH_CLIENT_H_
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <libssh/libssh.h>
+
+#include "ssh_types.h"
+
+namespace drop {
+
+// Client side of the drop protocol: connect, authenticate, open a session
+// channel, optionally send the passphrase line, and read until EOF.
+class SshClient {
+public:
+	SshClient() = default;
+
+	void connect(const std::string& host, int port, const std::string& user,
+		     int timeout_s);
+	// Runs the handshake over an already-connected socket, which the
+	// session then owns. host and port name the server in known_hosts.
+	void connect_fd(socket_t fd, const std::string& user, int timeout_s,
+			const std::string& host = "localhost", int port = 22);
+
+	// Throws unless the server's key is listed in known_hosts (empty for
+	// libssh's default, ~/.ssh/known_hosts).
+	void verify_host_key(const std::string& known_hosts);
+
+	// Return false when the server denies the method. Partial success
+	// (multi-factor) returns true but leaves authenticated() false until
+	// the remaining method succeeds.
+	bool auth_pubkey(ssh_key private_key);
+	// Offers each key held by the agent at SSH_AUTH_SOCK.
+	bool auth_agent();
+	bool auth_password(const std::string& password);
+	// Answers every prompt with the same string: the server only ever
+	// asks for the passphrase.
+	bool auth_kbdint(const std::string& answer);
+
+	[[nodiscard]] bool authenticated() const noexcept
+	{
+		return authenticated_;
+	}
+
+	// Session channel with a shell requested, nothing sent yet.
+	SshChannel open_shell();
+
+	std::string fetch(std::string_view passphrase, int timeout_ms);
+
+	// Same over an exec request ("get", "get <name>"): no shell round
+	// trip. Throws when the server reports a non-zero exit status.
+	std::string fetch_exec(const std::string& command,
+			       std::string_view passphrase, int timeout_ms);
+
+	// Several named secrets over one exec request ("get a b c"), in the
+	// order asked: one handshake for the lot.
+	std::vector<std::pair<std::string, std::string>>
+	fetch_batch(const std::vector<std::string>& names,
+		    std::string_view passphrase, int timeout_ms);
+
+	// Channel on the ssh-drop subsystem, kept open for any number of
+	// request() calls.
+	SshChannel open_subsystem();
+
+	// One request ("GET", "GET <name>", "LIST", "PING") and its reply.
+	// Throws when the server answers with an error.
+	std::string request(SshChannel& channel, std::string_view request,
+			    int timeout_ms);
+
+	// The next reply on a subsystem channel; after WATCH, the next push.
+	std::string read_reply(SshChannel& channel, int timeout_ms);
+
+	SshSession& session() noexcept
+	{
+		return session_;
+	}
+
+private:
+	void set_common_options(const std::string& user, int timeout_s);
+	bool handle_auth_result(int rc, const char* method);
+
+	SshSession session_;
+	bool	   authenticated_ = false;
+};
+
+} // namespace drop
+
+#endif // SSH_DROP_SSH_CLIENT_H_
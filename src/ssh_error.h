@@ -1,6 +1,8 @@
 #ifndef SSH_DROP_SSH_ERROR_H_
 #define SSH_DROP_SSH_ERROR_H_
 
+#include <cerrno>
+#include <exception>
 #include <stdexcept>
 #include <string>
 
@@ -10,15 +12,37 @@ namespace drop {
 
 class SshError : public std::runtime_error {
 public:
-	using std::runtime_error::runtime_error;
+	// os_error is the errno the failing call left, 0 when it was not a
+	// system error; by the time a catch block runs errno is anyone's.
+	explicit SshError(const std::string& what, int os_error = 0)
+	    : std::runtime_error{what},
+	      os_error_{os_error}
+	{
+	}
 
 	template<typename T>
 	static SshError from(T handle, const std::string& context)
 	{
-		return SshError{context + ": " + ssh_get_error(handle)};
+		const int err = errno;
+		return SshError{context + ": " + ssh_get_error(handle), err};
 	}
+
+	[[nodiscard]] int os_error() const noexcept
+	{
+		return os_error_;
+	}
+
+private:
+	int os_error_ = 0;
 };
 
+// The errno an SshError captured, 0 for any other exception
+[[nodiscard]] inline int os_error_of(const std::exception& e) noexcept
+{
+	const auto* ssh = dynamic_cast<const SshError*>(&e);
+	return ssh ? ssh->os_error() : 0;
+}
+
 } // namespace drop
 
 #endif // SSH_DROP_SSH_ERROR_H_
@@ -1,15 +1,61 @@
 #include "ssh_types.h"
 
+#include <algorithm>
 #include <utility>
 
 #ifdef _WIN32
 #include <winsock2.h>
+#include <ws2tcpip.h>
 #else
+#include <cerrno>
+#include <fcntl.h>
 #include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
 #endif
 
 namespace drop {
 
+namespace {
+
+void set_socket_blocking(socket_t fd, bool blocking)
+{
+#ifdef _WIN32
+	u_long nonblocking = blocking ? 0 : 1;
+	if (ioctlsocket(fd, FIONBIO, &nonblocking) != 0)
+		throw SshError{"ioctlsocket(FIONBIO) failed"};
+#else
+	const int flags = fcntl(fd, F_GETFL);
+	if (flags < 0
+	    || fcntl(fd, F_SETFL,
+		     blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK)
+		       != 0)
+		throw SshError{"fcntl(F_SETFL) failed", errno};
+#endif
+}
+
+} // namespace
+
+SshKeyPtr load_private_key(const std::string& path)
+{
+	ssh_key raw = nullptr;
+	if (ssh_pki_import_privkey_file(path.c_str(), nullptr, nullptr,
+					nullptr, &raw)
+		    != SSH_OK
+	    || raw == nullptr)
+		throw SshError{"Could not load private key: " + path};
+	return SshKeyPtr{raw};
+}
+
+void close_socket(socket_t fd) noexcept
+{
+#ifdef _WIN32
+	closesocket(fd);
+#else
+	close(fd);
+#endif
+}
+
 SshSession::SshSession()
     : session_{ssh_new()}
 {
@@ -53,6 +99,31 @@ void SshSession::set_auth_methods(int methods)
 	ssh_set_auth_methods(session_, methods);
 }
 
+void SshSession::set_message_callback(int (*cb)(ssh_session, ssh_message,
+						 void*),
+				      void* userdata)
+{
+	ssh_set_message_callback(session_, cb, userdata);
+}
+
+void SshSession::clear_callbacks()
+{
+	// libssh checks the size field before looking at any member
+	static ssh_server_callbacks_struct none = [] {
+		ssh_server_callbacks_struct cb = {};
+		ssh_callbacks_init(&cb);
+		return cb;
+	}();
+
+	ssh_set_server_callbacks(session_, &none);
+	ssh_set_message_callback(session_, nullptr, nullptr);
+}
+
+void SshSession::set_blocking(bool blocking)
+{
+	ssh_set_blocking(session_, blocking ? 1 : 0);
+}
+
 void SshSession::handle_key_exchange()
 {
 	if (ssh_handle_key_exchange(session_) != SSH_OK)
@@ -73,7 +144,8 @@ SshBind::~SshBind()
 }
 
 SshBind::SshBind(SshBind&& other) noexcept
-    : bind_{std::exchange(other.bind_, nullptr)}
+    : bind_{std::exchange(other.bind_, nullptr)},
+      key_types_{std::move(other.key_types_)}
 {
 }
 
@@ -82,7 +154,8 @@ SshBind& SshBind::operator=(SshBind&& other) noexcept
 	if (this != &other) {
 		if (bind_)
 			ssh_bind_free(bind_);
-		bind_ = std::exchange(other.bind_, nullptr);
+		bind_	   = std::exchange(other.bind_, nullptr);
+		key_types_ = std::move(other.key_types_);
 	}
 	return *this;
 }
@@ -97,15 +170,81 @@ void SshBind::set_port(const std::string& port)
 
 void SshBind::set_host_key(const std::string& path)
 {
-	if (ssh_bind_options_set(bind_, SSH_BIND_OPTIONS_HOSTKEY, path.c_str())
+	// Parse once here; every accepted session gets the in-memory key
+	// instead of libssh going back to the file.
+	set_host_key(load_private_key(path), path);
+}
+
+void SshBind::set_host_key(SshKeyPtr key, const std::string& name)
+{
+	const auto type = ssh_key_type(key.get());
+
+	// libssh keeps one key per type and would silently replace it
+	if (std::find(key_types_.begin(), key_types_.end(), type)
+	    != key_types_.end())
+		throw SshError{std::string{"Duplicate "}
+			       + ssh_key_type_to_char(type)
+			       + " host key: " + name};
+
+	if (ssh_bind_options_set(bind_, SSH_BIND_OPTIONS_IMPORT_KEY, key.get())
 	    != SSH_OK)
 		throw SshError::from(bind_, "Failed to set host key");
+
+	// The bind owns the key from here on
+	(void)key.release();
+	key_types_.push_back(type);
+}
+
+void SshBind::reset_host_keys() noexcept
+{
+	key_types_.clear();
+}
+
+void SshBind::set_list(ssh_bind_options_e option, const std::string& list,
+		       const char* what)
+{
+	if (ssh_bind_options_set(bind_, option, list.c_str()) != SSH_OK)
+		throw SshError::from(bind_, std::string{"Unsupported "} + what
+						    + ": " + list);
+}
+
+void SshBind::set_kex_algorithms(const std::string& list)
+{
+	set_list(SSH_BIND_OPTIONS_KEY_EXCHANGE, list, "kex_algorithms");
+}
+
+void SshBind::set_ciphers(const std::string& list)
+{
+	set_list(SSH_BIND_OPTIONS_CIPHERS_C_S, list, "ciphers");
+	set_list(SSH_BIND_OPTIONS_CIPHERS_S_C, list, "ciphers");
+}
+
+void SshBind::set_macs(const std::string& list)
+{
+	set_list(SSH_BIND_OPTIONS_HMAC_C_S, list, "macs");
+	set_list(SSH_BIND_OPTIONS_HMAC_S_C, list, "macs");
+}
+
+void SshBind::set_hostkey_algorithms(const std::string& list)
+{
+	set_list(SSH_BIND_OPTIONS_HOSTKEY_ALGORITHMS, list,
+		 "hostkey_algorithms");
 }
 
 void SshBind::listen()
 {
 	if (ssh_bind_listen(bind_) < 0)
 		throw SshError::from(bind_, "Error listening");
+
+	// Every worker sharing the listener wakes for a connection but only
+	// one gets it; the rest must find accept() empty, not block in it
+	set_socket_blocking(ssh_bind_get_fd(bind_), false);
+}
+
+void SshBind::listen_on(socket_t fd)
+{
+	ssh_bind_set_fd(bind_, fd);
+	listen();
 }
 
 void SshBind::accept(SshSession& session)
@@ -114,7 +253,7 @@ void SshBind::accept(SshSession& session)
 		throw SshError::from(bind_, "Error accepting");
 }
 
-bool SshBind::accept(SshSession& session, int timeout_ms)
+bool SshBind::wait_for_connection(int timeout_ms)
 {
 	socket_t fd = ssh_bind_get_fd(bind_);
 	if (fd == SSH_INVALID_SOCKET)
@@ -130,17 +269,66 @@ bool SshBind::accept(SshSession& session, int timeout_ms)
 
 	int rc = select(static_cast<int>(fd) + 1, &read_fds, nullptr, nullptr,
 			&tv);
-	if (rc < 0)
-		throw SshError{"select() failed on bind fd"};
-	if (rc == 0)
+#ifndef _WIN32
+	// A signal landed on this thread; let the caller re-check its state
+	if (rc < 0 && errno == EINTR)
 		return false;
+#endif
+	if (rc < 0)
+		throw SshError{"select() failed on bind fd", errno};
 
-	if (ssh_bind_accept(bind_, session.get()) != SSH_OK)
-		throw SshError::from(bind_, "Error accepting");
+	return rc > 0;
+}
+
+bool SshBind::accept(SshSession& session, int timeout_ms)
+{
+	if (!wait_for_connection(timeout_ms))
+		return false;
 
+	accept(session);
 	return true;
 }
 
+socket_t SshBind::accept_socket(sockaddr_storage& peer)
+{
+	socket_t fd = ssh_bind_get_fd(bind_);
+	if (fd == SSH_INVALID_SOCKET)
+		throw SshError{"ssh_bind has no valid fd"};
+
+	socklen_t len	 = sizeof(peer);
+	socket_t  client = ::accept(fd, reinterpret_cast<sockaddr*>(&peer),
+				    &len);
+#ifdef _WIN32
+	if (client == SSH_INVALID_SOCKET
+	    && WSAGetLastError() == WSAEWOULDBLOCK)
+		return SSH_INVALID_SOCKET;
+#else
+	if (client == SSH_INVALID_SOCKET
+	    && (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN
+		|| errno == EWOULDBLOCK))
+		return SSH_INVALID_SOCKET;
+#endif
+	if (client == SSH_INVALID_SOCKET)
+		throw SshError{"accept() failed on bind fd", errno};
+
+#ifndef __linux__
+	// Elsewhere the client inherits the listener's non-blocking mode
+	try {
+		set_socket_blocking(client, true);
+	} catch (...) {
+		close_socket(client);
+		throw;
+	}
+#endif
+	return client;
+}
+
+void SshBind::accept_fd(SshSession& session, socket_t fd)
+{
+	if (ssh_bind_accept_fd(bind_, session.get(), fd) != SSH_OK)
+		throw SshError::from(bind_, "Error accepting fd");
+}
+
 SshChannel::SshChannel(ssh_channel raw)
     : channel_{raw}
 {
@@ -179,6 +367,39 @@ void SshChannel::set_callbacks(ssh_channel_callbacks cb)
 		throw SshError{"Failed to set channel callbacks"};
 }
 
+void SshChannel::remove_callbacks(ssh_channel_callbacks cb)
+{
+	ssh_remove_channel_callbacks(channel_, cb);
+}
+
+void SshChannel::open_session()
+{
+	if (ssh_channel_open_session(channel_) != SSH_OK)
+		throw SshError::from(ssh_channel_get_session(channel_),
+				     "Failed to open session channel");
+}
+
+void SshChannel::request_shell()
+{
+	if (ssh_channel_request_shell(channel_) != SSH_OK)
+		throw SshError::from(ssh_channel_get_session(channel_),
+				     "Shell request failed");
+}
+
+void SshChannel::request_exec(const std::string& command)
+{
+	if (ssh_channel_request_exec(channel_, command.c_str()) != SSH_OK)
+		throw SshError::from(ssh_channel_get_session(channel_),
+				     "Exec request failed");
+}
+
+void SshChannel::request_subsystem(const std::string& name)
+{
+	if (ssh_channel_request_subsystem(channel_, name.c_str()) != SSH_OK)
+		throw SshError::from(ssh_channel_get_session(channel_),
+				     "Subsystem request failed");
+}
+
 std::string SshChannel::read(int timeout_ms)
 {
 	std::string result;
@@ -188,7 +409,7 @@ std::string SshChannel::read(int timeout_ms)
 		const int n = ssh_channel_read_timeout(
 				channel_, buf, sizeof(buf), 0, timeout_ms);
 		if (n < 0)
-			throw SshError{"Channel read failed"};
+			throw SshError{"Channel read failed", errno};
 		if (n == 0)
 			break;
 
@@ -209,17 +430,85 @@ std::string SshChannel::read(int timeout_ms)
 	return result;
 }
 
+std::string SshChannel::read_all(int timeout_ms)
+{
+	std::string result;
+	char	    buf[4096];
+
+	for (;;) {
+		const int n = ssh_channel_read_timeout(
+				channel_, buf, sizeof(buf), 0, timeout_ms);
+		if (n < 0)
+			throw SshError{"Channel read failed", errno};
+		if (n == 0) {
+			if (ssh_channel_is_eof(channel_))
+				break;
+			throw SshError{"Channel read timed out"};
+		}
+
+		result.append(buf, static_cast<std::size_t>(n));
+	}
+
+	return result;
+}
+
+std::string SshChannel::read_exact(std::size_t n, int timeout_ms)
+{
+	std::string result(n, '\0');
+	std::size_t got = 0;
+
+	while (got < n) {
+		const auto want = static_cast<uint32_t>(
+				std::min<std::size_t>(n - got, 65536));
+		const int got_now = ssh_channel_read_timeout(
+				channel_, result.data() + got, want, 0,
+				timeout_ms);
+		if (got_now < 0)
+			throw SshError{"Channel read failed", errno};
+		if (got_now == 0)
+			break;
+		got += static_cast<std::size_t>(got_now);
+	}
+
+	result.resize(got);
+	return result;
+}
+
+bool SshChannel::wait_readable(int timeout_ms)
+{
+	const int rc = ssh_channel_poll_timeout(channel_, timeout_ms, 0);
+	if (rc == SSH_ERROR)
+		throw SshError{"Channel poll failed", errno};
+	return rc != 0;
+}
+
 void SshChannel::write(std::string_view data)
 {
 	ssh_channel_write(channel_, data.data(),
 			  static_cast<uint32_t>(data.size()));
 }
 
+void SshChannel::write_stderr(std::string_view data)
+{
+	ssh_channel_write_stderr(channel_, data.data(),
+				 static_cast<uint32_t>(data.size()));
+}
+
 void SshChannel::send_eof()
 {
 	ssh_channel_send_eof(channel_);
 }
 
+void SshChannel::send_exit_status(int status)
+{
+	ssh_channel_request_send_exit_status(channel_, status);
+}
+
+int SshChannel::exit_status()
+{
+	return ssh_channel_get_exit_status(channel_);
+}
+
 void SshChannel::close()
 {
 	ssh_channel_close(channel_);
@@ -259,6 +548,11 @@ void SshEvent::add_session(SshSession& session)
 		throw SshError{"Failed to add session to event loop"};
 }
 
+void SshEvent::remove_session(SshSession& session)
+{
+	ssh_event_remove_session(event_, session.get());
+}
+
 int SshEvent::poll(int timeout_ms)
 {
 	return ssh_event_dopoll(event_, timeout_ms);
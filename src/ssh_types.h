@@ -1,21 +1,30 @@
 #ifndef SSH_DROP_SSH_TYPES_H_
 #define SSH_DROP_SSH_TYPES_H_
 
+#include <cstddef>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include <libssh/callbacks.h>
 #include <libssh/server.h>
 
 #include "ssh_error.h"
 
+struct sockaddr_storage;
+
 namespace drop {
 
 using SshKeyPtr = std::unique_ptr<ssh_key_struct, decltype([](ssh_key k) {
 					  ssh_key_free(k);
 				  })>;
 
+[[nodiscard]] SshKeyPtr load_private_key(const std::string& path);
+
+// closesocket() on Windows, close() elsewhere
+void close_socket(socket_t fd) noexcept;
+
 class SshSession {
 public:
 	SshSession();
@@ -28,6 +37,14 @@ public:
 
 	void set_server_callbacks(ssh_server_callbacks cb);
 	void set_auth_methods(int methods);
+	// For requests the server callbacks do not cover; the callback
+	// returns non-zero to have libssh send the default reply.
+	void set_message_callback(int (*cb)(ssh_session, ssh_message, void*),
+				  void* userdata);
+	// Drops the server and message callbacks, before the session moves
+	// to an owner that does not expect them.
+	void clear_callbacks();
+	void set_blocking(bool blocking);
 	void handle_key_exchange();
 
 	ssh_session get() const noexcept
@@ -50,10 +67,36 @@ public:
 	SshBind& operator=(const SshBind&) = delete;
 
 	void set_port(const std::string& port);
+	// Loads and parses the key immediately; throws if it is unreadable
+	// or a key of the same type was already set.
 	void set_host_key(const std::string& path);
+	// Same with a key loaded beforehand; name is for the error message.
+	void set_host_key(SshKeyPtr key, const std::string& name);
+	// Lets set_host_key() replace the keys already set, for a reload.
+	// libssh cannot drop a key, so a type left out stays until restart.
+	void reset_host_keys() noexcept;
+
+	// Comma-separated preference lists; throw if libssh rejects them.
+	void set_kex_algorithms(const std::string& list);
+	void set_ciphers(const std::string& list);
+	void set_macs(const std::string& list);
+	void set_hostkey_algorithms(const std::string& list);
+	// The listening socket is non-blocking: workers share it.
 	void listen();
+	// Serves a socket that is already bound and listening, one handed
+	// over by the previous process; the bind then owns it.
+	void listen_on(socket_t fd);
+	bool wait_for_connection(int timeout_ms);
 	void accept(SshSession& session);
 	bool accept(SshSession& session, int timeout_ms);
+	// Plain accept() on the listening socket, so the peer can be vetted
+	// before a session exists; hand the result to accept_fd(). Returns
+	// SSH_INVALID_SOCKET when the peer went away, a signal interrupted,
+	// or another process sharing the listener took the connection.
+	socket_t accept_socket(sockaddr_storage& peer);
+	// Sets up session on an already-connected socket; the session then
+	// owns fd.
+	void accept_fd(SshSession& session, socket_t fd);
 
 	ssh_bind get() const noexcept
 	{
@@ -61,7 +104,12 @@ public:
 	}
 
 private:
+	void set_list(ssh_bind_options_e option, const std::string& list,
+		      const char* what);
+
 	ssh_bind bind_ = nullptr;
+
+	std::vector<ssh_keytypes_e> key_types_;
 };
 
 class SshChannel {
@@ -75,9 +123,24 @@ public:
 	SshChannel& operator=(const SshChannel&) = delete;
 
 	void	    set_callbacks(ssh_channel_callbacks cb);
+	void	    remove_callbacks(ssh_channel_callbacks cb);
+	void	    open_session();
+	void	    request_shell();
+	void	    request_exec(const std::string& command);
+	void	    request_subsystem(const std::string& name);
 	std::string read(int timeout_ms);
+	std::string read_all(int timeout_ms);
+	// Up to n bytes; fewer only on EOF or when the timeout passes with
+	// nothing more arriving.
+	std::string read_exact(std::size_t n, int timeout_ms);
+	// True once there is data to read, or EOF; false on timeout.
+	bool	    wait_readable(int timeout_ms);
 	void	    write(std::string_view data);
+	void	    write_stderr(std::string_view data);
 	void	    send_eof();
+	void	    send_exit_status(int status);
+	// Waits for the peer's exit-status; -1 if it closed without one.
+	int	    exit_status();
 	void	    close();
 
 	ssh_channel get() const noexcept
@@ -100,6 +163,7 @@ public:
 	SshEvent& operator=(const SshEvent&) = delete;
 
 	void add_session(SshSession& session);
+	void remove_session(SshSession& session);
 	int  poll(int timeout_ms);
 
 private:
@@ -0,0 +1,134 @@
+#include "trace.h"
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace drop::trace {
+
+#ifndef SSH_DROP_NO_TRACING
+std::atomic<bool> g_enabled{false};
+#endif
+
+namespace {
+
+// Upper bound on buffered spans; anything beyond is counted and dropped.
+constexpr std::size_t kMaxEvents   = 1'000'000;
+constexpr std::size_t kFlushEvents = 1024;
+
+struct Event {
+	const char*   name;
+	std::uint64_t conn_id;
+	std::uint64_t begin_us;
+	std::uint64_t dur_us;
+	std::uint32_t tid;
+};
+
+const auto g_epoch = std::chrono::steady_clock::now();
+
+std::mutex		   g_mutex;
+std::vector<Event>	   g_events;
+std::uint64_t		   g_dropped = 0;
+std::atomic<std::uint32_t> g_next_tid{1};
+
+void flush(std::vector<Event>& events)
+{
+	if (events.empty())
+		return;
+
+	std::lock_guard lock{g_mutex};
+	for (const auto& e : events) {
+		if (g_events.size() >= kMaxEvents) {
+			g_dropped++;
+			continue;
+		}
+		g_events.push_back(e);
+	}
+	events.clear();
+}
+
+struct ThreadBuffer {
+	std::uint32_t tid = g_next_tid.fetch_add(1,
+						 std::memory_order_relaxed);
+	std::vector<Event> events;
+
+	~ThreadBuffer()
+	{
+		flush(events);
+	}
+};
+
+ThreadBuffer& local_buffer()
+{
+	thread_local ThreadBuffer buffer;
+	return buffer;
+}
+
+} // namespace
+
+void set_enabled(bool on) noexcept
+{
+#ifdef SSH_DROP_NO_TRACING
+	(void)on;
+#else
+	g_enabled.store(on, std::memory_order_relaxed);
+#endif
+}
+
+std::uint64_t now_us() noexcept
+{
+	return static_cast<std::uint64_t>(
+			std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::steady_clock::now()
+					- g_epoch)
+					.count());
+}
+
+void record(const char* name, std::uint64_t conn_id, std::uint64_t begin_us,
+	    std::uint64_t end_us)
+{
+	auto& buf = local_buffer();
+	buf.events.push_back(
+			{name, conn_id, begin_us, end_us - begin_us, buf.tid});
+	if (buf.events.size() >= kFlushEvents)
+		flush(buf.events);
+}
+
+void write_json(const std::string& path)
+{
+	flush(local_buffer().events);
+
+	std::vector<Event> events;
+	std::uint64_t	   dropped = 0;
+	{
+		std::lock_guard lock{g_mutex};
+		events.swap(g_events);
+		dropped	  = g_dropped;
+		g_dropped = 0;
+	}
+
+	std::ofstream out(path, std::ios::trunc);
+	if (!out.is_open())
+		throw std::runtime_error{"Could not open trace file: " + path};
+
+	out << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":"
+	    << dropped << "},\"traceEvents\":[";
+
+	bool first = true;
+	for (const auto& e : events) {
+		if (!first)
+			out << ',';
+		first = false;
+		out << "\n{\"name\":\"" << e.name
+		    << "\",\"cat\":\"conn\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+		    << e.tid << ",\"ts\":" << e.begin_us
+		    << ",\"dur\":" << e.dur_us << ",\"args\":{\"conn\":"
+		    << e.conn_id << "}}";
+	}
+
+	out << "\n]}\n";
+}
+
+} // namespace drop::trace
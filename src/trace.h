@@ -0,0 +1,68 @@
+#ifndef SSH_DROP_TRACE_H_
+#define SSH_DROP_TRACE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace drop::trace {
+
+#ifdef SSH_DROP_NO_TRACING
+constexpr bool enabled() noexcept
+{
+	return false;
+}
+#else
+extern std::atomic<bool> g_enabled;
+
+[[nodiscard]] inline bool enabled() noexcept
+{
+	return g_enabled.load(std::memory_order_relaxed);
+}
+#endif
+
+void set_enabled(bool on) noexcept;
+
+// Microseconds on a monotonic clock, relative to process start.
+[[nodiscard]] std::uint64_t now_us() noexcept;
+
+// `name` must have static storage duration.
+void record(const char* name, std::uint64_t conn_id, std::uint64_t begin_us,
+	    std::uint64_t end_us);
+
+// Writes every span collected so far as Chrome trace-event JSON and
+// clears the buffer. Spans still sitting in live threads' buffers are
+// picked up by the next call.
+void write_json(const std::string& path);
+
+class Span {
+public:
+	Span(const char* name, std::uint64_t conn_id) noexcept
+	    : name_{name},
+	      conn_id_{conn_id}
+	{
+		if (enabled()) [[unlikely]] {
+			active_	  = true;
+			begin_us_ = now_us();
+		}
+	}
+
+	~Span()
+	{
+		if (active_) [[unlikely]]
+			record(name_, conn_id_, begin_us_, now_us());
+	}
+
+	Span(const Span&)	     = delete;
+	Span& operator=(const Span&) = delete;
+
+private:
+	const char*   name_;
+	std::uint64_t conn_id_;
+	std::uint64_t begin_us_ = 0;
+	bool	      active_	= false;
+};
+
+} // namespace drop::trace
+
+#endif // SSH_DROP_TRACE_H_
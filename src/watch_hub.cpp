@@ -0,0 +1,280 @@
+#include "watch_hub.h"
+
+#include <algorithm>
+#include <system_error>
+#include <utility>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "log.h"
+#include "metrics.h"
+#include "session_protocol.h"
+
+namespace drop {
+
+namespace {
+
+// Ticks of the event loop: how soon new subscribers, refreshes and file
+// changes are picked up
+constexpr int kTickMs = 100;
+
+// Largest single write, so one subscriber cannot hog a tick
+constexpr std::uint32_t kMaxWrite = 32768;
+
+} // namespace
+
+WatchHub::WatchHub(std::shared_ptr<const ISecretProvider> provider,
+		   std::filesystem::path		  watch_path,
+		   const Limits&			  limits)
+    : limits_{limits},
+      provider_{std::move(provider)}
+{
+#ifdef __linux__
+	inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+	watch(std::move(watch_path));
+
+	load();
+	thread_ = std::jthread{[this](std::stop_token stop) { loop(stop); }};
+}
+
+WatchHub::~WatchHub()
+{
+	thread_.request_stop();
+	wake_.notify_all();
+	if (thread_.joinable())
+		thread_.join();
+
+#ifdef __linux__
+	if (inotify_fd_ >= 0)
+		::close(inotify_fd_);
+#endif
+}
+
+bool WatchHub::adopt(SshSession&& session, SshChannel&& channel)
+{
+	if (subscribers_.fetch_add(1, std::memory_order_relaxed)
+	    >= limits_.max_subscribers) {
+		subscribers_.fetch_sub(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	auto sub     = std::make_unique<Subscriber>(std::move(session),
+						    std::move(channel));
+	sub->started = std::chrono::steady_clock::now();
+	{
+		std::scoped_lock lock{mutex_};
+		incoming_.push_back(std::move(sub));
+	}
+	metrics::add(metrics::Gauge::watch_subscribers, 1);
+	wake_.notify_one();
+	return true;
+}
+
+void WatchHub::reload(std::shared_ptr<const ISecretProvider> provider,
+		      std::filesystem::path		     watch_path)
+{
+	{
+		std::scoped_lock lock{mutex_};
+		next_provider_ = std::move(provider);
+		next_path_     = std::move(watch_path);
+	}
+	refresh_.store(true, std::memory_order_relaxed);
+	wake_.notify_one();
+}
+
+void WatchHub::watch(std::filesystem::path path)
+{
+	watch_path_ = std::move(path);
+	mtime_	    = {};
+
+#ifdef __linux__
+	if (inotify_fd_ < 0) {
+		if (!watch_path_.empty())
+			log::warn("inotify unavailable, polling "
+				  + watch_path_.string());
+		return;
+	}
+	if (watch_fd_ >= 0)
+		(void)inotify_rm_watch(inotify_fd_, watch_fd_);
+	watch_fd_ = -1;
+	if (watch_path_.empty())
+		return;
+
+	// The directory, not the file: editors and deploy tools replace
+	// files by renaming over them, which ends a watch on the file itself
+	const auto dir = watch_path_.parent_path().empty()
+				 ? std::filesystem::path{"."}
+				 : watch_path_.parent_path();
+	watch_fd_      = inotify_add_watch(inotify_fd_, dir.c_str(),
+					   IN_CLOSE_WRITE | IN_MOVED_TO
+							   | IN_CREATE);
+	if (watch_fd_ < 0)
+		log::warn("Could not watch " + dir.string() + ", polling "
+			  + watch_path_.string());
+#endif
+}
+
+bool WatchHub::changed()
+{
+	if (watch_path_.empty())
+		return false;
+
+#ifdef __linux__
+	if (watch_fd_ >= 0) {
+		// Any event in the directory may concern the file; reading it
+		// again is cheap and load() ignores an unchanged value
+		alignas(inotify_event) char buf[4096];
+		bool			    any = false;
+		while (::read(inotify_fd_, buf, sizeof(buf)) > 0)
+			any = true;
+		return any;
+	}
+#endif
+
+	std::error_code ec;
+	const auto	mtime =
+			std::filesystem::last_write_time(watch_path_, ec);
+	if (ec || mtime == mtime_)
+		return false;
+	mtime_ = mtime;
+	return true;
+}
+
+void WatchHub::load()
+{
+	std::string value;
+	try {
+		value = provider_->get_secret();
+	} catch (const std::exception& e) {
+		// Mid-replacement, most likely: keep pushing the old value
+		log::warn(std::string{"Watch: secret unreadable: "} + e.what());
+		return;
+	}
+	if (snapshot_ && value == value_)
+		return;
+
+	value_	  = std::move(value);
+	snapshot_ = std::make_shared<const std::string>(
+			protocol::reply(protocol::Status::ok, value_));
+	version_++;
+	if (version_ > 1)
+		log::info("Watched secret changed, pushing version "
+			  + std::to_string(version_));
+}
+
+bool WatchHub::flush(Subscriber&			  sub,
+		     std::chrono::steady_clock::time_point now)
+{
+	ssh_channel channel = sub.channel.get();
+	if (!ssh_is_connected(sub.session.get())
+	    || ssh_channel_is_closed(channel) || ssh_channel_is_eof(channel))
+		return false;
+
+	// Between frames: start on the newest one, if this subscriber has
+	// not had it yet
+	if (!sub.frame) {
+		if (sub.version == version_)
+			return true;
+		sub.frame   = snapshot_;
+		sub.offset  = 0;
+		sub.version = version_;
+		sub.started = now;
+	}
+
+	// Only what the peer's window takes: a full window is the peer not
+	// reading, and a blocking write would stall every subscriber
+	const auto left = sub.frame->size() - sub.offset;
+	const auto room = std::min<std::size_t>(
+			{left, ssh_channel_window_size(channel), kMaxWrite});
+	if (room > 0) {
+		const int n = ssh_channel_write(
+				channel, sub.frame->data() + sub.offset,
+				static_cast<std::uint32_t>(room));
+		if (n < 0)
+			return false;
+		sub.offset += static_cast<std::size_t>(n);
+	}
+
+	if (sub.offset == sub.frame->size()) {
+		sub.frame.reset();
+		metrics::add(metrics::Counter::watch_pushes);
+		return true;
+	}
+
+	if (now - sub.started > limits_.stall_timeout) {
+		metrics::add(metrics::Counter::watch_stalled);
+		log::info("Watch: dropping a subscriber that stopped reading");
+		return false;
+	}
+	return true;
+}
+
+void WatchHub::loop(std::stop_token stop)
+{
+	SshEvent				 event;
+	std::vector<std::unique_ptr<Subscriber>> subs;
+
+	while (!stop.stop_requested()) {
+		{
+			std::unique_lock lock{mutex_};
+			// Idle: nothing to poll, so sleep until a subscriber
+			// or a refresh turns up
+			if (subs.empty() && incoming_.empty())
+				wake_.wait_for(lock,
+					       std::chrono::milliseconds{
+							       kTickMs});
+			for (auto& sub : incoming_) {
+				sub->session.set_blocking(false);
+				event.add_session(sub->session);
+				subs.push_back(std::move(sub));
+			}
+			incoming_.clear();
+		}
+
+		if (refresh_.exchange(false, std::memory_order_relaxed)) {
+			std::unique_lock lock{mutex_};
+			auto		 provider = std::move(next_provider_);
+			auto		 path	  = std::move(next_path_);
+			lock.unlock();
+
+			if (provider)
+				provider_ = std::move(provider);
+			if (path != watch_path_)
+				watch(std::move(path));
+			(void)changed();
+			load();
+		} else if (changed()) {
+			load();
+		}
+		if (subs.empty())
+			continue;
+
+		// Handles window adjusts, EOF and close from every peer. An
+		// error here is one broken session, found below.
+		(void)event.poll(kTickMs);
+
+		const auto now = std::chrono::steady_clock::now();
+		std::erase_if(subs, [&](std::unique_ptr<Subscriber>& sub) {
+			if (flush(*sub, now))
+				return false;
+			event.remove_session(sub->session);
+			subscribers_.fetch_sub(1, std::memory_order_relaxed);
+			metrics::add(metrics::Gauge::watch_subscribers, -1);
+			return true;
+		});
+	}
+
+	for (auto& sub : subs)
+		event.remove_session(sub->session);
+
+	std::scoped_lock lock{mutex_};
+	const auto	 left = subs.size() + incoming_.size();
+	metrics::add(metrics::Gauge::watch_subscribers,
+		     -static_cast<std::int64_t>(left));
+}
+
+} // namespace drop
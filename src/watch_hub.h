@@ -0,0 +1,113 @@
+#ifndef SSH_DROP_WATCH_HUB_H_
+#define SSH_DROP_WATCH_HUB_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "secret_provider.h"
+#include "ssh_types.h"
+
+namespace drop {
+
+// Pushes the default secret to subscribed sessions whenever it changes.
+// One thread runs an event loop over every subscriber. A change is read
+// once into an immutable reply frame that all subscribers share; a
+// subscriber still sending an older frame finishes it and then skips
+// straight to the newest, so a slow reader holds at most one frame and
+// never delays anyone else. Writes are capped at the channel window, and a
+// reader that leaves a frame unfinished past the stall timeout is
+// disconnected.
+class WatchHub {
+public:
+	struct Limits {
+		std::size_t	     max_subscribers = 4096;
+		std::chrono::seconds stall_timeout{30};
+	};
+
+	// Follows watch_path with inotify where available, by modification
+	// time elsewhere; with an empty path only reload() notices changes.
+	WatchHub(std::shared_ptr<const ISecretProvider> provider,
+		 std::filesystem::path watch_path, const Limits& limits);
+	~WatchHub();
+
+	WatchHub(const WatchHub&)	     = delete;
+	WatchHub& operator=(const WatchHub&) = delete;
+
+	// Called from a connection thread, which must not touch the session
+	// again: it belongs to the hub's thread from here on. The current
+	// value is the first push. False when the hub is full, and then
+	// session and channel are left with the caller to close.
+	[[nodiscard]] bool adopt(SshSession&& session, SshChannel&& channel);
+
+	// Sessions adopted and not yet dropped
+	[[nodiscard]] std::size_t subscribers() const noexcept
+	{
+		return subscribers_.load(std::memory_order_relaxed);
+	}
+
+	[[nodiscard]] bool full() const noexcept
+	{
+		return subscribers() >= limits_.max_subscribers;
+	}
+
+	// Switches to a new secret source, after a config reload, then
+	// re-reads the secret and pushes it if it changed.
+	void reload(std::shared_ptr<const ISecretProvider> provider,
+		    std::filesystem::path		   watch_path);
+
+private:
+	struct Subscriber {
+		SshSession session;
+		SshChannel channel;
+
+		// Frame in flight and how much of it is out
+		std::shared_ptr<const std::string>    frame;
+		std::size_t			      offset  = 0;
+		std::uint64_t			      version = 0;
+		std::chrono::steady_clock::time_point started;
+	};
+
+	void loop(std::stop_token stop);
+	void watch(std::filesystem::path path);
+	bool changed();
+	void load();
+	// False once the subscriber should be dropped
+	bool flush(Subscriber& sub, std::chrono::steady_clock::time_point now);
+
+	const Limits limits_;
+	int	     inotify_fd_ = -1;
+	int	     watch_fd_	 = -1;
+
+	std::mutex				 mutex_;
+	std::condition_variable			 wake_;
+	std::vector<std::unique_ptr<Subscriber>> incoming_;
+	std::atomic<std::size_t>		 subscribers_{0};
+	std::atomic<bool>			 refresh_{false};
+	// Guarded by mutex_: the source a reload hands over
+	std::shared_ptr<const ISecretProvider> next_provider_;
+	std::filesystem::path		       next_path_;
+
+	// Hub thread only
+	std::shared_ptr<const ISecretProvider> provider_;
+	std::filesystem::path		       watch_path_;
+	std::string			   value_;
+	std::shared_ptr<const std::string> snapshot_;
+	std::uint64_t			   version_ = 0;
+	std::filesystem::file_time_type	   mtime_;
+
+	std::jthread thread_;
+};
+
+} // namespace drop
+
+#endif // SSH_DROP_WATCH_HUB_H_
@@ -0,0 +1,233 @@
+#include "worker_pool.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "log.h"
+
+namespace drop {
+
+#ifdef _WIN32
+
+WorkerPool::WorkerPool(int count, Body body)
+    : body_{std::move(body)}
+{
+	(void)count;
+	throw std::runtime_error{"Worker processes are not supported on this "
+				 "platform"};
+}
+
+WorkerPool::~WorkerPool() = default;
+
+void WorkerPool::tend(std::chrono::milliseconds timeout)
+{
+	(void)timeout;
+}
+
+void WorkerPool::signal(int sig) noexcept
+{
+	(void)sig;
+}
+
+void WorkerPool::stop(std::chrono::seconds drain) noexcept
+{
+	(void)drain;
+}
+
+void WorkerPool::spawn(int index)
+{
+	(void)index;
+}
+
+void WorkerPool::retire(Slot& slot)
+{
+	(void)slot;
+}
+
+void WorkerPool::reap() noexcept
+{
+}
+
+#else
+
+namespace {
+
+// A worker that dies sooner than this after starting is replaced only once
+// that long has passed, so a crash at startup does not spin
+constexpr auto kMinLifetime = std::chrono::seconds{1};
+
+void log_exit(int pid, int status)
+{
+	const std::string who = "Worker " + std::to_string(pid);
+	if (WIFSIGNALED(status))
+		log::error(who + " killed by signal "
+			   + std::to_string(WTERMSIG(status)));
+	else if (WIFEXITED(status) && WEXITSTATUS(status) != 0)
+		log::error(who + " exited with status "
+			   + std::to_string(WEXITSTATUS(status)));
+	else
+		log::info(who + " exited");
+}
+
+} // namespace
+
+WorkerPool::WorkerPool(int count, Body body)
+    : body_{std::move(body)},
+      slots_(static_cast<std::size_t>(count))
+{
+	for (int i = 0; i < count; ++i)
+		spawn(i);
+}
+
+// Only reached with workers running when the supervisor failed
+WorkerPool::~WorkerPool()
+{
+	stop(std::chrono::seconds{0});
+}
+
+void WorkerPool::spawn(int index)
+{
+	int fds[2];
+	if (::pipe2(fds, O_CLOEXEC) != 0)
+		throw std::system_error{errno, std::generic_category(),
+					"pipe2"};
+
+	log::flush();
+	const pid_t pid = ::fork();
+	if (pid < 0) {
+		const int err = errno;
+		::close(fds[0]);
+		::close(fds[1]);
+		throw std::system_error{err, std::generic_category(), "fork"};
+	}
+
+	if (pid == 0) {
+		::close(fds[0]);
+		for (const auto& s : slots_)
+			if (s.retire_fd >= 0)
+				::close(s.retire_fd);
+
+		int code = 0;
+		try {
+			body_(index, fds[1]);
+		} catch (const std::exception& e) {
+			log::error(e.what());
+			code = 1;
+		}
+		log::flush();
+		std::_Exit(code);
+	}
+
+	::close(fds[1]);
+	auto& slot	= slots_[static_cast<std::size_t>(index)];
+	slot.pid	= pid;
+	slot.retire_fd	= fds[0];
+	slot.started	= std::chrono::steady_clock::now();
+	slot.respawn_at = slot.started;
+	log::info("Started worker " + std::to_string(index) + " as pid "
+		  + std::to_string(pid));
+}
+
+void WorkerPool::retire(Slot& slot)
+{
+	::close(slot.retire_fd);
+	draining_.push_back(slot.pid);
+	slot.pid	= 0;
+	slot.retire_fd	= -1;
+	slot.respawn_at = slot.started + kMinLifetime;
+}
+
+void WorkerPool::reap() noexcept
+{
+	std::erase_if(draining_, [](int pid) {
+		int status = 0;
+		if (::waitpid(pid, &status, WNOHANG) != pid)
+			return false;
+		log_exit(pid, status);
+		return true;
+	});
+}
+
+void WorkerPool::tend(std::chrono::milliseconds timeout)
+{
+	std::vector<pollfd> pfds;
+	for (const auto& s : slots_)
+		if (s.retire_fd >= 0)
+			pfds.push_back({s.retire_fd, POLLIN, 0});
+
+	// EOF: the worker closed its end to retire, or died
+	if (::poll(pfds.data(), pfds.size(), static_cast<int>(timeout.count()))
+	    > 0)
+		for (const auto& p : pfds) {
+			if (p.revents == 0)
+				continue;
+			for (auto& s : slots_)
+				if (s.retire_fd == p.fd)
+					retire(s);
+		}
+	reap();
+
+	const auto now = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < slots_.size(); ++i) {
+		if (slots_[i].pid != 0 || now < slots_[i].respawn_at)
+			continue;
+		try {
+			spawn(static_cast<int>(i));
+		} catch (const std::exception& e) {
+			log::error(std::string{"Could not start a worker: "}
+				   + e.what());
+			slots_[i].respawn_at = now + kMinLifetime;
+		}
+	}
+}
+
+void WorkerPool::signal(int sig) noexcept
+{
+	for (const auto& s : slots_)
+		if (s.pid != 0)
+			::kill(s.pid, sig);
+	for (int pid : draining_)
+		::kill(pid, sig);
+}
+
+void WorkerPool::stop(std::chrono::seconds drain) noexcept
+{
+	for (auto& s : slots_)
+		if (s.pid != 0)
+			retire(s);
+	signal(SIGTERM);
+
+	const auto deadline = std::chrono::steady_clock::now() + drain;
+	for (reap(); !draining_.empty()
+		     && std::chrono::steady_clock::now() < deadline;
+	     reap())
+		std::this_thread::sleep_for(std::chrono::milliseconds{100});
+
+	if (!draining_.empty())
+		log::warn(std::to_string(draining_.size())
+			  + " workers still draining; killing them");
+	for (int pid : draining_) {
+		int status = 0;
+		::kill(pid, SIGKILL);
+		if (::waitpid(pid, &status, 0) == pid)
+			log_exit(pid, status);
+	}
+	draining_.clear();
+}
+
+#endif
+
+} // namespace drop
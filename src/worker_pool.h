@@ -0,0 +1,60 @@
+#ifndef SSH_DROP_WORKER_POOL_H_
+#define SSH_DROP_WORKER_POOL_H_
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+namespace drop {
+
+// Forked worker processes serving one listener that the parent opened. A
+// crash, or heap growth, is confined to one worker; the parent only
+// supervises, and must not start threads of its own, since every worker
+// is forked from it.
+//
+// Each worker is handed the write end of a pipe and closes it when it
+// stops accepting, to be recycled or because it is exiting anyway; the
+// parent then starts a replacement straight away while the old one drains.
+class WorkerPool {
+public:
+	// Runs in the worker, which exits when it returns.
+	using Body = std::function<void(int index, int retire_fd)>;
+
+	WorkerPool(int count, Body body);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&)		 = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	// Waits up to timeout for a worker to retire or exit, reaps, and
+	// starts workers for empty slots. Call in a loop.
+	void tend(std::chrono::milliseconds timeout);
+
+	// To every worker still running, draining ones included.
+	void signal(int sig) noexcept;
+
+	// SIGTERM to every worker, then SIGKILL to those still running after
+	// drain.
+	void stop(std::chrono::seconds drain) noexcept;
+
+private:
+	struct Slot {
+		int				      pid	= 0;
+		int				      retire_fd = -1;
+		std::chrono::steady_clock::time_point started;
+		std::chrono::steady_clock::time_point respawn_at;
+	};
+
+	void spawn(int index);
+	void retire(Slot& slot);
+	void reap() noexcept;
+
+	Body		  body_;
+	std::vector<Slot> slots_;
+	// Retired workers still finishing their connections
+	std::vector<int> draining_;
+};
+
+} // namespace drop
+
+#endif // SSH_DROP_WORKER_POOL_H_